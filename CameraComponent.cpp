@@ -1,5 +1,6 @@
 #include "CameraComponent.h"
 #include "Entity.h"
+#include "SceneArchive.h"
 #include <Windows.h>
 using namespace DirectX;
 
@@ -15,7 +16,7 @@ void CameraComponent::Tick(float deltaTime)
 	Transform* transform = GetOwner()->GetTransform();
 	XMVECTOR upAxis = XMVectorSet(0, 1.0f, 0.0f, 1.0f);
 
-	XMFLOAT3 pos = transform->GetPosition();
+	XMFLOAT3 pos = transform->GetWorldPosition();
 	XMFLOAT3 fwd = transform->GetForward();
 
 	XMVECTOR globalForward = XMLoadFloat3(&fwd);
@@ -31,8 +32,8 @@ void CameraComponent::UpdateProjectionMatrix(float aspect)
 	XMMATRIX P = XMMatrixPerspectiveFovLH(
 		0.25f * 3.1415926535f,		// Field of View Angle
 		aspect,						// Aspect ratio
-		0.1f,						// Near clip plane distance
-		100.0f);					// Far clip plane distance
+		m_nearClip,					// Near clip plane distance
+		m_farClip);					// Far clip plane distance
 	XMStoreFloat4x4(&m_projection, XMMatrixTranspose(P)); // Transpose for HLSL!
 }
 
@@ -44,3 +45,8 @@ void CameraComponent::OnResize(int width, int height)
 {
 	UpdateProjectionMatrix((float)width / height);
 }
+
+void CameraComponent::Serialize(SceneArchive& archive)
+{
+	archive.Fields(this);
+}
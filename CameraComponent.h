@@ -11,12 +11,16 @@ class CameraComponent : public Component
 private:
 	DirectX::XMFLOAT4X4 m_view;
 	DirectX::XMFLOAT4X4 m_projection;
+	float m_nearClip = 0.1f;
+	float m_farClip = 100.0f;
 public:
 	CameraComponent(Entity* entity);
 
 	// Getters
 	DirectX::XMFLOAT4X4 GetViewMatrix() { return m_view; }
 	DirectX::XMFLOAT4X4 GetProjectionMatrix() { return m_projection; }
+	float GetNearClip() { return m_nearClip; }
+	float GetFarClip() { return m_farClip; }
 
 
 	// --------------------------------------------------------
@@ -38,5 +42,11 @@ public:
 
 	virtual void OnResize(int width, int height) override;
 
+	virtual void Serialize(SceneArchive& archive) override;
+
+	REFLECT_FIELDS(CameraComponent,
+		REFLECT_FIELD("nearClip", m_nearClip),
+		REFLECT_FIELD("farClip", m_farClip))
+
 };
 
@@ -0,0 +1,166 @@
+#include "CollisionLayers.h"
+#include <cassert>
+
+CollisionLayers::CollisionLayers()
+{
+	m_names[DEFAULT_LAYER] = "Default";
+	for (uint32_t& mask : m_masks) {
+		mask = 0xFFFFFFFF;
+	}
+}
+
+void CollisionLayers::Attach(btDiscreteDynamicsWorld* world)
+{
+	m_world = world;
+	m_world->getPairCache()->setOverlapFilterCallback(this);
+}
+
+int CollisionLayers::CreateLayer(const std::string& name)
+{
+	int existing = GetLayer(name);
+	if (existing >= 0) {
+		return existing;
+	}
+	if (m_layerCount == MAX_LAYERS) {
+		return -1;
+	}
+	m_names[m_layerCount] = name;
+	return m_layerCount++;
+}
+
+int CollisionLayers::GetLayer(const std::string& name) const
+{
+	for (int i = 0; i < m_layerCount; ++i) {
+		if (m_names[i] == name) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+const std::string& CollisionLayers::GetLayerName(int layer) const
+{
+	static const std::string noName;
+	assert(IsLayer(layer));
+	return IsLayer(layer) ? m_names[layer] : noName;
+}
+
+void CollisionLayers::SetCollides(int layerA, int layerB, bool collides)
+{
+	assert(IsLayer(layerA) && IsLayer(layerB));
+	if (!IsLayer(layerA) || !IsLayer(layerB) || GetCollides(layerA, layerB) == collides) {
+		return;
+	}
+	if (collides) {
+		m_masks[layerA] |= 1u << layerB;
+		m_masks[layerB] |= 1u << layerA;
+	}
+	else {
+		m_masks[layerA] &= ~(1u << layerB);
+		m_masks[layerB] &= ~(1u << layerA);
+	}
+	Refresh(layerA);
+	if (layerB != layerA) {
+		Refresh(layerB);
+	}
+}
+
+bool CollisionLayers::GetCollides(int layerA, int layerB) const
+{
+	assert(IsLayer(layerA) && IsLayer(layerB));
+	return IsLayer(layerA) && IsLayer(layerB) && (m_masks[layerA] & (1u << layerB)) != 0;
+}
+
+int CollisionLayers::GetGroup(int layer) const
+{
+	assert(IsLayer(layer));
+	return IsLayer(layer) ? (int)(1u << layer) : 0;
+}
+
+int CollisionLayers::GetMask(int layer) const
+{
+	assert(IsLayer(layer));
+	return IsLayer(layer) ? (int)m_masks[layer] : 0;
+}
+
+void CollisionLayers::Refresh(int layer)
+{
+	if (!m_world) {
+		return;
+	}
+
+	// Collect first, since re-adding reorders the world's object array
+	btAlignedObjectArray<btCollisionObject*> onLayer;
+	btCollisionObjectArray& objects = m_world->getCollisionObjectArray();
+	for (int i = 0; i < objects.size(); ++i) {
+		btBroadphaseProxy* proxy = objects[i]->getBroadphaseHandle();
+		if (proxy && proxy->m_collisionFilterGroup == GetGroup(layer)) {
+			onLayer.push_back(objects[i]);
+		}
+	}
+	for (int i = 0; i < onLayer.size(); ++i) {
+		Readd(onLayer[i], layer);
+	}
+}
+
+void CollisionLayers::Readd(btCollisionObject* object, int layer)
+{
+	btRigidBody* body = btRigidBody::upcast(object);
+	if (body) {
+		m_world->removeRigidBody(body);
+		m_world->addRigidBody(body, GetGroup(layer), GetMask(layer));
+	}
+	else {
+		m_world->removeCollisionObject(object);
+		m_world->addCollisionObject(object, GetGroup(layer), GetMask(layer));
+	}
+}
+
+void CollisionLayers::SetObjectLayer(btCollisionObject* object, int layer)
+{
+	assert(IsLayer(layer));
+	btBroadphaseProxy* proxy = object->getBroadphaseHandle();
+	if (!IsLayer(layer) || !m_world || !proxy || (proxy->m_collisionFilterGroup == GetGroup(layer) && proxy->m_collisionFilterMask == GetMask(layer))) {
+		return;
+	}
+	Readd(object, layer);
+}
+
+CollisionPairStats CollisionLayers::GetStats() const
+{
+	CollisionPairStats stats;
+	stats.candidatePairs = m_candidatePairs;
+	stats.filteredPairs = m_filteredPairs;
+	if (m_world) {
+		stats.overlappingPairs = m_world->getPairCache()->getNumOverlappingPairs();
+		stats.manifolds = m_world->getDispatcher()->getNumManifolds();
+	}
+	return stats;
+}
+
+void CollisionLayers::ResetStats()
+{
+	m_candidatePairs = 0;
+	m_filteredPairs = 0;
+}
+
+bool CollisionLayers::IsStatic(const btBroadphaseProxy* proxy)
+{
+	// Kinematic bodies count, as they do in Bullet's own static group
+	const btCollisionObject* object = static_cast<const btCollisionObject*>(proxy->m_clientObject);
+	return btRigidBody::upcast(object) && object->isStaticOrKinematicObject();
+}
+
+bool CollisionLayers::needBroadphaseCollision(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) const
+{
+	// Same test as Bullet's default filter, but counted. Layers replace
+	// Bullet's static group, so static bodies are kept apart here instead.
+	m_candidatePairs++;
+	bool collides = (proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) != 0 &&
+		(proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask) != 0 &&
+		!(IsStatic(proxy0) && IsStatic(proxy1));
+	if (!collides) {
+		m_filteredPairs++;
+	}
+	return collides;
+}
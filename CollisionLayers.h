@@ -0,0 +1,99 @@
+#pragma once
+#include <bullet/btBulletDynamicsCommon.h>
+#include <string>
+#include <cstdint>
+
+// --------------------------------------------------------
+// Broadphase pair counters for the last physics step
+// --------------------------------------------------------
+struct CollisionPairStats
+{
+	size_t candidatePairs = 0;	// New pairs whose bounds started overlapping
+	size_t filteredPairs = 0;	// Of those, pairs rejected by the layer matrix
+	int overlappingPairs = 0;	// Pairs the broadphase is tracking
+	int manifolds = 0;			// Pairs the narrowphase is tracking
+};
+
+// --------------------------------------------------------
+// Named collision layers and which of them collide with each other.
+// Each layer is one bit of a body's Bullet collision group, and its row
+// of the matrix is the body's collision mask, so filtered pairs are 
+// rejected by the broadphase and never reach the narrowphase.
+// Static and kinematic bodies never pair with each other.
+// --------------------------------------------------------
+class CollisionLayers : public btOverlapFilterCallback
+{
+public:
+	static const int MAX_LAYERS = 32;
+	static const int DEFAULT_LAYER = 0;
+private:
+	std::string m_names[MAX_LAYERS];
+	uint32_t m_masks[MAX_LAYERS];
+	int m_layerCount = 1;
+	btDiscreteDynamicsWorld* m_world = nullptr;
+
+	mutable size_t m_candidatePairs = 0;
+	mutable size_t m_filteredPairs = 0;
+
+	// --------------------------------------------------------
+	// Re-adds every body on a layer so the new mask takes effect,
+	// including for pairs the broadphase already found
+	// --------------------------------------------------------
+	void Refresh(int layer);
+	void Readd(btCollisionObject* object, int layer);
+
+	static bool IsStatic(const btBroadphaseProxy* proxy);
+public:
+	CollisionLayers();
+
+	// --------------------------------------------------------
+	// Installs the layer filter on a physics world
+	// --------------------------------------------------------
+	void Attach(btDiscreteDynamicsWorld* world);
+
+	// --------------------------------------------------------
+	// Adds a layer that collides with every other layer
+	// @returns int the layer's index, an existing layer's index if
+	// the name is taken, or -1 if there are already MAX_LAYERS layers
+	// --------------------------------------------------------
+	int CreateLayer(const std::string& name);
+
+	// --------------------------------------------------------
+	// @returns int the layer's index, or -1 if there is no such layer
+	// --------------------------------------------------------
+	int GetLayer(const std::string& name) const;
+	const std::string& GetLayerName(int layer) const;
+	int GetLayerCount() const { return m_layerCount; }
+
+	// --------------------------------------------------------
+	// Whether a layer index refers to a created layer. Functions
+	// taking a layer assert on bad ones, and otherwise ignore them.
+	// --------------------------------------------------------
+	bool IsLayer(int layer) const { return layer >= 0 && layer < m_layerCount; }
+
+	// --------------------------------------------------------
+	// Sets whether bodies on two layers collide. Bodies that are 
+	// already in the world are updated.
+	// --------------------------------------------------------
+	void SetCollides(int layerA, int layerB, bool collides);
+	bool GetCollides(int layerA, int layerB) const;
+
+	// --------------------------------------------------------
+	// Bullet collision group and mask for a layer, or 0 for a bad layer
+	// --------------------------------------------------------
+	int GetGroup(int layer) const;
+	int GetMask(int layer) const;
+
+	// --------------------------------------------------------
+	// Moves an object that's already in the world to another layer
+	// --------------------------------------------------------
+	void SetObjectLayer(btCollisionObject* object, int layer);
+
+	// --------------------------------------------------------
+	// Returns the pair counters since the last reset
+	// --------------------------------------------------------
+	CollisionPairStats GetStats() const;
+	void ResetStats();
+
+	virtual bool needBroadphaseCollision(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) const override;
+};
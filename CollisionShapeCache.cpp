@@ -0,0 +1,406 @@
+#include "CollisionShapeCache.h"
+#include "Mesh.h"
+#include "SceneArchive.h"
+#include <tuple>
+#include <fstream>
+#include <cstdint>
+#include <Windows.h>
+#include <bullet/LinearMath/btConvexHullComputer.h>
+
+using namespace DirectX;
+
+ShapeDesc ShapeDesc::Box(float halfX, float halfY, float halfZ)
+{
+	ShapeDesc desc;
+	desc.type = ShapeType::Box;
+	desc.dimensions = XMFLOAT3(halfX, halfY, halfZ);
+	return desc;
+}
+
+ShapeDesc ShapeDesc::Sphere(float radius)
+{
+	ShapeDesc desc;
+	desc.type = ShapeType::Sphere;
+	desc.dimensions = XMFLOAT3(radius, 0, 0);
+	return desc;
+}
+
+ShapeDesc ShapeDesc::Capsule(float radius, float height)
+{
+	ShapeDesc desc;
+	desc.type = ShapeType::Capsule;
+	desc.dimensions = XMFLOAT3(radius, height, 0);
+	return desc;
+}
+
+ShapeDesc ShapeDesc::ConvexHull(MeshHandle mesh, DirectX::XMFLOAT3 scale)
+{
+	ShapeDesc desc;
+	desc.type = ShapeType::ConvexHull;
+	desc.mesh = mesh;
+	desc.scale = scale;
+	return desc;
+}
+
+ShapeDesc ShapeDesc::TriangleMesh(MeshHandle mesh, DirectX::XMFLOAT3 scale)
+{
+	ShapeDesc desc;
+	desc.type = ShapeType::TriangleMesh;
+	desc.mesh = mesh;
+	desc.scale = scale;
+	return desc;
+}
+
+void ShapeDesc::Serialize(SceneArchive& archive, bool& present)
+{
+	static const char* names[] = { "box", "sphere", "capsule", "hull", "trimesh" };
+	const int nameCount = sizeof(names) / sizeof(names[0]);
+
+	std::string name;
+	if (present && (int)type < nameCount) {
+		name = names[(int)type];
+	}
+	archive.Field("shape", name);
+	archive.Fields(this);
+
+	if (archive.IsLoading()) {
+		present = false;
+		for (int i = 0; i < nameCount; ++i) {
+			if (name == names[i]) {
+				type = (ShapeType)i;
+				present = true;
+			}
+		}
+	}
+}
+
+bool CollisionShapeCache::ShapeKey::operator<(const ShapeKey& other) const
+{
+	return std::tie(type, values[0], values[1], values[2], values[3], values[4], values[5], mesh, name) <
+		std::tie(other.type, other.values[0], other.values[1], other.values[2], other.values[3], other.values[4], other.values[5], other.mesh, other.name);
+}
+
+CollisionShapeCache::ShapeKey CollisionShapeCache::MakeKey(const ShapeDesc& desc)
+{
+	ShapeKey key;
+	key.type = desc.type;
+	key.values[0] = desc.dimensions.x;
+	key.values[1] = desc.dimensions.y;
+	key.values[2] = desc.dimensions.z;
+	key.values[3] = desc.scale.x;
+	key.values[4] = desc.scale.y;
+	key.values[5] = desc.scale.z;
+	key.mesh = desc.mesh;
+	return key;
+}
+
+btCollisionShape* CollisionShapeCache::AddEntry(const ShapeKey& key, Entry& entry)
+{
+	entry.refCount = 1;
+	EntryMap::iterator it = m_entries.insert(std::make_pair(key, entry)).first;
+	m_byShape[entry.shape] = it;
+	return entry.shape;
+}
+
+void CollisionShapeCache::Build(const ShapeDesc& desc, Entry& entry)
+{
+	bool scaled = desc.scale.x != 1.0f || desc.scale.y != 1.0f || desc.scale.z != 1.0f;
+	btVector3 scale(desc.scale.x, desc.scale.y, desc.scale.z);
+
+	switch (desc.type) {
+	case ShapeType::Box:
+		entry.shape = new btBoxShape(btVector3(desc.dimensions.x, desc.dimensions.y, desc.dimensions.z));
+		break;
+	case ShapeType::Sphere:
+		entry.shape = new btSphereShape(desc.dimensions.x);
+		break;
+	case ShapeType::Capsule:
+		entry.shape = new btCapsuleShape(desc.dimensions.x, desc.dimensions.y);
+		break;
+	case ShapeType::ConvexHull:
+		if (scaled) {
+			// Copy the unscaled hull's points rather than computing the hull again.
+			// It's kept while scaled copies exist, so each new scale can copy it too.
+			btConvexHullShape* unscaled = static_cast<btConvexHullShape*>(Acquire(ShapeDesc::ConvexHull(desc.mesh)));
+			if (!unscaled) {
+				break;
+			}
+			entry.dependencies.push_back(unscaled);
+			btConvexHullShape* hull = new btConvexHullShape(&unscaled->getUnscaledPoints()[0].getX(), unscaled->getNumPoints(), sizeof(btVector3));
+			hull->setLocalScaling(scale);
+			entry.shape = hull;
+		}
+		else {
+			entry.shape = BuildConvexHull(desc.mesh);
+		}
+		break;
+	case ShapeType::TriangleMesh:
+		if (scaled) {
+			// Scaled copies share the unscaled mesh's tree rather than building their own
+			btCollisionShape* unscaled = Acquire(ShapeDesc::TriangleMesh(desc.mesh));
+			if (!unscaled) {
+				break;
+			}
+			entry.dependencies.push_back(unscaled);
+			entry.shape = new btScaledBvhTriangleMeshShape(static_cast<btBvhTriangleMeshShape*>(unscaled), scale);
+		}
+		else {
+			entry.shape = BuildTriangleMesh(desc.mesh, entry);
+			entry.mesh = desc.mesh;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+btCollisionShape* CollisionShapeCache::BuildConvexHull(Mesh* mesh)
+{
+	const std::vector<XMFLOAT3>& positions = mesh->GetPositions();
+	if (positions.empty()) {
+		return nullptr;
+	}
+
+	// Keep only the points on the hull, so support queries don't walk every vertex
+	btConvexHullComputer computer;
+	computer.compute(&positions[0].x, sizeof(XMFLOAT3), (int)positions.size(), 0.0f, 0.0f);
+	if (computer.vertices.size() == 0) {
+		return nullptr;
+	}
+	return new btConvexHullShape(&computer.vertices[0].getX(), computer.vertices.size(), sizeof(btVector3));
+}
+
+btCollisionShape* CollisionShapeCache::BuildTriangleMesh(Mesh* mesh, Entry& entry)
+{
+	// The mesh interface points straight at the Mesh's CPU copies
+	const std::vector<XMFLOAT3>& positions = mesh->GetPositions();
+	const std::vector<unsigned int>& indices = mesh->GetIndices();
+	if (indices.size() < 3) {
+		return nullptr;
+	}
+	entry.meshInterface = new btTriangleIndexVertexArray(
+		(int)(indices.size() / 3), (int*)indices.data(), 3 * sizeof(unsigned int),
+		(int)positions.size(), (btScalar*)positions.data(), sizeof(XMFLOAT3));
+
+	btOptimizedBvh* cooked = LoadCookedBvh(mesh, entry);
+	if (cooked) {
+		btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(entry.meshInterface, true, false);
+		shape->setOptimizedBvh(cooked);
+		return shape;
+	}
+
+	btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(entry.meshInterface, true);
+	SaveCookedBvh(mesh, shape->getOptimizedBvh());
+	return shape;
+}
+
+namespace
+{
+	// Start of a cooked tree file
+	struct CookedHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint64_t meshHash;
+		uint32_t dataSize;
+		uint32_t padding;
+	};
+
+	const uint32_t COOKED_MAGIC = 0x48564246; // "FBVH"
+	const uint32_t COOKED_VERSION = 1;
+
+	// FNV-1a over the mesh data, so a cooked tree is rebuilt when the mesh changes
+	uint64_t HashMesh(Mesh* mesh)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto hashBytes = [&hash](const void* data, size_t size) {
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; ++i) {
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		};
+		hashBytes(mesh->GetPositions().data(), mesh->GetPositions().size() * sizeof(XMFLOAT3));
+		hashBytes(mesh->GetIndices().data(), mesh->GetIndices().size() * sizeof(unsigned int));
+		return hash;
+	}
+
+	CookedHeader MakeHeader(Mesh* mesh, uint32_t dataSize)
+	{
+		CookedHeader header;
+		header.magic = COOKED_MAGIC;
+		header.version = COOKED_VERSION;
+		header.vertexCount = (uint32_t)mesh->GetPositions().size();
+		header.indexCount = (uint32_t)mesh->GetIndices().size();
+		header.meshHash = HashMesh(mesh);
+		header.dataSize = dataSize;
+		header.padding = 0;
+		return header;
+	}
+}
+
+btOptimizedBvh* CollisionShapeCache::LoadCookedBvh(Mesh* mesh, Entry& entry)
+{
+	if (m_cookedDirectory.empty() || mesh->GetName().empty()) {
+		return nullptr;
+	}
+
+	std::ifstream file(m_cookedDirectory + "/" + mesh->GetName() + ".bvh", std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return nullptr;
+	}
+	std::streamoff fileSize = file.tellg();
+	file.seekg(0);
+
+	CookedHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	CookedHeader expected = MakeHeader(mesh, header.dataSize);
+	if (!file || header.magic != expected.magic || header.version != expected.version ||
+		header.vertexCount != expected.vertexCount || header.indexCount != expected.indexCount || 
+		header.meshHash != expected.meshHash) {
+		return nullptr;
+	}
+
+	// Don't trust the size until the file is known to hold that much
+	if (fileSize < (std::streamoff)sizeof(header) || (uint64_t)header.dataSize > (uint64_t)(fileSize - (std::streamoff)sizeof(header))) {
+		return nullptr;
+	}
+
+	// The tree is used in place, so the buffer lives as long as the shape
+	void* buffer = btAlignedAlloc(header.dataSize, 16);
+	file.read(static_cast<char*>(buffer), header.dataSize);
+	btOptimizedBvh* bvh = file ? btOptimizedBvh::deSerializeInPlace(buffer, header.dataSize, false) : nullptr;
+	if (!bvh) {
+		btAlignedFree(buffer);
+		return nullptr;
+	}
+	entry.cookedBvh = buffer;
+	return bvh;
+}
+
+void CollisionShapeCache::SaveCookedBvh(Mesh* mesh, btOptimizedBvh* bvh)
+{
+	if (m_cookedDirectory.empty() || mesh->GetName().empty() || !bvh) {
+		return;
+	}
+
+	unsigned int size = bvh->calculateSerializeBufferSize();
+	void* buffer = btAlignedAlloc(size, 16);
+	if (bvh->serializeInPlace(buffer, size, false)) {
+		CreateDirectoryA(m_cookedDirectory.c_str(), nullptr);
+		std::ofstream file(m_cookedDirectory + "/" + mesh->GetName() + ".bvh", std::ios::binary);
+		CookedHeader header = MakeHeader(mesh, size);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(static_cast<const char*>(buffer), size);
+	}
+	btAlignedFree(buffer);
+}
+
+btCollisionShape* CollisionShapeCache::Acquire(const ShapeDesc& desc)
+{
+	ShapeKey key = MakeKey(desc);
+	EntryMap::iterator it = m_entries.find(key);
+	if (it != m_entries.end()) {
+		it->second.refCount++;
+		return it->second.shape;
+	}
+
+	Entry entry;
+	Build(desc, entry);
+	if (!entry.shape) {
+		return nullptr;
+	}
+	return AddEntry(key, entry);
+}
+
+btCollisionShape* CollisionShapeCache::AcquireCompound(const std::string& name, const std::vector<CompoundChild>& children)
+{
+	ShapeKey key = MakeKey(ShapeDesc());
+	key.type = ShapeType::Compound;
+	key.name = name;
+	EntryMap::iterator it = m_entries.find(key);
+	if (it != m_entries.end()) {
+		it->second.refCount++;
+		return it->second.shape;
+	}
+
+	Entry entry;
+	btCompoundShape* compound = new btCompoundShape(true, (int)children.size());
+	for (const CompoundChild& child : children) {
+		btCollisionShape* childShape = Acquire(child.shape);
+		if (!childShape) {
+			continue;
+		}
+		entry.dependencies.push_back(childShape);
+
+		btTransform localTransform;
+		localTransform.setOrigin(btVector3(child.position.x, child.position.y, child.position.z));
+		localTransform.setRotation(btQuaternion(child.rotation.x, child.rotation.y, child.rotation.z, child.rotation.w));
+		compound->addChildShape(localTransform, childShape);
+	}
+	entry.shape = compound;
+	return AddEntry(key, entry);
+}
+
+void CollisionShapeCache::AddRef(btCollisionShape* shape)
+{
+	auto found = m_byShape.find(shape);
+	if (found != m_byShape.end()) {
+		found->second->second.refCount++;
+	}
+}
+
+void CollisionShapeCache::Release(btCollisionShape* shape)
+{
+	auto found = m_byShape.find(shape);
+	if (found == m_byShape.end()) {
+		return;
+	}
+	EntryMap::iterator it = found->second;
+	if (--it->second.refCount == 0) {
+		Free(it);
+	}
+}
+
+void CollisionShapeCache::Free(EntryMap::iterator it)
+{
+	Entry entry = it->second;
+	m_byShape.erase(entry.shape);
+	m_entries.erase(it);
+
+	delete entry.shape;
+	delete entry.meshInterface;
+	if (entry.cookedBvh) {
+		btAlignedFree(entry.cookedBvh);
+	}
+	for (btCollisionShape* dependency : entry.dependencies) {
+		Release(dependency);
+	}
+}
+
+bool CollisionShapeCache::UsesMesh(const Mesh* mesh) const
+{
+	for (const auto& pair : m_entries) {
+		if (pair.first.mesh == mesh) {
+			return true;
+		}
+	}
+	return false;
+}
+
+CollisionShapeCache::~CollisionShapeCache()
+{
+	// Anything still here outlived its bodies. Free dependents first, so
+	// their references to the shapes they depend on are given back.
+	while (!m_entries.empty()) {
+		EntryMap::iterator it = m_entries.begin();
+		for (EntryMap::iterator other = m_entries.begin(); other != m_entries.end(); ++other) {
+			if (!other->second.dependencies.empty()) {
+				it = other;
+				break;
+			}
+		}
+		Free(it);
+	}
+}
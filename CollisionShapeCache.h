@@ -0,0 +1,155 @@
+#pragma once
+#include <bullet/btBulletDynamicsCommon.h>
+#include <DirectXMath.h>
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include "Reflection.h"
+class Mesh;
+class SceneArchive;
+
+enum class ShapeType
+{
+	Box,
+	Sphere,
+	Capsule,
+	ConvexHull,
+	TriangleMesh, // Static and kinematic bodies only
+	Compound
+};
+
+// --------------------------------------------------------
+// Describes a collision shape. Two descriptions with the same 
+// values share a single Bullet shape.
+// --------------------------------------------------------
+struct ShapeDesc
+{
+	ShapeType type = ShapeType::Box;
+	DirectX::XMFLOAT3 dimensions = DirectX::XMFLOAT3(0, 0, 0); // Half extents, or radius and height
+	MeshHandle mesh;
+	DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3(1, 1, 1);
+
+	static ShapeDesc Box(float halfX, float halfY, float halfZ);
+	static ShapeDesc Sphere(float radius);
+	// @param float height distance between the centers of the end caps, along y
+	static ShapeDesc Capsule(float radius, float height);
+	static ShapeDesc ConvexHull(MeshHandle mesh, DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3(1, 1, 1));
+	static ShapeDesc TriangleMesh(MeshHandle mesh, DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3(1, 1, 1));
+
+	// --------------------------------------------------------
+	// Visits the description in a scene file. Compound shapes
+	// can't be stored, and are saved as no shape.
+	// @param bool & present whether there's a shape to save, or whether one was loaded
+	// --------------------------------------------------------
+	void Serialize(SceneArchive& archive, bool& present);
+
+	REFLECT_FIELDS(ShapeDesc,
+		REFLECT_FIELD("dimensions", dimensions),
+		REFLECT_FIELD("shapeMesh", mesh),
+		REFLECT_FIELD("shapeScale", scale))
+};
+
+// --------------------------------------------------------
+// One part of a compound shape, placed relative to the body
+// --------------------------------------------------------
+struct CompoundChild
+{
+	ShapeDesc shape;
+	DirectX::XMFLOAT3 position = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT4 rotation = DirectX::XMFLOAT4(0, 0, 0, 1);
+};
+
+// --------------------------------------------------------
+// Shares collision shapes between rigid bodies. Shapes are made 
+// the first time they're asked for, mesh shapes are cooked from the 
+// Mesh's vertices only once, and a shape is deleted when the last 
+// body using it releases it.
+// --------------------------------------------------------
+class CollisionShapeCache
+{
+private:
+	struct ShapeKey
+	{
+		ShapeType type;
+		float values[6]; // Dimensions then scale
+		Mesh* mesh;
+		std::string name;
+
+		bool operator<(const ShapeKey& other) const;
+	};
+
+	struct Entry
+	{
+		btCollisionShape* shape = nullptr;
+		int refCount = 0;
+
+		// Owned by the entry alongside the shape
+		btStridingMeshInterface* meshInterface = nullptr;
+		void* cookedBvh = nullptr; // Buffer a triangle mesh's tree was loaded into
+		std::vector<btCollisionShape*> dependencies; // Shapes this one holds a reference to
+		MeshHandle mesh; // Keeps the Mesh a triangle mesh shape reads its vertices from
+	};
+
+	typedef std::map<ShapeKey, Entry> EntryMap;
+	EntryMap m_entries;
+	std::unordered_map<const btCollisionShape*, EntryMap::iterator> m_byShape;
+	std::string m_cookedDirectory;
+
+	static ShapeKey MakeKey(const ShapeDesc& desc);
+	btCollisionShape* BuildConvexHull(Mesh* mesh);
+	btCollisionShape* BuildTriangleMesh(Mesh* mesh, Entry& entry);
+
+	// --------------------------------------------------------
+	// Reads or writes the tree of a named Mesh's triangle mesh shape.
+	// Cooked files record the mesh they came from, so stale ones are ignored.
+	// --------------------------------------------------------
+	btOptimizedBvh* LoadCookedBvh(Mesh* mesh, Entry& entry);
+	void SaveCookedBvh(Mesh* mesh, btOptimizedBvh* bvh);
+	btCollisionShape* AddEntry(const ShapeKey& key, Entry& entry);
+	void Build(const ShapeDesc& desc, Entry& entry);
+	void Free(EntryMap::iterator it);
+public:
+	// --------------------------------------------------------
+	// Returns the shared shape for a description, making it if needed.
+	// Every call must be paired with a call to Release.
+	// --------------------------------------------------------
+	btCollisionShape* Acquire(const ShapeDesc& desc);
+
+	// --------------------------------------------------------
+	// Returns the compound shape with this name, making it from the 
+	// children the first time. Later calls with the same name share it
+	// and ignore the children. Pair every call with Release.
+	// --------------------------------------------------------
+	btCollisionShape* AcquireCompound(const std::string& name, const std::vector<CompoundChild>& children);
+
+	// --------------------------------------------------------
+	// Adds a reference to a shape from this cache
+	// --------------------------------------------------------
+	void AddRef(btCollisionShape* shape);
+
+	// --------------------------------------------------------
+	// Gives up a reference. The shape is deleted once none are left.
+	// --------------------------------------------------------
+	void Release(btCollisionShape* shape);
+
+	// --------------------------------------------------------
+	// Sets where triangle mesh trees are cooked to. Once set, the tree 
+	// for a Mesh made with World::CreateMesh is saved the first time it's
+	// built, and later runs load it instead of building it again.
+	// @param const std::string & directory empty to turn cooking off
+	// --------------------------------------------------------
+	void SetCookedDirectory(const std::string& directory) { m_cookedDirectory = directory; }
+
+	// --------------------------------------------------------
+	// Returns how many distinct shapes are alive
+	// --------------------------------------------------------
+	size_t GetShapeCount() const { return m_entries.size(); }
+
+	// --------------------------------------------------------
+	// Whether any shape was made from a Mesh, so it can't be freed yet
+	// --------------------------------------------------------
+	bool UsesMesh(const Mesh* mesh) const;
+
+	~CollisionShapeCache();
+};
@@ -17,17 +17,17 @@ void CollisionTester::OnMouseDown(WPARAM buttonState, int x, int y)
 	GetOwner()->GetRigidBody()->ApplyImpulse(XMFLOAT3(0, 10, 0));
 }
 
-void CollisionTester::OnCollisionBegin(Entity* other)
+void CollisionTester::OnCollisionBegin(EntityHandle other)
 {
 	printf("Began colliding with %s\n", other->GetName().c_str());
 }
 
-void CollisionTester::OnCollisionStay(Entity* other)
+void CollisionTester::OnCollisionStay(EntityHandle other)
 {
 	printf("Colliding with %s\n", other->GetName().c_str());
 }
 
-void CollisionTester::OnCollisionEnd(Entity* other)
+void CollisionTester::OnCollisionEnd(EntityHandle other)
 {
 	printf("Stopped colliding with %s\n", other->GetName().c_str());
 }
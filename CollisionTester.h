@@ -17,13 +17,13 @@ public:
 	virtual void OnMouseDown(WPARAM buttonState, int x, int y) override;
 
 
-	virtual void OnCollisionBegin(Entity* other) override;
+	virtual void OnCollisionBegin(EntityHandle other) override;
 
 
-	virtual void OnCollisionStay(Entity* other) override;
+	virtual void OnCollisionStay(EntityHandle other) override;
 
 
-	virtual void OnCollisionEnd(Entity* other) override;
+	virtual void OnCollisionEnd(EntityHandle other) override;
 
 };
 
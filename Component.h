@@ -1,7 +1,12 @@
 #pragma once
 class Entity;
+class SnapshotWriter;
+class SnapshotReader;
+class SceneArchive;
 #include <Windows.h>
 #include <bullet/btBulletDynamicsCommon.h>
+#include "EntityHandle.h"
+#include "Reflection.h"
 
 // --------------------------------------------------------
 // Abstract Component class which encapsulates state and 
@@ -9,9 +14,13 @@ class Entity;
 // --------------------------------------------------------
 class Component
 {
+	friend class Entity;
 private:
 	Entity* m_owner = nullptr;
 	bool m_enabled = true;
+
+	// Destroys this component and frees its memory. Set by Entity::AddComponent.
+	void (*m_release)(Component* component) = nullptr;
 public:
 	// --------------------------------------------------------
 	// Component Constructor. Do not change the parameters that 
@@ -31,6 +40,14 @@ public:
 	// --------------------------------------------------------
 	virtual void Tick(float deltaTime) = 0;
 
+	// --------------------------------------------------------
+	// Whether Tick has nothing to do while the owner's Transform
+	// isn't moving. Physics only puts an Entity to sleep when all of
+	// its components can sleep, so gameplay components keep their
+	// Entity awake unless they override this.
+	// --------------------------------------------------------
+	virtual bool CanSleep() { return false; }
+
 
 	// Lifecycle Methods ///////////////////////////////////////////
 	virtual void OnResize() { }
@@ -42,11 +59,40 @@ public:
 	///////////////////////////////////////////////////////////////
 	
 	// Collision Methods //////////////////////////////////////////
-	virtual void OnCollisionBegin(Entity* other) { }
-	virtual void OnCollisionStay(Entity* other) { }
-	virtual void OnCollisionEnd(Entity* other) { }
+	virtual void OnCollisionBegin(EntityHandle other) { }
+	virtual void OnCollisionStay(EntityHandle other) { }
+	virtual void OnCollisionEnd(EntityHandle other) { }
+	///////////////////////////////////////////////////////////////
+
+	// Trigger Methods ////////////////////////////////////////////
+	// Called on the trigger's components and on the other Entity's.
+	// other may already be destroyed when a trigger is exited.
+	virtual void OnTriggerEnter(EntityHandle other) { }
+	virtual void OnTriggerExit(EntityHandle other) { }
+	///////////////////////////////////////////////////////////////
+
+	// Snapshot Methods ///////////////////////////////////////////
+	// Components with simulation state write it here, so World 
+	// snapshots can capture and roll it back. LoadState reads back
+	// exactly what SaveState wrote.
+	virtual void SaveState(SnapshotWriter& writer) { }
+	virtual void LoadState(SnapshotReader& reader) { }
 	///////////////////////////////////////////////////////////////
 
+	// --------------------------------------------------------
+	// Visits the settings that scene files store for this component.
+	// Called before Start when a scene is loaded. Only registered
+	// components are saved (see ComponentRegistry). Components that
+	// declare REFLECT_FIELDS can just call archive.Fields(this).
+	// --------------------------------------------------------
+	virtual void Serialize(SceneArchive& archive) { }
+
+	// --------------------------------------------------------
+	// Whether Serialize can store everything the component needs to
+	// load again. Components that can't are left out of scene files.
+	// --------------------------------------------------------
+	virtual bool CanSerialize() { return true; }
+
 	
 	// --------------------------------------------------------
 	// Returns the owner of this Component
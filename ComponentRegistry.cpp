@@ -0,0 +1,34 @@
+#include "ComponentRegistry.h"
+#include "CameraComponent.h"
+#include "SoundComponent.h"
+#include "TriggerComponent.h"
+
+ComponentRegistry::ComponentRegistry()
+{
+	Register<MeshComponent>("MeshComponent");
+	Register<MaterialComponent>("MaterialComponent");
+	Register<RigidBodyComponent>("RigidBodyComponent");
+	Register<LightComponent>("LightComponent");
+	Register<CameraComponent>("CameraComponent");
+	Register<EmitterComponent>("EmitterComponent");
+	Register<SoundComponent>("SoundComponent");
+	Register<TriggerComponent>("TriggerComponent");
+}
+
+ComponentRegistry& ComponentRegistry::GetInstance()
+{
+	static ComponentRegistry registry;
+	return registry;
+}
+
+const ComponentRegistry::TypeInfo* ComponentRegistry::Find(const std::string& name) const
+{
+	auto it = m_byName.find(name);
+	return it != m_byName.end() ? it->second : nullptr;
+}
+
+const ComponentRegistry::TypeInfo* ComponentRegistry::Find(Component* component) const
+{
+	auto it = m_byType.find(std::type_index(typeid(*component)));
+	return it != m_byType.end() ? it->second : nullptr;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <typeindex>
+#include "Entity.h"
+
+// --------------------------------------------------------
+// Component types that scene files can create by name.
+// The engine's components are registered up front; register
+// your own with Register<T> before loading scenes that use them.
+// Components that aren't registered are left out of saved scenes.
+// --------------------------------------------------------
+class ComponentRegistry
+{
+public:
+	struct TypeInfo
+	{
+		std::string name;
+		Component* (*create)(Entity* entity);	// Adds the component to an Entity
+		void (*reserve)(size_t count);			// Grows the type's pool by count
+	};
+private:
+	std::deque<TypeInfo> m_types; // A deque, so TypeInfo pointers stay valid as types are added
+	std::unordered_map<std::string, TypeInfo*> m_byName;
+	std::unordered_map<std::type_index, TypeInfo*> m_byType;
+
+	template <class T>
+	static Component* Create(Entity* entity)
+	{
+		return entity->AddComponent<T>();
+	}
+
+	template <class T>
+	static void Reserve(size_t count)
+	{
+		ObjectPool<T>& pool = ObjectPool<T>::GetInstance();
+		pool.Reserve(pool.GetStats().live + count);
+	}
+
+	ComponentRegistry();
+public:
+	// --------------------------------------------------------
+	// Get the registry
+	// --------------------------------------------------------
+	static ComponentRegistry& GetInstance();
+
+	// --------------------------------------------------------
+	// Makes a component type available to scene files under a name.
+	// T must extend from Component!
+	// --------------------------------------------------------
+	template <class T>
+	void Register(const std::string& name)
+	{
+		if (m_byName.count(name)) {
+			return;
+		}
+		m_types.push_back({ name, &Create<T>, &Reserve<T> });
+		m_byName[name] = &m_types.back();
+		m_byType[std::type_index(typeid(T))] = &m_types.back();
+	}
+
+	// --------------------------------------------------------
+	// @returns const TypeInfo* the type, or nullptr if it isn't registered
+	// --------------------------------------------------------
+	const TypeInfo* Find(const std::string& name) const;
+	const TypeInfo* Find(Component* component) const;
+};
@@ -0,0 +1,421 @@
+#include "DynamicBVH.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace
+{
+	inline int MaxHeight(int a, int b) { return a > b ? a : b; }
+
+	inline float SurfaceArea(const XMFLOAT3& min, const XMFLOAT3& max)
+	{
+		float dx = max.x - min.x;
+		float dy = max.y - min.y;
+		float dz = max.z - min.z;
+		return 2.0f * (dx * dy + dy * dz + dz * dx);
+	}
+
+	inline void Combine(const XMFLOAT3& aMin, const XMFLOAT3& aMax, const XMFLOAT3& bMin, const XMFLOAT3& bMax,
+		XMFLOAT3& outMin, XMFLOAT3& outMax)
+	{
+		outMin = XMFLOAT3(aMin.x < bMin.x ? aMin.x : bMin.x, aMin.y < bMin.y ? aMin.y : bMin.y, aMin.z < bMin.z ? aMin.z : bMin.z);
+		outMax = XMFLOAT3(aMax.x > bMax.x ? aMax.x : bMax.x, aMax.y > bMax.y ? aMax.y : bMax.y, aMax.z > bMax.z ? aMax.z : bMax.z);
+	}
+
+	inline float CombinedArea(const XMFLOAT3& aMin, const XMFLOAT3& aMax, const XMFLOAT3& bMin, const XMFLOAT3& bMax)
+	{
+		XMFLOAT3 min, max;
+		Combine(aMin, aMax, bMin, bMax, min, max);
+		return SurfaceArea(min, max);
+	}
+
+	inline bool Contains(const XMFLOAT3& outerMin, const XMFLOAT3& outerMax, const XMFLOAT3& innerMin, const XMFLOAT3& innerMax)
+	{
+		return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z &&
+			innerMax.x <= outerMax.x && innerMax.y <= outerMax.y && innerMax.z <= outerMax.z;
+	}
+
+	inline void ToMinMax(const BoundingBox& box, XMFLOAT3& min, XMFLOAT3& max)
+	{
+		min = XMFLOAT3(box.Center.x - box.Extents.x, box.Center.y - box.Extents.y, box.Center.z - box.Extents.z);
+		max = XMFLOAT3(box.Center.x + box.Extents.x, box.Center.y + box.Extents.y, box.Center.z + box.Extents.z);
+	}
+}
+
+DynamicBVH::DynamicBVH(float margin) : m_margin(margin)
+{
+}
+
+int DynamicBVH::AllocateNode()
+{
+	int node;
+	if (m_freeList != NULL_NODE) {
+		node = m_freeList;
+		m_freeList = m_nodes[node].parent;
+	}
+	else {
+		node = (int)m_nodes.size();
+		m_nodes.push_back(Node());
+	}
+
+	Node& newNode = m_nodes[node];
+	newNode.entity = nullptr;
+	newNode.parent = NULL_NODE;
+	newNode.child1 = NULL_NODE;
+	newNode.child2 = NULL_NODE;
+	newNode.height = 0;
+	return node;
+}
+
+void DynamicBVH::FreeNode(int node)
+{
+	m_nodes[node].parent = m_freeList;
+	m_nodes[node].height = -1;
+	m_freeList = node;
+}
+
+void DynamicBVH::FitToChildren(int node)
+{
+	Node& parent = m_nodes[node];
+	const Node& child1 = m_nodes[parent.child1];
+	const Node& child2 = m_nodes[parent.child2];
+	parent.height = 1 + MaxHeight(child1.height, child2.height);
+	Combine(child1.min, child1.max, child2.min, child2.max, parent.min, parent.max);
+}
+
+int DynamicBVH::CreateProxy(const DirectX::BoundingBox& box, Entity* entity)
+{
+	int proxy = AllocateNode();
+	Node& node = m_nodes[proxy];
+	ToMinMax(box, node.min, node.max);
+	node.min = XMFLOAT3(node.min.x - m_margin, node.min.y - m_margin, node.min.z - m_margin);
+	node.max = XMFLOAT3(node.max.x + m_margin, node.max.y + m_margin, node.max.z + m_margin);
+	node.entity = entity;
+
+	InsertLeaf(proxy);
+	m_proxyCount++;
+	return proxy;
+}
+
+void DynamicBVH::DestroyProxy(int proxyId)
+{
+	RemoveLeaf(proxyId);
+	FreeNode(proxyId);
+	m_proxyCount--;
+}
+
+bool DynamicBVH::MoveProxy(int proxyId, const DirectX::BoundingBox& box)
+{
+	XMFLOAT3 min, max;
+	ToMinMax(box, min, max);
+
+	// Still inside the fat box, so the tree doesn't need to know
+	Node& node = m_nodes[proxyId];
+	if (Contains(node.min, node.max, min, max)) {
+		return false;
+	}
+
+	RemoveLeaf(proxyId);
+	node.min = XMFLOAT3(min.x - m_margin, min.y - m_margin, min.z - m_margin);
+	node.max = XMFLOAT3(max.x + m_margin, max.y + m_margin, max.z + m_margin);
+	InsertLeaf(proxyId);
+	return true;
+}
+
+void DynamicBVH::InsertLeaf(int leaf)
+{
+	if (m_root == NULL_NODE) {
+		m_root = leaf;
+		m_nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	// Find the best sibling using the surface area heuristic
+	XMFLOAT3 leafMin = m_nodes[leaf].min;
+	XMFLOAT3 leafMax = m_nodes[leaf].max;
+	int index = m_root;
+	while (!m_nodes[index].IsLeaf()) {
+		const Node& node = m_nodes[index];
+		float area = SurfaceArea(node.min, node.max);
+		float combinedArea = CombinedArea(node.min, node.max, leafMin, leafMax);
+
+		// Cost of creating a new parent for this node and the new leaf
+		float cost = 2.0f * combinedArea;
+
+		// Minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+		int children[2] = { node.child1, node.child2 };
+		for (int i = 0; i < 2; ++i) {
+			const Node& child = m_nodes[children[i]];
+			float childCombined = CombinedArea(child.min, child.max, leafMin, leafMax);
+			childCosts[i] = child.IsLeaf() ?
+				childCombined + inheritanceCost :
+				(childCombined - SurfaceArea(child.min, child.max)) + inheritanceCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1]) {
+			break;
+		}
+		index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+	}
+
+	// Create a new parent for the sibling and the leaf
+	int sibling = index;
+	int oldParent = m_nodes[sibling].parent;
+	int newParent = AllocateNode();
+	m_nodes[newParent].parent = oldParent;
+	m_nodes[newParent].child1 = sibling;
+	m_nodes[newParent].child2 = leaf;
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+
+	if (oldParent != NULL_NODE) {
+		if (m_nodes[oldParent].child1 == sibling) {
+			m_nodes[oldParent].child1 = newParent;
+		}
+		else {
+			m_nodes[oldParent].child2 = newParent;
+		}
+	}
+	else {
+		m_root = newParent;
+	}
+
+	// Walk back up, rebalancing and refitting the ancestors
+	index = newParent;
+	while (index != NULL_NODE) {
+		index = Balance(index);
+		FitToChildren(index);
+		index = m_nodes[index].parent;
+	}
+}
+
+void DynamicBVH::RemoveLeaf(int leaf)
+{
+	if (leaf == m_root) {
+		m_root = NULL_NODE;
+		return;
+	}
+
+	int parent = m_nodes[leaf].parent;
+	int grandParent = m_nodes[parent].parent;
+	int sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+	if (grandParent != NULL_NODE) {
+		// Replace the parent with the sibling
+		if (m_nodes[grandParent].child1 == parent) {
+			m_nodes[grandParent].child1 = sibling;
+		}
+		else {
+			m_nodes[grandParent].child2 = sibling;
+		}
+		m_nodes[sibling].parent = grandParent;
+		FreeNode(parent);
+
+		int index = grandParent;
+		while (index != NULL_NODE) {
+			index = Balance(index);
+			FitToChildren(index);
+			index = m_nodes[index].parent;
+		}
+	}
+	else {
+		m_root = sibling;
+		m_nodes[sibling].parent = NULL_NODE;
+		FreeNode(parent);
+	}
+}
+
+int DynamicBVH::Balance(int iA)
+{
+	Node* A = &m_nodes[iA];
+	if (A->IsLeaf() || A->height < 2) {
+		return iA;
+	}
+
+	int iB = A->child1;
+	int iC = A->child2;
+	Node* B = &m_nodes[iB];
+	Node* C = &m_nodes[iC];
+	int balance = C->height - B->height;
+
+	// Rotate C up
+	if (balance > 1) {
+		int iF = C->child1;
+		int iG = C->child2;
+		Node* F = &m_nodes[iF];
+		Node* G = &m_nodes[iG];
+
+		// Swap A and C
+		C->child1 = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		// A's old parent should point to C
+		if (C->parent != NULL_NODE) {
+			if (m_nodes[C->parent].child1 == iA) {
+				m_nodes[C->parent].child1 = iC;
+			}
+			else {
+				m_nodes[C->parent].child2 = iC;
+			}
+		}
+		else {
+			m_root = iC;
+		}
+
+		// Keep the taller of F and G under C
+		if (F->height > G->height) {
+			C->child2 = iF;
+			A->child2 = iG;
+			G->parent = iA;
+		}
+		else {
+			C->child2 = iG;
+			A->child2 = iF;
+			F->parent = iA;
+		}
+		FitToChildren(iA);
+		FitToChildren(iC);
+		return iC;
+	}
+
+	// Rotate B up
+	if (balance < -1) {
+		int iD = B->child1;
+		int iE = B->child2;
+		Node* D = &m_nodes[iD];
+		Node* E = &m_nodes[iE];
+
+		// Swap A and B
+		B->child1 = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		// A's old parent should point to B
+		if (B->parent != NULL_NODE) {
+			if (m_nodes[B->parent].child1 == iA) {
+				m_nodes[B->parent].child1 = iB;
+			}
+			else {
+				m_nodes[B->parent].child2 = iB;
+			}
+		}
+		else {
+			m_root = iB;
+		}
+
+		// Keep the taller of D and E under B
+		if (D->height > E->height) {
+			B->child2 = iD;
+			A->child1 = iE;
+			E->parent = iA;
+		}
+		else {
+			B->child2 = iE;
+			A->child1 = iD;
+			D->parent = iA;
+		}
+		FitToChildren(iA);
+		FitToChildren(iB);
+		return iB;
+	}
+
+	return iA;
+}
+
+void DynamicBVH::QueryBox(const DirectX::BoundingBox& box, std::vector<Entity*>& results) const
+{
+	XMFLOAT3 min, max;
+	ToMinMax(box, min, max);
+	Traverse(
+		[&](const XMFLOAT3& nodeMin, const XMFLOAT3& nodeMax) {
+			return nodeMin.x <= max.x && nodeMax.x >= min.x &&
+				nodeMin.y <= max.y && nodeMax.y >= min.y &&
+				nodeMin.z <= max.z && nodeMax.z >= min.z;
+		},
+		[&](Entity* entity) { results.push_back(entity); }
+	);
+}
+
+void DynamicBVH::QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<Entity*>& results) const
+{
+	XMFLOAT3 c = sphere.Center;
+	float radiusSq = sphere.Radius * sphere.Radius;
+	Traverse(
+		[&](const XMFLOAT3& nodeMin, const XMFLOAT3& nodeMax) {
+			// Squared distance from the sphere's center to the closest point on the box
+			float dx = c.x < nodeMin.x ? nodeMin.x - c.x : (c.x > nodeMax.x ? c.x - nodeMax.x : 0.0f);
+			float dy = c.y < nodeMin.y ? nodeMin.y - c.y : (c.y > nodeMax.y ? c.y - nodeMax.y : 0.0f);
+			float dz = c.z < nodeMin.z ? nodeMin.z - c.z : (c.z > nodeMax.z ? c.z - nodeMax.z : 0.0f);
+			return dx * dx + dy * dy + dz * dz <= radiusSq;
+		},
+		[&](Entity* entity) { results.push_back(entity); }
+	);
+}
+
+void DynamicBVH::QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<Entity*>& results) const
+{
+	Traverse(
+		[&](const XMFLOAT3& nodeMin, const XMFLOAT3& nodeMax) {
+			// Outside if the corner furthest along a plane's normal is behind it
+			for (int i = 0; i < 6; ++i) {
+				const XMFLOAT4& p = planes[i];
+				float x = p.x >= 0 ? nodeMax.x : nodeMin.x;
+				float y = p.y >= 0 ? nodeMax.y : nodeMin.y;
+				float z = p.z >= 0 ? nodeMax.z : nodeMin.z;
+				if (p.x * x + p.y * y + p.z * z + p.w < 0) {
+					return false;
+				}
+			}
+			return true;
+		},
+		[&](Entity* entity) { results.push_back(entity); }
+	);
+}
+
+void DynamicBVH::QueryRay(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, std::vector<BoundsHit>& results) const
+{
+	size_t firstResult = results.size();
+	float invDir[3] = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+	float o[3] = { origin.x, origin.y, origin.z };
+	float d[3] = { direction.x, direction.y, direction.z };
+	float hitDistance = 0;
+
+	// Slab test. Leaves reuse the entry distance of the last test.
+	auto rayOverlaps = [&](const XMFLOAT3& nodeMin, const XMFLOAT3& nodeMax) {
+		float minB[3] = { nodeMin.x, nodeMin.y, nodeMin.z };
+		float maxB[3] = { nodeMax.x, nodeMax.y, nodeMax.z };
+		float tMin = 0.0f;
+		float tMax = maxDistance;
+		for (int axis = 0; axis < 3; ++axis) {
+			// Parallel to this slab: either always inside it or never.
+			// Skipped so 0 * inf can't turn the distances into NaN.
+			if (d[axis] == 0.0f) {
+				if (o[axis] < minB[axis] || o[axis] > maxB[axis]) {
+					return false;
+				}
+				continue;
+			}
+			float t1 = (minB[axis] - o[axis]) * invDir[axis];
+			float t2 = (maxB[axis] - o[axis]) * invDir[axis];
+			if (t1 > t2) {
+				float temp = t1; t1 = t2; t2 = temp;
+			}
+			tMin = t1 > tMin ? t1 : tMin;
+			tMax = t2 < tMax ? t2 : tMax;
+			if (tMin > tMax) {
+				return false;
+			}
+		}
+		hitDistance = tMin;
+		return true;
+	};
+
+	Traverse(rayOverlaps, [&](Entity* entity) { results.push_back({ entity, hitDistance }); });
+
+	std::sort(results.begin() + firstResult, results.end(),
+		[](const BoundsHit& a, const BoundsHit& b) { return a.distance < b.distance; });
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+#include "SmallVector.h"
+class Entity;
+
+// --------------------------------------------------------
+// Result of a ray query against the tree
+// --------------------------------------------------------
+struct BoundsHit
+{
+	Entity* entity;
+	float distance; // Distance along the ray to the entity's bounding box
+};
+
+// --------------------------------------------------------
+// Dynamic bounding volume hierarchy over entity bounds.
+// Leaves store "fat" boxes enlarged by a margin, so small
+// movements refit nothing and larger ones only reinsert the
+// moved leaf. The tree is kept balanced with AVL-style rotations,
+// like Box2D's dynamic tree and Bullet's btDbvt.
+// --------------------------------------------------------
+class DynamicBVH
+{
+public:
+	static const int NULL_NODE = -1;
+private:
+	// Traversal stack kept inline by queries. A balanced tree of
+	// millions of leaves is far shallower than this, and deeper
+	// (unbalanced) trees spill the stack to the heap.
+	static const int INLINE_STACK = 256;
+
+	struct Node
+	{
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 max;
+		Entity* entity;
+		int parent; // Next free node while on the free list
+		int child1;
+		int child2;
+		int height; // 0 for leaves, -1 for free nodes
+
+		bool IsLeaf() const { return child1 == NULL_NODE; }
+	};
+
+	std::vector<Node> m_nodes;
+	int m_root = NULL_NODE;
+	int m_freeList = NULL_NODE;
+	int m_proxyCount = 0;
+	float m_margin;
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int node);
+	void FitToChildren(int node);
+
+	// --------------------------------------------------------
+	// Walks every node whose box passes the overlap test, and calls
+	// visit with each overlapping leaf's entity
+	// --------------------------------------------------------
+	template <class OverlapTest, class Visitor>
+	void Traverse(OverlapTest overlaps, Visitor visit) const
+	{
+		if (m_root == NULL_NODE) {
+			return;
+		}
+
+		SmallVector<int, INLINE_STACK> stack;
+		stack.push_back(m_root);
+		while (!stack.empty()) {
+			const Node& node = m_nodes[stack.back()];
+			stack.pop_back();
+			if (!overlaps(node.min, node.max)) {
+				continue;
+			}
+			if (node.IsLeaf()) {
+				visit(node.entity);
+			}
+			else {
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+	}
+public:
+	// --------------------------------------------------------
+	// @param float margin how far leaf boxes are enlarged in each direction
+	// --------------------------------------------------------
+	DynamicBVH(float margin = 0.1f);
+
+	// --------------------------------------------------------
+	// Adds an entity's bounds to the tree
+	// @returns int proxy id used to move or remove the bounds later
+	// --------------------------------------------------------
+	int CreateProxy(const DirectX::BoundingBox& box, Entity* entity);
+
+	// --------------------------------------------------------
+	// Removes a proxy created with CreateProxy
+	// --------------------------------------------------------
+	void DestroyProxy(int proxyId);
+
+	// --------------------------------------------------------
+	// Updates a proxy's bounds. The tree is only changed if the new
+	// bounds have left the proxy's fat box.
+	// @returns bool whether the proxy was reinserted
+	// --------------------------------------------------------
+	bool MoveProxy(int proxyId, const DirectX::BoundingBox& box);
+
+	// --------------------------------------------------------
+	// Queries. Each appends the entities whose (fat) bounds pass
+	// the test to the output list. Safe to call from several
+	// threads at once as long as nothing modifies the tree.
+	// --------------------------------------------------------
+	void QueryBox(const DirectX::BoundingBox& box, std::vector<Entity*>& results) const;
+	void QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<Entity*>& results) const;
+
+	// --------------------------------------------------------
+	// @param const DirectX::XMFLOAT4 planes[6] frustum planes with inward facing normals
+	// --------------------------------------------------------
+	void QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<Entity*>& results) const;
+
+	// --------------------------------------------------------
+	// Finds every proxy the ray passes through, sorted by distance
+	// @param DirectX::XMFLOAT3 direction normalized ray direction
+	// --------------------------------------------------------
+	void QueryRay(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, std::vector<BoundsHit>& results) const;
+
+	int GetProxyCount() const { return m_proxyCount; }
+	int GetHeight() const { return m_root == NULL_NODE ? 0 : m_nodes[m_root].height; }
+};
@@ -1,12 +1,32 @@
 #include "EmitterComponent.h"
 #include "Transform.h"
 #include "Entity.h"
+#include "WorldSnapshot.h"
+#include "SceneArchive.h"
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <cstdio>
 
 using namespace DirectX;
 using namespace rapidjson;
 
+namespace
+{
+	bool IsNumberArray(const Document& document, const char* key, SizeType size)
+	{
+		if (!document.HasMember(key) || !document[key].IsArray() || document[key].Size() < size) {
+			return false;
+		}
+		for (SizeType i = 0; i < size; ++i) {
+			if (!document[key][i].IsNumber()) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
 void EmitterComponent::UpdateSingleParticle(float deltaTime, int index)
 {
 	// Check for valid particle age before doing anything
@@ -56,6 +76,15 @@ void EmitterComponent::UpdateSingleParticle(float deltaTime, int index)
 	);
 }
 
+float EmitterComponent::Random()
+{
+	// xorshift32
+	m_randomState ^= m_randomState << 13;
+	m_randomState ^= m_randomState >> 17;
+	m_randomState ^= m_randomState << 5;
+	return (m_randomState >> 8) * (1.0f / 16777215.0f);
+}
+
 void EmitterComponent::SpawnParticle()
 {
 	// Any left to spawn?
@@ -68,25 +97,25 @@ void EmitterComponent::SpawnParticle()
 	m_particles[m_firstDeadIndex].Color = m_startColor;
 
 	Transform* transform = GetOwner()->GetTransform();
-	m_particles[m_firstDeadIndex].StartPosition = transform->GetPosition();
-	m_particles[m_firstDeadIndex].StartPosition.x += (((float)rand() / RAND_MAX) * 2 - 1) * m_positionRandomRange.x;
-	m_particles[m_firstDeadIndex].StartPosition.y += (((float)rand() / RAND_MAX) * 2 - 1) * m_positionRandomRange.y;
-	m_particles[m_firstDeadIndex].StartPosition.z += (((float)rand() / RAND_MAX) * 2 - 1) * m_positionRandomRange.z;
+	m_particles[m_firstDeadIndex].StartPosition = transform->GetWorldPosition();
+	m_particles[m_firstDeadIndex].StartPosition.x += (Random() * 2 - 1) * m_positionRandomRange.x;
+	m_particles[m_firstDeadIndex].StartPosition.y += (Random() * 2 - 1) * m_positionRandomRange.y;
+	m_particles[m_firstDeadIndex].StartPosition.z += (Random() * 2 - 1) * m_positionRandomRange.z;
 				
 	m_particles[m_firstDeadIndex].Position = m_particles[m_firstDeadIndex].StartPosition;
 				
 	m_particles[m_firstDeadIndex].StartVelocity = m_startVelocity;
-	m_particles[m_firstDeadIndex].StartVelocity.x += (((float)rand() / RAND_MAX) * 2 - 1) * m_velocityRandomRange.x;
-	m_particles[m_firstDeadIndex].StartVelocity.y += (((float)rand() / RAND_MAX) * 2 - 1) * m_velocityRandomRange.y;
-	m_particles[m_firstDeadIndex].StartVelocity.z += (((float)rand() / RAND_MAX) * 2 - 1) * m_velocityRandomRange.z;
+	m_particles[m_firstDeadIndex].StartVelocity.x += (Random() * 2 - 1) * m_velocityRandomRange.x;
+	m_particles[m_firstDeadIndex].StartVelocity.y += (Random() * 2 - 1) * m_velocityRandomRange.y;
+	m_particles[m_firstDeadIndex].StartVelocity.z += (Random() * 2 - 1) * m_velocityRandomRange.z;
 
 	float rotStartMin = m_rotationRandomRanges.x;
 	float rotStartMax = m_rotationRandomRanges.y;
-	m_particles[m_firstDeadIndex].RotationStart = ((float)rand() / RAND_MAX) * (rotStartMax - rotStartMin) + rotStartMin;
+	m_particles[m_firstDeadIndex].RotationStart = Random() * (rotStartMax - rotStartMin) + rotStartMin;
 
 	float rotEndMin = m_rotationRandomRanges.z;
 	float rotEndMax = m_rotationRandomRanges.w;
-	m_particles[m_firstDeadIndex].RotationEnd = ((float)rand() / RAND_MAX) * (rotEndMax - rotEndMin) + rotEndMin;
+	m_particles[m_firstDeadIndex].RotationEnd = Random() * (rotEndMax - rotEndMin) + rotEndMin;
 
 	// Increment and wrap
 	m_firstDeadIndex++;
@@ -155,7 +184,10 @@ void EmitterComponent::InitInternal()
 	m_firstAliveIndex = 0;
 	m_firstDeadIndex = 0;
 	m_age = 0;
+	// Seeded from rand so emitters don't all make the same pattern. Never zero.
+	m_randomState = ((uint32_t)rand() << 1) | 1;
 
+	ReleaseParticles();
 	m_particles = new Particle[m_maxParticles]{};
 	// Create local particle vertices
 	m_defaultUVs[0] = XMFLOAT2(0, 0);
@@ -291,21 +323,49 @@ void EmitterComponent::Init(
 	InitInternal();
 }
 
-void EmitterComponent::Init(const std::string& configPath, ID3D11Device* device)
+bool EmitterComponent::ReadConfig(const std::string& configPath, rapidjson::Document& document)
 {
 	// Read the entire document into a string
 	std::ifstream input(configPath);
+	if (!input) {
+		return false;
+	}
 
 	// @see https://stackoverflow.com/questions/2602013/read-whole-ascii-file-into-c-stdstring
 	std::string fileContents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
 
 	// Use RapidJson to parse the configuration file
-	Document document;
 	document.Parse(fileContents.c_str());
 	input.close();
 
-	Transform* transform = GetOwner()->GetTransform();
+	// Hot reloads can catch a file that's mid-edit, so check everything's there
+	if (document.HasParseError() || !document.IsObject()) {
+		return false;
+	}
+	const char* numbers[] = { "max-particles", "particles-per-second", "lifetime", "emitter-lifetime", "start-size", "end-size" };
+	for (const char* key : numbers) {
+		if (!document.HasMember(key) || !document[key].IsNumber()) {
+			return false;
+		}
+	}
+	const char* float3s[] = { "start-velocity", "velocity-random-range", "emitter-position", "position-random-range", "acceleration" };
+	const char* float4s[] = { "start-color", "end-color", "rotation-random-ranges" };
+	for (const char* key : float3s) {
+		if (!IsNumberArray(document, key, 3)) {
+			return false;
+		}
+	}
+	for (const char* key : float4s) {
+		if (!IsNumberArray(document, key, 4)) {
+			return false;
+		}
+	}
+	return document["max-particles"].IsInt() && document["max-particles"].GetInt() > 0 &&
+		document["particles-per-second"].IsInt() && document["particles-per-second"].GetInt() > 0;
+}
 
+void EmitterComponent::ApplyConfig(rapidjson::Document& document)
+{
 	m_maxParticles = document["max-particles"].GetInt();
 	m_particlesPerSecond = document["particles-per-second"].GetInt();
 	m_secondsPerParticle = 1.0f / m_particlesPerSecond;
@@ -319,13 +379,83 @@ void EmitterComponent::Init(const std::string& configPath, ID3D11Device* device)
 
 	m_startVelocity = ParseFloat3(document, "start-velocity");
 	m_velocityRandomRange = ParseFloat3(document, "velocity-random-range");
-	transform->SetPosition(ParseFloat3(document, "emitter-position"));
 	m_positionRandomRange = ParseFloat3(document, "position-random-range");
 	m_rotationRandomRanges = ParseFloat4(document, "rotation-random-ranges");
 	m_emitterAcceleration = ParseFloat3(document, "acceleration");
+}
+
+void EmitterComponent::Init(const std::string& configPath, ID3D11Device* device)
+{
+	// A config that can't be read leaves the defaults, so it can be fixed and hot reloaded
+	Document document;
+	if (ReadConfig(configPath, document)) {
+		ApplyConfig(document);
+		GetOwner()->GetTransform()->SetPosition(ParseFloat3(document, "emitter-position"));
+	}
+	else {
+		printf("Couldn't read particle config %s\n", configPath.c_str());
+		SetDefaults();
+	}
 
 	m_device = device;
 	InitInternal();
+
+	// The config is parsed on the watching thread, and applied between ticks
+	FileWatcher* watcher = World::GetInstance()->GetFileWatcher();
+	if (m_configWatch) {
+		watcher->Unwatch(m_configWatch);
+		m_configWatch = 0;
+	}
+	if (!watcher->IsRunning()) {
+		return;
+	}
+	m_configWatch = watcher->Watch(configPath, [this](const std::string& path) -> FileWatcher::ApplyFunction {
+		auto reloaded = std::make_shared<Document>();
+		if (!ReadConfig(path, *reloaded)) {
+			return nullptr;
+		}
+		return [this, reloaded]() { ReloadConfig(*reloaded); };
+	});
+}
+
+void EmitterComponent::ReloadConfig(rapidjson::Document& document)
+{
+	ApplyConfig(document);
+	InitInternal();
+}
+
+void EmitterComponent::ReleaseParticles()
+{
+	delete[] m_particles;
+	delete[] m_localParticleVertices;
+	if (m_vertexBuffer) {
+		m_vertexBuffer->Release();
+	}
+	if (m_indexBuffer) {
+		m_indexBuffer->Release();
+	}
+	m_particles = nullptr;
+	m_localParticleVertices = nullptr;
+	m_vertexBuffer = nullptr;
+	m_indexBuffer = nullptr;
+}
+
+void EmitterComponent::SetDefaults()
+{
+	m_maxParticles = 100;
+	m_particlesPerSecond = 10;
+	m_secondsPerParticle = 1.0f / m_particlesPerSecond;
+	m_lifetime = 1.0f;
+	m_emitterLifetime = 0.0f;
+	m_startSize = 1.0f;
+	m_endSize = 1.0f;
+	m_startColor = XMFLOAT4(1, 1, 1, 1);
+	m_endColor = XMFLOAT4(1, 1, 1, 1);
+	m_startVelocity = XMFLOAT3(0, 0, 0);
+	m_velocityRandomRange = XMFLOAT3(0, 0, 0);
+	m_positionRandomRange = XMFLOAT3(0, 0, 0);
+	m_rotationRandomRanges = XMFLOAT4(0, 0, 0, 0);
+	m_emitterAcceleration = XMFLOAT3(0, 0, 0);
 }
 
 void EmitterComponent::Start()
@@ -367,10 +497,59 @@ void EmitterComponent::Tick(float deltaTime)
 
 }
 
+void EmitterComponent::SaveState(SnapshotWriter& writer)
+{
+	writer.Write(m_maxParticles);
+	writer.Write(m_timeSinceEmit);
+	writer.Write(m_livingParticleCount);
+	writer.Write(m_age);
+	writer.Write(m_firstDeadIndex);
+	writer.Write(m_firstAliveIndex);
+	writer.Write(m_randomState);
+	writer.WriteBytes(m_particles, sizeof(Particle) * m_maxParticles);
+}
+
+void EmitterComponent::LoadState(SnapshotReader& reader)
+{
+	// The particle buffer isn't resized, so the emitter has to have been set up the same way
+	int maxParticles;
+	if (!reader.Read(maxParticles) || maxParticles != m_maxParticles) {
+		return;
+	}
+	reader.Read(m_timeSinceEmit);
+	reader.Read(m_livingParticleCount);
+	reader.Read(m_age);
+	reader.Read(m_firstDeadIndex);
+	reader.Read(m_firstAliveIndex);
+	reader.Read(m_randomState);
+	reader.ReadBytes(m_particles, sizeof(Particle) * m_maxParticles);
+}
+
+void EmitterComponent::Serialize(SceneArchive& archive)
+{
+	if (archive.IsLoading()) {
+		SetDefaults();
+	}
+
+	archive.Fields(this);
+
+	if (archive.IsLoading()) {
+		if (m_maxParticles < 1) {
+			m_maxParticles = 1;
+		}
+		if (m_particlesPerSecond < 1) {
+			m_particlesPerSecond = 1;
+		}
+		m_secondsPerParticle = 1.0f / m_particlesPerSecond;
+		m_device = World::GetInstance()->GetDevice();
+		InitInternal();
+	}
+}
+
 EmitterComponent::~EmitterComponent()
 {
-	delete[] m_particles;
-	delete[] m_localParticleVertices;
-	m_vertexBuffer->Release();
-	m_indexBuffer->Release();
+	if (m_configWatch) {
+		World::GetInstance()->GetFileWatcher()->Unwatch(m_configWatch);
+	}
+	ReleaseParticles();
 }
@@ -3,8 +3,10 @@
 
 #include <d3d11.h>
 #include <DirectXMath.h>
+#include <cstdint>
 #include <rapidjson/document.h>
 #include "CameraComponent.h"
+#include "FileWatcher.h"
 
 struct Particle
 {
@@ -57,17 +59,28 @@ private:
 
 	DirectX::XMFLOAT2 m_defaultUVs[4];
 
-	Particle* m_particles;
+	Particle* m_particles = nullptr;
 	int m_firstDeadIndex;
 	int m_firstAliveIndex;
 
+	// Each emitter has its own random sequence, so snapshots can restore it
+	uint32_t m_randomState;
+
 	// Rendering
-	ParticleVertex* m_localParticleVertices;
-	ID3D11Buffer* m_vertexBuffer;
-	ID3D11Buffer* m_indexBuffer;
+	ParticleVertex* m_localParticleVertices = nullptr;
+	ID3D11Buffer* m_vertexBuffer = nullptr;
+	ID3D11Buffer* m_indexBuffer = nullptr;
+
+	// The config file's hot reload watch, if it was set up from one
+	FileWatcher::WatchId m_configWatch = 0;
 
 	void UpdateSingleParticle(float deltaTime, int index);
 	void SpawnParticle();
+
+	// --------------------------------------------------------
+	// Returns a random number between 0 and 1 from this emitter's sequence
+	// --------------------------------------------------------
+	float Random();
 	void CopyOneParticle(int index, CameraComponent* camera);
 	DirectX::XMFLOAT3 CalcParticleVertexPosition(int particleIndex, int quadCornerIndex, CameraComponent* camera);
 	void CopyParticlesToGPU(ID3D11DeviceContext* context, CameraComponent* camera);
@@ -82,6 +95,32 @@ private:
 	// --------------------------------------------------------
 	DirectX::XMFLOAT4 ParseFloat4(rapidjson::Document& document, const char* key);
 
+	// --------------------------------------------------------
+	// Reads and parses a config file
+	// @returns bool false if it couldn't be read, or is missing settings
+	// --------------------------------------------------------
+	static bool ReadConfig(const std::string& configPath, rapidjson::Document& document);
+
+	// --------------------------------------------------------
+	// Sets the emission settings from a parsed config
+	// --------------------------------------------------------
+	void ApplyConfig(rapidjson::Document& document);
+
+	// --------------------------------------------------------
+	// Applies a hot reloaded config and starts emitting again with it
+	// --------------------------------------------------------
+	void ReloadConfig(rapidjson::Document& document);
+
+	// --------------------------------------------------------
+	// Frees the particles and their buffers made by InitInternal
+	// --------------------------------------------------------
+	void ReleaseParticles();
+
+	// --------------------------------------------------------
+	// Settings used when a scene or config leaves them out
+	// --------------------------------------------------------
+	void SetDefaults();
+
 
 	// --------------------------------------------------------
 	// Initialize private variables. This should be called from 
@@ -114,7 +153,9 @@ public:
 	);
 
 	// --------------------------------------------------------
-	// Setup method for this component accepting a configuration json file
+	// Setup method for this component accepting a configuration json file.
+	// If hot reloading is on, the file is watched, so changing it
+	// changes the emitter's settings but not its position.
 	// @param const std::string & configPath path to json file
 	// --------------------------------------------------------
 	void Init(const std::string& configPath, ID3D11Device* device);
@@ -123,6 +164,31 @@ public:
 
 	virtual void Tick(float deltaTime) override;
 
+	virtual void SaveState(SnapshotWriter& writer) override;
+	virtual void LoadState(SnapshotReader& reader) override;
+
+	// --------------------------------------------------------
+	// Scenes store the emitter's settings rather than its config
+	// file, so emitters set up either way can be saved. Loading
+	// initializes the emitter with the World's device.
+	// --------------------------------------------------------
+	virtual void Serialize(SceneArchive& archive) override;
+
+	REFLECT_FIELDS(EmitterComponent,
+		REFLECT_FIELD("maxParticles", m_maxParticles),
+		REFLECT_FIELD("particlesPerSecond", m_particlesPerSecond),
+		REFLECT_FIELD("lifetime", m_lifetime),
+		REFLECT_FIELD("emitterLifetime", m_emitterLifetime),
+		REFLECT_FIELD("startSize", m_startSize),
+		REFLECT_FIELD("endSize", m_endSize),
+		REFLECT_FIELD("startColor", m_startColor),
+		REFLECT_FIELD("endColor", m_endColor),
+		REFLECT_FIELD("startVelocity", m_startVelocity),
+		REFLECT_FIELD("velocityRandomRange", m_velocityRandomRange),
+		REFLECT_FIELD("positionRandomRange", m_positionRandomRange),
+		REFLECT_FIELD("rotationRandomRanges", m_rotationRandomRanges),
+		REFLECT_FIELD("acceleration", m_emitterAcceleration))
+
 	virtual ~EmitterComponent();
 };
 
@@ -5,6 +5,78 @@ Entity::Entity(const std::string& name) : m_name(name)
 	m_transform = AddComponent<Transform>();
 }
 
+void Entity::SetName(const std::string& name)
+{
+	if (m_inWorld) {
+		World::GetInstance()->OnEntityRenamed(this, name);
+	}
+	m_name = name;
+}
+
+void Entity::Sleep()
+{
+	if (m_inWorld && !m_asleep && !m_sleepPending) {
+		World::GetInstance()->RequestSleep(this);
+	}
+}
+
+void Entity::Wake()
+{
+	if (m_asleep || m_sleepPending) {
+		World::GetInstance()->WakeEntity(this);
+	}
+}
+
+size_t Entity::FindTagEntry(uint32_t tagId)
+{
+	for (size_t i = 0; i < m_tags.size(); ++i) {
+		if (m_tags[i].id == tagId) {
+			return i;
+		}
+	}
+	return m_tags.size();
+}
+
+void Entity::AddTag(const std::string& tag)
+{
+	uint32_t tagId = World::GetInstance()->InternTag(tag);
+	if (FindTagEntry(tagId) < m_tags.size()) {
+		return;
+	}
+	m_tags.push_back({ tagId, 0 });
+	if (m_inWorld) {
+		World::GetInstance()->OnEntityTagAdded(this, m_tags.size() - 1);
+	}
+}
+
+bool Entity::HasTag(const std::string& tag)
+{
+	uint32_t tagId;
+	return World::GetInstance()->FindTagId(tag, tagId) && FindTagEntry(tagId) < m_tags.size();
+}
+
+std::string Entity::GetTag(size_t index)
+{
+	return World::GetInstance()->GetTagName(m_tags[index].id);
+}
+
+void Entity::RemoveTag(const std::string& tag)
+{
+	uint32_t tagId;
+	if (!World::GetInstance()->FindTagId(tag, tagId)) {
+		return;
+	}
+	size_t entry = FindTagEntry(tagId);
+	if (entry == m_tags.size()) {
+		return;
+	}
+	if (m_inWorld) {
+		World::GetInstance()->OnEntityTagRemoved(this, entry);
+	}
+	m_tags[entry] = m_tags.back();
+	m_tags.pop_back();
+}
+
 void Entity::PrepareMaterial(DirectX::XMFLOAT4X4 view, DirectX::XMFLOAT4X4 projection, DirectX::XMFLOAT3 cameraPos, LightComponent::Light lights[], int numLights)
 {
 	Material* material = GetMaterial();
@@ -64,7 +136,7 @@ void Entity::StartAllComponents()
 Entity::~Entity()
 {
 	for (Component* component : m_components) {
-		delete component;
+		component->m_release(component);
 	}
 }
 
@@ -5,7 +5,6 @@
 #include <DirectXMath.h>
 #include <vector>
 #include <string>
-#include <unordered_set>
 #include <algorithm>
 #include "MaterialComponent.h"
 #include "LightComponent.h"
@@ -13,6 +12,9 @@
 #include "RigidBodyComponent.h"
 #include "UITransform.h"
 #include "EmitterComponent.h"
+#include "EntityHandle.h"
+#include "ObjectPool.h"
+#include "SmallVector.h"
 // --------------------------------------------------------
 // Base Entity class which contains a list of Components.
 // Entities come with the Transform component by default.
@@ -20,10 +22,25 @@
 class Entity
 {
 	friend class World;
+	template <class T, size_t SLAB_SIZE> friend class ObjectPool;
+public:
+	// Most entities have only a handful of components, so these are stored inline
+	static const size_t INLINE_COMPONENTS = 8;
+	typedef SmallVector<Component*, INLINE_COMPONENTS> ComponentList;
 protected:
-	std::vector<Component*> m_components;
+	// --------------------------------------------------------
+	// An interned tag id, and this Entity's position in the 
+	// World's list for that tag
+	// --------------------------------------------------------
+	struct TagEntry
+	{
+		uint32_t id;
+		size_t slot;
+	};
+
+	ComponentList m_components;
 	std::string m_name;
-	std::unordered_set<std::string> m_tags;
+	SmallVector<TagEntry, 4> m_tags;
 
 
 	// "Shortcut" references to common components 
@@ -37,6 +54,34 @@ protected:
 	// Used to determine if start needs to be called
 	bool m_hasStarted = false;
 
+	// Whether the World has spawned this Entity and indexed its name and tags
+	bool m_inWorld = false;
+
+	// Book-keeping so the World can remove this Entity in constant time
+	EntityHandle m_handle;
+	size_t m_denseIndex = 0;		// Position in the World's entity list
+	size_t m_nameSlot = 0;			// Position in the World's list for this name
+	SmallVector<size_t, 4> m_collisionPairs;	// Indices of the World's collision pairs involving this Entity
+
+	// Sleeping Entities are left out of the World's tick loop
+	bool m_asleep = false;
+	bool m_sleepPending = false;	// Sleep was requested this frame
+	size_t m_activeIndex = 0;		// Position in the World's list of awake entities
+
+	// --------------------------------------------------------
+	// Returns the index of the tag in m_tags, or m_tags.size() if it's not there
+	// --------------------------------------------------------
+	size_t FindTagEntry(uint32_t tagId);
+
+	// --------------------------------------------------------
+	// Destroys a component made by AddComponent<T> and returns it to T's pool
+	// --------------------------------------------------------
+	template <class T>
+	static void ReleaseComponent(Component* component)
+	{
+		ObjectPool<T>::GetInstance().Destroy(static_cast<T*>(component));
+	}
+
 	// Use the World to instantiate an Entity
 	Entity(const std::string& name);
 public:
@@ -50,7 +95,8 @@ public:
 	template <class T>
 	T* AddComponent()
 	{
-		T* newComponent = new T(this);
+		T* newComponent = ObjectPool<T>::GetInstance().Create(this);
+		newComponent->m_release = &ReleaseComponent<T>;
 		m_components.push_back(newComponent);
 
 		// Use these to build references to the "shortcut" pointers
@@ -99,14 +145,35 @@ public:
 	}
 
 
-	std::string GetName() { return m_name; }
-	void SetName(const std::string& name) { m_name = name; }
+	const std::string& GetName() { return m_name; }
 
-	void AddTag(const std::string& tag) { m_tags.insert(tag); }
-	bool HasTag(const std::string& tag) { return m_tags.count(tag) > 0; }
-	void RemoveTag(const std::string& tag) { m_tags.erase(tag); }
+	// --------------------------------------------------------
+	// Returns this Entity's generational handle
+	// --------------------------------------------------------
+	EntityHandle GetHandle() { return m_handle; }
 
-	std::vector<Component*>& GetAllComponents() { return m_components; }
+	// --------------------------------------------------------
+	// Names and tags are indexed by the World once the Entity
+	// is spawned, so change them through these methods
+	// --------------------------------------------------------
+	void SetName(const std::string& name);
+	void AddTag(const std::string& tag);
+	bool HasTag(const std::string& tag);
+	void RemoveTag(const std::string& tag);
+	size_t GetTagCount() { return m_tags.size(); }
+	std::string GetTag(size_t index);
+
+	// --------------------------------------------------------
+	// Sleeping Entities aren't ticked. Sleep takes effect at the end
+	// of the frame, and is cancelled if the Entity is woken before then.
+	// Moving a sleeping Entity's Transform, a collision, or a trigger
+	// overlap changing wakes it.
+	// --------------------------------------------------------
+	void Sleep();
+	void Wake();
+	bool IsAsleep() { return m_asleep; }
+
+	ComponentList& GetAllComponents() { return m_components; }
 
 	Transform* GetTransform() { return m_transform; }
 
@@ -116,17 +183,19 @@ public:
 
 	EmitterComponent* GetEmitter() { return m_emitter; }
 
+	MeshComponent* GetMeshComponent() { return m_meshComponent; }
+
 	// --------------------------------------------------------
 	// Returns the mesh component attached to this Entity.
 	// Note that this CAN be nullptr if a mesh hasn't been attached.
 	// --------------------------------------------------------
-	Mesh* GetMesh() { return m_meshComponent ? m_meshComponent->m_mesh : nullptr; }
+	Mesh* GetMesh() { return m_meshComponent ? m_meshComponent->m_mesh.Get() : nullptr; }
 
     // --------------------------------------------------------
 	// Returns the material component attached to this Entity.
 	// Note that this CAN be nullptr if a material hasn't been attached.
 	// --------------------------------------------------------
-	Material* GetMaterial() { return m_materialComponent ? m_materialComponent->m_material : nullptr; }
+	Material* GetMaterial() { return m_materialComponent ? m_materialComponent->m_material.Get() : nullptr; }
 
 
 	// --------------------------------------------------------
@@ -150,3 +219,20 @@ public:
 
 };
 
+template <class T>
+void World::DeferAddComponent(EntityHandle handle, std::function<void(T*)> init)
+{
+	Defer([handle, init]() {
+		Entity* entity = handle.Get();
+		if (!entity) {
+			return;
+		}
+		T* component = entity->AddComponent<T>();
+		if (init) {
+			init(component);
+		}
+		if (entity->m_hasStarted && component->GetEnabled()) {
+			component->Start();
+		}
+	});
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+class Entity;
+
+// --------------------------------------------------------
+// Generational reference to an Entity's slot in the World.
+// Once the Entity is destroyed its slot's generation changes,
+// so old handles resolve to nullptr instead of a dangling pointer.
+// Handles are 8 bytes and safe to hold onto across frames.
+// --------------------------------------------------------
+struct EntityHandle
+{
+	static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+	uint32_t index = INVALID_INDEX;
+	uint32_t generation = 0;
+
+	// --------------------------------------------------------
+	// Returns the Entity, or nullptr if it has been destroyed.
+	// Defined in World.cpp, so this header is all callers need.
+	// --------------------------------------------------------
+	Entity* Get() const;
+	Entity* operator->() const { return Get(); }
+
+	bool IsValid() const { return Get() != nullptr; }
+	explicit operator bool() const { return IsValid(); }
+
+	bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
@@ -0,0 +1,250 @@
+#include "FileWatcher.h"
+
+FileWatcher::FileWatcher() : m_polling(false)
+{
+	m_wakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+}
+
+FileWatcher::FileStamp FileWatcher::GetStamp(const std::string& path)
+{
+	FileStamp stamp;
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+		return stamp;
+	}
+	stamp.exists = true;
+	stamp.writeTime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+	stamp.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	return stamp;
+}
+
+std::string FileWatcher::GetDirectory(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	if (slash == std::string::npos) {
+		return ".";
+	}
+	return path.substr(0, slash == 0 ? 1 : slash);
+}
+
+FileWatcher::WatchId FileWatcher::Watch(const std::string& path, LoadFunction load)
+{
+	WatchedFile watch;
+	watch.path = path;
+	watch.directory = GetDirectory(path);
+	watch.load = load;
+	watch.stamp = GetStamp(path);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	WatchId id = m_nextId++;
+	if (m_directories[watch.directory]++ == 0) {
+		m_directoriesChanged = true;
+		SetEvent(m_wakeEvent);
+	}
+	m_watches[id] = watch;
+	return id;
+}
+
+void FileWatcher::Unwatch(WatchId id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_watches.find(id);
+	if (it == m_watches.end()) {
+		return;
+	}
+	auto directory = m_directories.find(it->second.directory);
+	if (--directory->second == 0) {
+		m_directories.erase(directory);
+		m_directoriesChanged = true;
+		SetEvent(m_wakeEvent);
+	}
+	m_watches.erase(it);
+
+	for (size_t i = m_changes.size(); i-- > 0; ) {
+		if (m_changes[i].id == id) {
+			m_changes.erase(m_changes.begin() + i);
+		}
+	}
+}
+
+void FileWatcher::DispatchChanges()
+{
+	std::vector<Change> changes;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_changes.empty()) {
+			return;
+		}
+		changes.swap(m_changes);
+
+		// A watch can go away while its file is being loaded
+		for (size_t i = changes.size(); i-- > 0; ) {
+			if (m_watches.count(changes[i].id) == 0) {
+				changes.erase(changes.begin() + i);
+			}
+		}
+	}
+	for (Change& change : changes) {
+		change.apply();
+	}
+}
+
+bool FileWatcher::CheckFiles()
+{
+	// Files are looked at and loaded without the lock, so watches can be added meanwhile
+	std::vector<std::pair<WatchId, std::string>> files;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		files.reserve(m_watches.size());
+		for (auto& pair : m_watches) {
+			files.push_back({ pair.first, pair.second.path });
+		}
+	}
+	std::vector<FileStamp> stamps;
+	stamps.reserve(files.size());
+	for (auto& file : files) {
+		stamps.push_back(GetStamp(file.second));
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	bool settling = false;
+	std::vector<std::pair<WatchId, WatchedFile>> ready;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < files.size(); ++i) {
+			auto it = m_watches.find(files[i].first);
+			if (it == m_watches.end()) {
+				continue;
+			}
+			WatchedFile& watch = it->second;
+			const FileStamp& stamp = stamps[i];
+
+			// Editors that save by renaming can leave the file missing for a moment
+			if (!stamp.exists || stamp == watch.stamp) {
+				watch.pending = false;
+				continue;
+			}
+			if (!watch.pending || stamp != watch.pendingStamp) {
+				watch.pending = true;
+				watch.pendingStamp = stamp;
+				watch.pendingSince = now;
+				settling = true;
+			}
+			else if (now - watch.pendingSince < m_settleTime) {
+				settling = true;
+			}
+			else {
+				watch.stamp = stamp;
+				watch.pending = false;
+				ready.push_back({ it->first, watch });
+			}
+		}
+	}
+
+	for (auto& file : ready) {
+		ApplyFunction apply = file.second.load(file.second.path);
+		if (apply) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_changes.push_back({ file.first, apply });
+		}
+	}
+	return settling;
+}
+
+void FileWatcher::ThreadLoop()
+{
+	// The wake event comes first, then a change notification for each directory
+	std::vector<HANDLE> handles = { m_wakeEvent };
+	while (true) {
+		std::vector<std::string> directories;
+		bool directoriesChanged;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_stopping) {
+				break;
+			}
+			directoriesChanged = m_directoriesChanged;
+			m_directoriesChanged = false;
+			if (directoriesChanged) {
+				for (auto& pair : m_directories) {
+					directories.push_back(pair.first);
+				}
+			}
+		}
+
+		if (directoriesChanged) {
+			for (size_t i = 1; i < handles.size(); ++i) {
+				FindCloseChangeNotification(handles[i]);
+			}
+			handles.resize(1);
+
+			// Directories past the wait limit, or that can't notify (e.g. some network shares), are polled
+			bool polling = false;
+			for (const std::string& directory : directories) {
+				if (handles.size() == MAXIMUM_WAIT_OBJECTS) {
+					polling = true;
+					break;
+				}
+				HANDLE notification = FindFirstChangeNotificationA(directory.c_str(), FALSE,
+					FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_FILE_NAME);
+				if (notification == INVALID_HANDLE_VALUE) {
+					polling = true;
+				}
+				else {
+					handles.push_back(notification);
+				}
+			}
+			m_polling = polling;
+		}
+
+		bool settling = CheckFiles();
+		DWORD timeout = INFINITE;
+		if (settling) {
+			timeout = (DWORD)m_settleTime.count();
+		}
+		else if (m_polling) {
+			timeout = (DWORD)m_pollInterval.count();
+		}
+
+		DWORD result = WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, timeout);
+		if (result > WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + handles.size()) {
+			FindNextChangeNotification(handles[result - WAIT_OBJECT_0]);
+		}
+	}
+
+	for (size_t i = 1; i < handles.size(); ++i) {
+		FindCloseChangeNotification(handles[i]);
+	}
+}
+
+void FileWatcher::Start()
+{
+	if (m_thread.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = false;
+		m_directoriesChanged = true;
+	}
+	m_thread = std::thread(&FileWatcher::ThreadLoop, this);
+}
+
+void FileWatcher::Stop()
+{
+	if (!m_thread.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	SetEvent(m_wakeEvent);
+	m_thread.join();
+}
+
+FileWatcher::~FileWatcher()
+{
+	Stop();
+	CloseHandle(m_wakeEvent);
+}
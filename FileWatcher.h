@@ -0,0 +1,134 @@
+#pragma once
+#include <Windows.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+// --------------------------------------------------------
+// Watches files for changes on a background thread, for hot
+// reloading assets while the game runs.
+//
+// Each watched file has a load function. When the file changes, it
+// runs on the watching thread to read the file, and returns a function
+// that applies the result, or nullptr if the file couldn't be used.
+// Apply functions run on the main thread in DispatchChanges, so they
+// can swap the result into whatever uses it between frames.
+//
+// The thread sleeps on directory change notifications, and falls
+// back to polling the files' write times where those aren't
+// available. A change is only reported once the file has stopped
+// changing for the settle time, so half-written files aren't loaded.
+// --------------------------------------------------------
+class FileWatcher
+{
+public:
+	typedef uint32_t WatchId;
+	typedef std::function<void()> ApplyFunction;
+	typedef std::function<ApplyFunction(const std::string& path)> LoadFunction;
+private:
+	struct FileStamp
+	{
+		uint64_t writeTime = 0;
+		uint64_t size = 0;
+		bool exists = false;
+
+		bool operator==(const FileStamp& other) const { return writeTime == other.writeTime && size == other.size && exists == other.exists; }
+		bool operator!=(const FileStamp& other) const { return !(*this == other); }
+	};
+
+	struct WatchedFile
+	{
+		std::string path;
+		std::string directory;
+		LoadFunction load;
+		FileStamp stamp;			// As last loaded
+		FileStamp pendingStamp;		// Changed, waiting to settle
+		std::chrono::steady_clock::time_point pendingSince;
+		bool pending = false;
+	};
+
+	struct Change
+	{
+		WatchId id;
+		ApplyFunction apply;
+	};
+
+	std::map<WatchId, WatchedFile> m_watches;
+	std::map<std::string, int> m_directories; // Number of watches in each
+	WatchId m_nextId = 1;
+	std::vector<Change> m_changes;
+	std::chrono::milliseconds m_pollInterval = std::chrono::milliseconds(500);
+	std::chrono::milliseconds m_settleTime = std::chrono::milliseconds(200);
+
+	// The watching thread
+	std::thread m_thread;
+	std::mutex m_mutex;
+	HANDLE m_wakeEvent = nullptr;
+	bool m_stopping = false;
+	bool m_directoriesChanged = false;
+	std::atomic<bool> m_polling;
+
+	void ThreadLoop();
+
+	// --------------------------------------------------------
+	// Compares each watched file to its stamp, and loads the files
+	// that have settled. Called on the watching thread.
+	// @returns bool whether any changes are still settling
+	// --------------------------------------------------------
+	bool CheckFiles();
+
+	static FileStamp GetStamp(const std::string& path);
+	static std::string GetDirectory(const std::string& path);
+public:
+	FileWatcher();
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// --------------------------------------------------------
+	// Starts watching a file. Its current contents aren't reported.
+	// @param LoadFunction load reads the file on the watching thread
+	// @returns WatchId the id to stop watching it with
+	// --------------------------------------------------------
+	WatchId Watch(const std::string& path, LoadFunction load);
+
+	// --------------------------------------------------------
+	// Stops watching a file. Changes it had waiting are dropped,
+	// so their apply functions never run.
+	// --------------------------------------------------------
+	void Unwatch(WatchId id);
+
+	// --------------------------------------------------------
+	// Runs the apply functions of files that changed since the last
+	// call. Call it from the main thread.
+	// --------------------------------------------------------
+	void DispatchChanges();
+
+	// --------------------------------------------------------
+	// Starts and stops the watching thread. Files are only checked
+	// while it's running; watches can be added either way.
+	// --------------------------------------------------------
+	void Start();
+	void Stop();
+	bool IsRunning() { return m_thread.joinable(); }
+
+	// --------------------------------------------------------
+	// Whether some directories couldn't be given change notifications,
+	// so the files are polled
+	// --------------------------------------------------------
+	bool IsPolling() { return m_polling; }
+
+	// --------------------------------------------------------
+	// How often files are polled, and how long a file has to stay
+	// the same before it's loaded. Set these before Start.
+	// --------------------------------------------------------
+	void SetPollInterval(std::chrono::milliseconds interval) { m_pollInterval = interval; }
+	void SetSettleTime(std::chrono::milliseconds settleTime) { m_settleTime = settleTime; }
+
+	~FileWatcher();
+};
@@ -0,0 +1,123 @@
+#include "FrustumCuller.h"
+#include <cmath>
+#if defined(__AVX__)
+#include <immintrin.h>
+#else
+#include <xmmintrin.h>
+#endif
+
+using namespace DirectX;
+
+void FrustumCuller::Begin(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection)
+{
+	m_blocks.clear();
+	m_entities.clear();
+	m_stats = CullStats();
+
+	// The camera stores its matrices transposed for HLSL
+	XMMATRIX viewProj = XMMatrixMultiply(
+		XMMatrixTranspose(XMLoadFloat4x4(&view)),
+		XMMatrixTranspose(XMLoadFloat4x4(&projection)));
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, viewProj);
+
+	// Gribb/Hartmann plane extraction for row vectors and a [0, 1] depth range
+	m_planes[0] = XMFLOAT4(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41); // Left
+	m_planes[1] = XMFLOAT4(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41); // Right
+	m_planes[2] = XMFLOAT4(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42); // Bottom
+	m_planes[3] = XMFLOAT4(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42); // Top
+	m_planes[4] = XMFLOAT4(m._13, m._23, m._33, m._43);									 // Near
+	m_planes[5] = XMFLOAT4(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43); // Far
+
+	for (XMFLOAT4& plane : m_planes) {
+		XMStoreFloat4(&plane, XMPlaneNormalize(XMLoadFloat4(&plane)));
+	}
+}
+
+void FrustumCuller::Add(Entity* entity, const DirectX::BoundingBox& worldBox)
+{
+	int slot = (int)(m_entities.size() % BLOCK_SIZE);
+	if (slot == 0) {
+		// Unused slots in the last block are still tested, but their results are ignored
+		m_blocks.push_back(BoxBlock());
+	}
+
+	BoxBlock& block = m_blocks.back();
+	block.centerX[slot] = worldBox.Center.x;
+	block.centerY[slot] = worldBox.Center.y;
+	block.centerZ[slot] = worldBox.Center.z;
+	block.extentX[slot] = worldBox.Extents.x;
+	block.extentY[slot] = worldBox.Extents.y;
+	block.extentZ[slot] = worldBox.Extents.z;
+	m_entities.push_back(entity);
+}
+
+int FrustumCuller::TestBlock(const BoxBlock& block)
+{
+	// A box is outside if, for any plane, its center is further behind the plane
+	// than the box's projected radius: dot(n, c) + d + dot(|n|, e) < 0
+#if defined(__AVX__)
+	__m256 cx = _mm256_loadu_ps(block.centerX);
+	__m256 cy = _mm256_loadu_ps(block.centerY);
+	__m256 cz = _mm256_loadu_ps(block.centerZ);
+	__m256 ex = _mm256_loadu_ps(block.extentX);
+	__m256 ey = _mm256_loadu_ps(block.extentY);
+	__m256 ez = _mm256_loadu_ps(block.extentZ);
+	__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+	for (const XMFLOAT4& plane : m_planes) {
+		__m256 distance = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+			_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+		__m256 radius = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(fabsf(plane.x))), _mm256_mul_ps(ey, _mm256_set1_ps(fabsf(plane.y)))),
+			_mm256_mul_ps(ez, _mm256_set1_ps(fabsf(plane.z))));
+		inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+	}
+	return _mm256_movemask_ps(inside);
+#else
+	// Without AVX, test the block as two halves of 4 with SSE
+	int mask = 0;
+	for (int half = 0; half < 2; ++half) {
+		int offset = half * 4;
+		__m128 cx = _mm_loadu_ps(block.centerX + offset);
+		__m128 cy = _mm_loadu_ps(block.centerY + offset);
+		__m128 cz = _mm_loadu_ps(block.centerZ + offset);
+		__m128 ex = _mm_loadu_ps(block.extentX + offset);
+		__m128 ey = _mm_loadu_ps(block.extentY + offset);
+		__m128 ez = _mm_loadu_ps(block.extentZ + offset);
+		__m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+
+		for (const XMFLOAT4& plane : m_planes) {
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabsf(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(fabsf(plane.y)))),
+				_mm_mul_ps(ez, _mm_set1_ps(fabsf(plane.z))));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+		mask |= _mm_movemask_ps(inside) << offset;
+	}
+	return mask;
+#endif
+}
+
+void FrustumCuller::Cull(std::vector<Entity*>& visible)
+{
+	size_t count = m_entities.size();
+	for (size_t blockIndex = 0; blockIndex < m_blocks.size(); ++blockIndex) {
+		int mask = TestBlock(m_blocks[blockIndex]);
+		size_t first = blockIndex * BLOCK_SIZE;
+		for (int i = 0; i < BLOCK_SIZE && first + i < count; ++i) {
+			if (mask & (1 << i)) {
+				visible.push_back(m_entities[first + i]);
+				m_stats.visible++;
+			}
+			else {
+				m_stats.culled++;
+			}
+		}
+	}
+	m_stats.tested = (int)count;
+}
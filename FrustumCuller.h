@@ -0,0 +1,76 @@
+#pragma once
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+class Entity;
+
+// --------------------------------------------------------
+// Per-frame culling counters
+// --------------------------------------------------------
+struct CullStats
+{
+	int tested = 0;
+	int visible = 0;
+	int culled = 0;
+};
+
+// --------------------------------------------------------
+// Tests world space bounding boxes against the camera frustum.
+// Boxes are stored in blocks of 8 in structure-of-arrays form
+// so that one plane test covers 8 boxes at a time.
+// --------------------------------------------------------
+class FrustumCuller
+{
+public:
+	static const int BLOCK_SIZE = 8;
+private:
+	// --------------------------------------------------------
+	// 8 boxes as centers and extents, one array per component
+	// --------------------------------------------------------
+	struct BoxBlock
+	{
+		float centerX[BLOCK_SIZE];
+		float centerY[BLOCK_SIZE];
+		float centerZ[BLOCK_SIZE];
+		float extentX[BLOCK_SIZE];
+		float extentY[BLOCK_SIZE];
+		float extentZ[BLOCK_SIZE];
+	};
+
+	std::vector<BoxBlock> m_blocks;
+	std::vector<Entity*> m_entities;
+	DirectX::XMFLOAT4 m_planes[6];
+	CullStats m_stats;
+
+	// --------------------------------------------------------
+	// Returns a bitmask with a bit set for each box in the block
+	// that intersects or is inside the frustum
+	// --------------------------------------------------------
+	int TestBlock(const BoxBlock& block);
+public:
+	// --------------------------------------------------------
+	// Extracts the frustum planes from the camera's matrices.
+	// Also clears any boxes added last frame.
+	// @param DirectX::XMFLOAT4X4 view transposed view matrix (as stored by CameraComponent)
+	// @param DirectX::XMFLOAT4X4 projection transposed projection matrix
+	// --------------------------------------------------------
+	void Begin(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection);
+
+	// --------------------------------------------------------
+	// Queues an entity's world space bounds for testing
+	// --------------------------------------------------------
+	void Add(Entity* entity, const DirectX::BoundingBox& worldBox);
+
+	// --------------------------------------------------------
+	// Tests every queued box and appends the visible entities
+	// @param std::vector<Entity*>& visible output list
+	// --------------------------------------------------------
+	void Cull(std::vector<Entity*>& visible);
+
+	// --------------------------------------------------------
+	// Returns the frustum planes (normals point inwards)
+	// --------------------------------------------------------
+	const DirectX::XMFLOAT4* GetPlanes() { return m_planes; }
+
+	const CullStats& GetStats() { return m_stats; }
+};
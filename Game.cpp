@@ -76,11 +76,19 @@ void Game::LoadResources()
 
 	world->SetDevice(device);
 
+#if defined(DEBUG) || defined(_DEBUG)
+	// Reload meshes, shaders and particle configs as they're edited
+	world->SetHotReload(true);
+#endif
+
 	// Meshes
 	world->CreateMesh("cube", "Assets/Models/cube.obj", device);
+	// Triangle mesh colliders are cooked here the first time they're built
+	world->GetShapeCache()->SetCookedDirectory("Assets/Cooked");
 
 	// Shaders
 	SimpleVertexShader* vs = world->CreateVertexShader("vs", device, context, L"VertexShader.cso");
+	SimpleVertexShader* vsInstanced = world->CreateVertexShader("vsInstanced", device, context, L"VertexShaderInstanced.cso");
 	SimplePixelShader* uiPs = world->CreatePixelShader("ui", device, context, L"UIPixelShader.cso");
 	SimplePixelShader* ps = world->CreatePixelShader("ps", device, context, L"PixelShader.cso");
 	//sky shaders
@@ -148,8 +156,10 @@ void Game::LoadResources()
 	
 
 	// Materials
-	world->CreateMaterial("leather", vs, ps, world->GetTexture("leather"), world->GetTexture("velvet_normal"), skyTex, world->GetSamplerState("main"));
+	Material* leather = world->CreateMaterial("leather", vs, ps, world->GetTexture("leather"), world->GetTexture("velvet_normal"), skyTex, world->GetSamplerState("main"));
+	leather->SetInstancedVertexShader(vsInstanced);
 	Material* metal = world->CreateMaterial("metal", vs, ps, world->GetTexture("metal"), world->GetTexture("velvet_normal"), skyTex, world->GetSamplerState("main"));
+	metal->SetInstancedVertexShader(vsInstanced);
 	metal->m_specColor = DirectX::XMFLOAT3(0.662124f, 0.654864f, 0.633732f);
 	metal->m_roughness = 1.0f;
 	metal->m_metalness = 0;
@@ -174,7 +184,7 @@ void Game::CreateEntities()
 {
 	World* world = World::GetInstance();
 
-	Entity* cube1 = world->Instantiate("cube1");
+	EntityHandle cube1 = world->Instantiate("cube1");
 	cube1->GetTransform()->SetPosition(XMFLOAT3(0, 0, 0));
 	XMFLOAT4 rot;
 	XMStoreFloat4(&rot, XMQuaternionRotationRollPitchYaw(10.0f, 10.0f, 10.0f));
@@ -185,7 +195,7 @@ void Game::CreateEntities()
 	rb->SetBoxCollider(.5f, .5f, .5f);
 	rb->m_mass = 1.0f; // This has mass so it will be affected by gravity
 
-	Entity* ground = world->Instantiate("ground");
+	EntityHandle ground = world->Instantiate("ground");
 	ground->GetTransform()->SetPosition(XMFLOAT3(0, -3, 0));
 	ground->AddComponent<MeshComponent>()->m_mesh = world->GetMesh("cube");
 	ground->AddComponent<MaterialComponent>()->m_material = world->GetMaterial("metal");
@@ -195,27 +205,27 @@ void Game::CreateEntities()
 	//sc->Play();
 
 
-	Entity* camera = world->Instantiate("Cam");
+	EntityHandle camera = world->Instantiate("Cam");
 	CameraComponent* cc = camera->AddComponent<CameraComponent>();
 	cc->UpdateProjectionMatrix((float)width / height);
 	camera->GetTransform()->SetPosition(XMFLOAT3(0, 0, -5));
 	camera->AddComponent<DebugMovement>();
 	world->m_mainCamera = cc;
 
-	Entity* dirLight = world->Instantiate("DirLight1");
+	EntityHandle dirLight = world->Instantiate("DirLight1");
 	LightComponent* dirLightComp = dirLight->AddComponent<LightComponent>();
 	dirLightComp->m_data.type = LightComponent::Directional;
 	dirLightComp->m_data.color = XMFLOAT3(1.0f, 1.0f, 1.0f);
 	dirLightComp->m_data.intensity = 1.0f;
 	
-	/*Entity* pointLight = world->Instantiate("PointLight1");
+	/*EntityHandle pointLight = world->Instantiate("PointLight1");
 	LightComponent* pointLightComp = pointLight->AddComponent<LightComponent>();
 	pointLightComp->m_data.type = LightComponent::Point;
 	pointLightComp->m_data.color = XMFLOAT3(1.0f, 0, 0);
 	pointLightComp->m_data.intensity = 1.0f;
 	pointLight->GetTransform()->SetPosition(XMFLOAT3(-1, 1, 0));
 
-	Entity* spotLight = world->Instantiate("SpotLight1");
+	EntityHandle spotLight = world->Instantiate("SpotLight1");
 	LightComponent* spotLightComp = spotLight->AddComponent<LightComponent>();
 	spotLightComp->m_data.type = LightComponent::Spot;
 	spotLightComp->m_data.color = XMFLOAT3(0, 1.0f, 0);
@@ -226,7 +236,7 @@ void Game::CreateEntities()
 	XMStoreFloat4(&spotLightRot, XMQuaternionRotationRollPitchYaw(0, 90.0f, 0));
 	spotLight->GetTransform()->SetRotation(spotLightRot);*/
 
-	Entity* sprite = world->Instantiate("sprite");
+	EntityHandle sprite = world->Instantiate("sprite");
 	sprite->AddComponent<UITransform>()->Init(Anchor::BOTTOM_RIGHT, 0, XMFLOAT2(1, 1), XMFLOAT2(.25f,.25f), XMFLOAT2(0, 0));
 	sprite->AddComponent<MaterialComponent>()->m_material = world->GetMaterial("leather");
 	ButtonComponent* spriteButton = sprite->AddComponent<ButtonComponent>();
@@ -241,19 +251,21 @@ void Game::CreateEntities()
 		}
 	);
 
-	Entity* text = world->Instantiate("text");
+	EntityHandle text = world->Instantiate("text");
 	text->AddComponent<UITransform>()->Init(Anchor::CENTER_CENTER, 0, XMFLOAT2(.5f, .5f), XMFLOAT2(1, 1), XMFLOAT2(0, 0));
 	text->AddComponent<UITextComponent>()->Init("Hello World", world->GetFont("Open Sans"), Colors::White);
 	ButtonComponent* button = text->AddComponent<ButtonComponent>();
 	button->AddOnClick([]() 
 		{
-			Entity* text = World::GetInstance()->Find("text");
-			text->GetComponent<UITextComponent>()->m_color = Colors::Black;
+			EntityHandle text = World::GetInstance()->Find("text");
+			if (text) {
+				text->GetComponent<UITextComponent>()->m_color = Colors::Black;
+			}
 		}
 	);
 	
 	// Particle System Test
-	Entity* particleSystem = world->Instantiate("particle-system");
+	EntityHandle particleSystem = world->Instantiate("particle-system");
 	//particleSystem->AddComponent<EmitterComponent>()->Init(
 	//	110,
 	//	20,
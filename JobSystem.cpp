@@ -0,0 +1,119 @@
+#include "JobSystem.h"
+
+JobSystem::JobSystem()
+{
+	m_nextChunk.store(0);
+	m_chunksDone.store(0);
+}
+
+void JobSystem::Start(size_t workerCount, std::function<void(size_t)> onStart)
+{
+	if (!m_workers.empty()) {
+		return;
+	}
+	if (workerCount == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	m_stopping = false;
+	for (size_t i = 0; i < workerCount; ++i) {
+		m_workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i, onStart));
+	}
+}
+
+void JobSystem::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+	m_workers.clear();
+}
+
+void JobSystem::WorkerLoop(size_t workerIndex, std::function<void(size_t)> onStart)
+{
+	if (onStart) {
+		onStart(workerIndex);
+	}
+
+	uint64_t lastGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() { return m_stopping || m_generation != lastGeneration; });
+			if (m_stopping) {
+				return;
+			}
+			lastGeneration = m_generation;
+			m_busyWorkers++;
+		}
+
+		RunChunks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_busyWorkers--;
+		}
+		m_done.notify_all();
+	}
+}
+
+void JobSystem::RunChunks()
+{
+	while (true) {
+		size_t chunk = m_nextChunk.fetch_add(1);
+		if (chunk >= m_chunkCount) {
+			return;
+		}
+		size_t begin = chunk * m_grainSize;
+		size_t end = begin + m_grainSize < m_count ? begin + m_grainSize : m_count;
+		m_job(begin, end);
+		m_chunksDone.fetch_add(1);
+	}
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grainSize, const RangeJob& job)
+{
+	if (count == 0) {
+		return;
+	}
+	if (grainSize == 0) {
+		grainSize = 1;
+	}
+	if (m_workers.empty() || count <= grainSize) {
+		job(0, count);
+		return;
+	}
+
+	{
+		// A worker that woke late for the last job may still be checking for chunks
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [&]() { return m_busyWorkers == 0; });
+		m_job = job;
+		m_count = count;
+		m_grainSize = grainSize;
+		m_chunkCount = (count + grainSize - 1) / grainSize;
+		m_nextChunk.store(0);
+		m_chunksDone.store(0);
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	// Help out rather than sit idle
+	RunChunks();
+
+	// Wait for the last chunks, and for every worker to be done looking at this job
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&]() { return m_chunksDone.load() == m_chunkCount && m_busyWorkers == 0; });
+	m_job = nullptr;
+}
+
+JobSystem::~JobSystem()
+{
+	Stop();
+}
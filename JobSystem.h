@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// --------------------------------------------------------
+// Fixed pool of worker threads for data-parallel work. 
+// ParallelFor splits a range into chunks that the workers and 
+// the calling thread take turns grabbing until none are left.
+// Only one ParallelFor runs at a time, and it should be called 
+// from the main thread.
+// --------------------------------------------------------
+class JobSystem
+{
+public:
+	typedef std::function<void(size_t begin, size_t end)> RangeJob;
+private:
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	bool m_stopping = false;
+
+	// The job in progress
+	RangeJob m_job;
+	size_t m_count = 0;
+	size_t m_grainSize = 1;
+	size_t m_chunkCount = 0;
+	uint64_t m_generation = 0;
+	std::atomic<size_t> m_nextChunk;
+	std::atomic<size_t> m_chunksDone;
+	int m_busyWorkers = 0;
+
+	void WorkerLoop(size_t workerIndex, std::function<void(size_t)> onStart);
+
+	// Runs chunks of the current job until there are none left
+	void RunChunks();
+public:
+	JobSystem();
+
+	// --------------------------------------------------------
+	// Starts the worker threads
+	// @param size_t workerCount 0 to use one less than the number of hardware threads
+	// @param std::function<void(size_t)> onStart called on each worker with its index
+	// --------------------------------------------------------
+	void Start(size_t workerCount = 0, std::function<void(size_t)> onStart = nullptr);
+
+	// --------------------------------------------------------
+	// Finishes any work and joins the worker threads
+	// --------------------------------------------------------
+	void Stop();
+
+	// --------------------------------------------------------
+	// Calls job with consecutive sub-ranges of [0, count), each at 
+	// most grainSize long, spread across the workers. Returns once 
+	// every sub-range is done. Runs inline when the range fits in one chunk.
+	// --------------------------------------------------------
+	void ParallelFor(size_t count, size_t grainSize, const RangeJob& job);
+
+	size_t GetWorkerCount() const { return m_workers.size(); }
+
+	~JobSystem();
+};
@@ -0,0 +1,512 @@
+#include "LevelStreamer.h"
+#include "SceneSerializer.h"
+#include "World.h"
+#include <rapidjson/document.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace rapidjson;
+
+namespace
+{
+	size_t GetFileSize(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		return file ? (size_t)file.tellg() : 0;
+	}
+
+	std::string GetString(const Value& object, const char* key)
+	{
+		Value::ConstMemberIterator member = object.FindMember(key);
+		return member != object.MemberEnd() && member->value.IsString() ? member->value.GetString() : "";
+	}
+}
+
+bool LevelStreamer::Open(const std::string& manifestPath, ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	Close();
+
+	std::ifstream input(manifestPath);
+	if (!input) {
+		return false;
+	}
+	std::string contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+	Document document;
+	document.Parse(contents.c_str());
+	if (document.HasParseError() || !document.IsObject() || !document.HasMember("cells") || !document["cells"].IsArray()) {
+		return false;
+	}
+
+	m_device = device;
+	m_context = context;
+	if (document.HasMember("cellSize") && document["cellSize"].IsNumber()) {
+		m_cellSize = (float)document["cellSize"].GetDouble();
+	}
+
+	// Resources are referred to by index from here on
+	std::map<std::pair<ResourceType, std::string>, size_t> ids;
+	auto addResources = [&](const char* key, ResourceType type) {
+		if (!document.HasMember(key) || !document[key].IsObject()) {
+			return;
+		}
+		for (const auto& member : document[key].GetObject()) {
+			Resource resource;
+			resource.type = type;
+			resource.name = member.name.GetString();
+			if (member.value.IsString()) {
+				resource.path = member.value.GetString();
+				resource.bytes = GetFileSize(resource.path);
+			}
+			else if (member.value.IsObject()) {
+				resource.vertexShader = GetString(member.value, "vertexShader");
+				resource.pixelShader = GetString(member.value, "pixelShader");
+				resource.sampler = GetString(member.value, "sampler");
+				resource.diffuse = GetString(member.value, "diffuse");
+				resource.normal = GetString(member.value, "normal");
+				resource.reflection = GetString(member.value, "reflection");
+			}
+			ids[{ type, resource.name }] = m_resources.size();
+			m_resources.push_back(resource);
+		}
+	};
+	addResources("meshes", ResourceType::Mesh);
+	addResources("textures", ResourceType::Texture);
+	addResources("materials", ResourceType::Material);
+
+	for (const Value& value : document["cells"].GetArray()) {
+		if (!value.IsObject()) {
+			continue;
+		}
+		Cell cell;
+		cell.x = value.HasMember("x") && value["x"].IsInt() ? value["x"].GetInt() : 0;
+		cell.z = value.HasMember("z") && value["z"].IsInt() ? value["z"].GetInt() : 0;
+		cell.scenePath = GetString(value, "scene");
+		cell.bytes = GetFileSize(cell.scenePath);
+
+		auto use = [&](ResourceType type, const std::string& name) {
+			auto it = ids.find({ type, name });
+			if (it != ids.end() && std::find(cell.resources.begin(), cell.resources.end(), it->second) == cell.resources.end()) {
+				cell.resources.push_back(it->second);
+			}
+		};
+		auto useList = [&](const char* key, ResourceType type) {
+			if (!value.HasMember(key) || !value[key].IsArray()) {
+				return;
+			}
+			for (const Value& name : value[key].GetArray()) {
+				if (!name.IsString()) {
+					continue;
+				}
+				// A material's textures are used by the cell too, and have to be made first
+				if (type == ResourceType::Material) {
+					auto material = ids.find({ type, name.GetString() });
+					if (material != ids.end()) {
+						const Resource& resource = m_resources[material->second];
+						use(ResourceType::Texture, resource.diffuse);
+						use(ResourceType::Texture, resource.normal);
+					}
+				}
+				use(type, name.GetString());
+			}
+		};
+		useList("meshes", ResourceType::Mesh);
+		useList("textures", ResourceType::Texture);
+		useList("materials", ResourceType::Material);
+		m_cells.push_back(cell);
+	}
+
+	m_stopping = false;
+	m_thread = std::thread(&LevelStreamer::ThreadLoop, this);
+	return true;
+}
+
+void LevelStreamer::Close()
+{
+	Stop();
+	for (size_t i = 0; i < m_cells.size(); ++i) {
+		UnloadCell(i);
+	}
+
+	// Cells still on the loading thread when it stopped have their meshes deleted by Stop
+	for (Cell& cell : m_cells) {
+		if (cell.state == CellState::Reading) {
+			for (size_t index : cell.resources) {
+				Resource& resource = m_resources[index];
+				if (--resource.refs == 0) {
+					m_releaseQueue.push_back(index);
+				}
+			}
+		}
+	}
+
+	// Resources waiting to be freed keep their names, so the next Update can free them
+	std::vector<Resource> released;
+	for (size_t index : m_releaseQueue) {
+		released.push_back(m_resources[index]);
+	}
+	m_releaseQueue.clear();
+	m_cells.clear();
+	m_resources = released;
+	for (size_t i = 0; i < m_resources.size(); ++i) {
+		m_releaseQueue.push_back(i);
+	}
+}
+
+void LevelStreamer::Stop()
+{
+	if (!m_thread.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_requests.clear();
+	}
+	m_wake.notify_all();
+	m_thread.join();
+
+	// Meshes that were read but never added to the World
+	for (ReadResult& result : m_results) {
+		for (auto& mesh : result.meshes) {
+			delete mesh.second;
+			m_resources[mesh.first].reading = false;
+		}
+	}
+	m_results.clear();
+}
+
+void LevelStreamer::ThreadLoop()
+{
+	while (true) {
+		ReadRequest request;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_stopping || !m_requests.empty(); });
+			if (m_stopping) {
+				return;
+			}
+			request = std::move(m_requests.front());
+			m_requests.pop_front();
+		}
+
+		ReadResult result;
+		result.cell = request.cell;
+		std::ifstream input(request.scenePath, std::ios::binary);
+		result.succeeded = (bool)input;
+		if (input) {
+			result.scene.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+		}
+
+		// D3D11 devices can make buffers from any thread
+		for (auto& mesh : request.meshes) {
+			if (std::ifstream(mesh.second)) {
+				result.meshes.push_back({ mesh.first, new Mesh(mesh.second.c_str(), m_device) });
+			}
+			else {
+				result.meshes.push_back({ mesh.first, nullptr });
+				result.succeeded = false;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_results.push_back(std::move(result));
+	}
+}
+
+void LevelStreamer::Update(DirectX::XMFLOAT3 position)
+{
+	FreeReleasedResources();
+	if (m_cells.empty()) {
+		return;
+	}
+	ReceiveResults();
+
+	for (size_t i = 0; i < m_cells.size(); ++i) {
+		CellState state = m_cells[i].state;
+		if ((state == CellState::Ready || state == CellState::Loaded) && GetDistance(m_cells[i], position) > m_unloadRadius) {
+			UnloadCell(i);
+		}
+	}
+
+	// Load the nearest cells first, while they fit in the budget
+	std::vector<std::pair<float, size_t>> wanted;
+	std::vector<std::pair<float, size_t>> evictable;
+	for (size_t i = 0; i < m_cells.size(); ++i) {
+		const Cell& cell = m_cells[i];
+		float distance = GetDistance(cell, position);
+		if (cell.state == CellState::Unloaded && !cell.failed && distance <= m_loadRadius) {
+			wanted.push_back({ distance, i });
+		}
+		else if ((cell.state == CellState::Ready || cell.state == CellState::Loaded) && distance > m_loadRadius) {
+			evictable.push_back({ distance, i });
+		}
+	}
+	std::sort(wanted.begin(), wanted.end());
+	std::sort(evictable.begin(), evictable.end());
+
+	size_t usage = GetMemoryUsage();
+	for (auto& candidate : wanted) {
+		size_t cost = GetLoadCost(m_cells[candidate.second]);
+		while (usage + cost > m_memoryBudget && !evictable.empty()) {
+			UnloadCell(evictable.back().second);
+			evictable.pop_back();
+			usage = GetMemoryUsage();
+			cost = GetLoadCost(m_cells[candidate.second]);
+		}
+		if (usage + cost > m_memoryBudget) {
+			break;
+		}
+		LoadCell(candidate.second);
+		usage += cost;
+	}
+
+	// Spawn read cells nearest first, a few at a time so a frame doesn't spawn too much
+	std::vector<std::pair<float, size_t>> ready;
+	for (size_t i = 0; i < m_cells.size(); ++i) {
+		if (m_cells[i].state == CellState::Ready) {
+			ready.push_back({ GetDistance(m_cells[i], position), i });
+		}
+	}
+	std::sort(ready.begin(), ready.end());
+	size_t spawned = 0;
+	for (size_t i = 0; i < ready.size() && spawned < m_maxSpawnsPerUpdate; ++i) {
+		if (SpawnCell(m_cells[ready[i].second])) {
+			spawned++;
+		}
+	}
+}
+
+void LevelStreamer::FreeReleasedResources()
+{
+	World* world = World::GetInstance();
+	for (size_t index : m_releaseQueue) {
+		Resource& resource = m_resources[index];
+		if (resource.refs > 0 || !resource.resident) {
+			continue;
+		}
+		switch (resource.type) {
+		case ResourceType::Mesh: world->DestroyMesh(resource.name); break;
+		case ResourceType::Texture: world->DestroyTexture(resource.name); break;
+		case ResourceType::Material: world->DestroyMaterial(resource.name); break;
+		}
+		resource.resident = false;
+	}
+	m_releaseQueue.clear();
+}
+
+void LevelStreamer::ReceiveResults()
+{
+	std::vector<ReadResult> results;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		results.swap(m_results);
+	}
+
+	World* world = World::GetInstance();
+	for (ReadResult& result : results) {
+		for (auto& mesh : result.meshes) {
+			Resource& resource = m_resources[mesh.first];
+			resource.reading = false;
+			if (mesh.second) {
+				world->AddMesh(resource.name, mesh.second, resource.path.c_str(), m_device);
+				resource.resident = true;
+				continue;
+			}
+
+			// Other cells were waiting for this mesh instead of reading it themselves
+			for (size_t i = 0; i < m_cells.size(); ++i) {
+				Cell& other = m_cells[i];
+				if (i == result.cell || std::find(other.resources.begin(), other.resources.end(), mesh.first) == other.resources.end()) {
+					continue;
+				}
+				if (other.state == CellState::Ready) {
+					FailCell(other);
+				}
+				else if (other.state == CellState::Reading) {
+					other.failed = true; // Released when its own read comes back
+				}
+			}
+		}
+
+		Cell& cell = m_cells[result.cell];
+		if (result.succeeded && !cell.failed) {
+			cell.scene = std::move(result.scene);
+			cell.state = CellState::Ready;
+		}
+		else {
+			FailCell(cell);
+		}
+	}
+}
+
+void LevelStreamer::LoadCell(size_t index)
+{
+	Cell& cell = m_cells[index];
+	ReadRequest request;
+	request.cell = index;
+	request.scenePath = cell.scenePath;
+
+	// Only the first cell to use a mesh reads it
+	for (size_t resourceIndex : cell.resources) {
+		Resource& resource = m_resources[resourceIndex];
+		resource.refs++;
+		if (resource.type == ResourceType::Mesh && !resource.resident && !resource.reading) {
+			resource.reading = true;
+			request.meshes.push_back({ resourceIndex, resource.path });
+		}
+	}
+	cell.state = CellState::Reading;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests.push_back(std::move(request));
+	}
+	m_wake.notify_one();
+}
+
+bool LevelStreamer::SpawnCell(Cell& cell)
+{
+	for (size_t index : cell.resources) {
+		if (m_resources[index].reading) {
+			return false;
+		}
+	}
+
+	World* world = World::GetInstance();
+	for (size_t index : cell.resources) {
+		Resource& resource = m_resources[index];
+		if (resource.resident) {
+			continue;
+		}
+		if (resource.type == ResourceType::Texture) {
+			std::wstring path(resource.path.begin(), resource.path.end());
+			world->CreateTexture(resource.name, m_device, m_context, path.c_str());
+			resource.resident = true;
+		}
+		else if (resource.type == ResourceType::Material) {
+			world->CreateMaterial(resource.name,
+				world->GetVertexShader(resource.vertexShader), world->GetPixelShader(resource.pixelShader),
+				resource.diffuse.empty() ? nullptr : world->GetTexture(resource.diffuse),
+				resource.normal.empty() ? nullptr : world->GetTexture(resource.normal),
+				resource.reflection.empty() ? nullptr : world->GetCubeTexture(resource.reflection),
+				world->GetSamplerState(resource.sampler));
+			resource.resident = true;
+		}
+	}
+
+	// A bad scene leaves no entities behind, but its resources are still held
+	if (!SceneSerializer::LoadBinary(cell.scene.data(), cell.scene.size(), &cell.entities)) {
+		FailCell(cell);
+		return true;
+	}
+	std::vector<char>().swap(cell.scene);
+	cell.state = CellState::Loaded;
+	return true;
+}
+
+void LevelStreamer::UnloadCell(size_t index)
+{
+	Cell& cell = m_cells[index];
+	if (cell.state != CellState::Ready && cell.state != CellState::Loaded) {
+		return;
+	}
+
+	World* world = World::GetInstance();
+	for (EntityHandle entity : cell.entities) {
+		world->Destroy(entity);
+	}
+	cell.entities.clear();
+	std::vector<char>().swap(cell.scene);
+	cell.state = CellState::Unloaded;
+	ReleaseResources(cell);
+}
+
+void LevelStreamer::FailCell(Cell& cell)
+{
+	std::vector<char>().swap(cell.scene);
+	cell.state = CellState::Unloaded;
+	cell.failed = true;
+	ReleaseResources(cell);
+}
+
+void LevelStreamer::ReleaseResources(Cell& cell)
+{
+	for (size_t index : cell.resources) {
+		Resource& resource = m_resources[index];
+		if (--resource.refs == 0) {
+			m_releaseQueue.push_back(index);
+		}
+	}
+}
+
+float LevelStreamer::GetDistance(const Cell& cell, DirectX::XMFLOAT3 position)
+{
+	// Distance to the closest point of the cell's square
+	float minX = cell.x * m_cellSize;
+	float minZ = cell.z * m_cellSize;
+	float dx = 0.0f;
+	float dz = 0.0f;
+	if (position.x < minX) dx = minX - position.x;
+	else if (position.x > minX + m_cellSize) dx = position.x - (minX + m_cellSize);
+	if (position.z < minZ) dz = minZ - position.z;
+	else if (position.z > minZ + m_cellSize) dz = position.z - (minZ + m_cellSize);
+	return sqrtf(dx * dx + dz * dz);
+}
+
+size_t LevelStreamer::GetLoadCost(const Cell& cell)
+{
+	size_t cost = cell.bytes;
+	for (size_t index : cell.resources) {
+		if (m_resources[index].refs == 0) {
+			cost += m_resources[index].bytes;
+		}
+	}
+	return cost;
+}
+
+size_t LevelStreamer::GetMemoryUsage()
+{
+	size_t usage = 0;
+	for (const Cell& cell : m_cells) {
+		if (cell.state != CellState::Unloaded) {
+			usage += cell.bytes;
+		}
+	}
+	for (const Resource& resource : m_resources) {
+		if (resource.refs > 0) {
+			usage += resource.bytes;
+		}
+	}
+	return usage;
+}
+
+void LevelStreamer::SetRadii(float loadRadius, float unloadRadius)
+{
+	m_loadRadius = loadRadius;
+	m_unloadRadius = unloadRadius > loadRadius ? unloadRadius : loadRadius;
+}
+
+LevelStreamer::Stats LevelStreamer::GetStats()
+{
+	Stats stats;
+	for (const Cell& cell : m_cells) {
+		if (cell.state == CellState::Loaded) {
+			stats.loadedCells++;
+		}
+		else if (cell.state != CellState::Unloaded) {
+			stats.pendingCells++;
+		}
+	}
+	stats.memoryUsage = GetMemoryUsage();
+	stats.memoryBudget = m_memoryBudget;
+	return stats;
+}
+
+LevelStreamer::~LevelStreamer()
+{
+	Stop();
+}
@@ -0,0 +1,199 @@
+#pragma once
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "EntityHandle.h"
+class Mesh;
+
+// --------------------------------------------------------
+// Streams a level that's split into square cells on the XZ plane.
+// Each cell is a binary scene (see SceneSerializer) plus the meshes,
+// textures and materials it uses, listed in a JSON manifest:
+//
+//     {
+//         "cellSize": 64,
+//         "meshes": { "rock": "Assets/Models/rock.obj" },
+//         "textures": { "rockDiffuse": "Assets/Textures/rock.png" },
+//         "materials": { "rock": { "vertexShader": "vs", "pixelShader": "ps",
+//             "sampler": "main", "diffuse": "rockDiffuse", "normal": "rockNormal" } },
+//         "cells": [ { "x": 0, "z": 0, "scene": "Assets/Levels/forest_0_0.ftscene",
+//             "meshes": [ "rock" ], "materials": [ "rock" ] } ]
+//     }
+//
+// Shaders, samplers and cube textures are looked up in the World by
+// name, so create them before opening a level.
+//
+// Cells near the camera are loaded nearest first. Their scene files
+// and meshes are read on a background thread, and they're spawned on
+// the main thread, a few per update. Cells past the unload radius are
+// destroyed. Resources are reference counted across cells, and freed
+// once the last cell using them is gone. Loading stops when the cells'
+// estimated size (their files' sizes on disk) would go over the memory
+// budget; loaded cells outside the load radius are unloaded first to
+// make room.
+// --------------------------------------------------------
+class LevelStreamer
+{
+public:
+	struct Stats
+	{
+		size_t loadedCells = 0;
+		size_t pendingCells = 0; // Being read, or waiting to spawn
+		size_t memoryUsage = 0;
+		size_t memoryBudget = 0;
+	};
+private:
+	enum class ResourceType
+	{
+		Mesh,
+		Texture,
+		Material
+	};
+
+	struct Resource
+	{
+		ResourceType type;
+		std::string name;
+		std::string path;
+		size_t bytes = 0;
+
+		// Names of the World resources a material is made from
+		std::string vertexShader;
+		std::string pixelShader;
+		std::string sampler;
+		std::string diffuse;
+		std::string normal;
+		std::string reflection;
+
+		int refs = 0;
+		bool resident = false;	// Created in the World
+		bool reading = false;	// Being made on the loading thread
+	};
+
+	enum class CellState
+	{
+		Unloaded,
+		Reading,	// On the loading thread
+		Ready,		// Read, waiting to spawn
+		Loaded
+	};
+
+	struct Cell
+	{
+		int x = 0;
+		int z = 0;
+		std::string scenePath;
+		size_t bytes = 0;
+		std::vector<size_t> resources; // Textures come before the materials that use them
+		CellState state = CellState::Unloaded;
+		bool failed = false; // Files were missing or bad, so it isn't tried again
+		std::vector<char> scene;
+		std::vector<EntityHandle> entities;
+	};
+
+	struct ReadRequest
+	{
+		size_t cell;
+		std::string scenePath;
+		std::vector<std::pair<size_t, std::string>> meshes; // Resource and path
+	};
+
+	struct ReadResult
+	{
+		size_t cell;
+		bool succeeded;
+		std::vector<char> scene;
+		std::vector<std::pair<size_t, Mesh*>> meshes;
+	};
+
+	std::vector<Cell> m_cells;
+	std::vector<Resource> m_resources;
+	std::vector<size_t> m_releaseQueue;
+	float m_cellSize = 64.0f;
+	float m_loadRadius = 128.0f;
+	float m_unloadRadius = 192.0f;
+	size_t m_memoryBudget = 512 * 1024 * 1024;
+	size_t m_maxSpawnsPerUpdate = 1;
+	ID3D11Device* m_device = nullptr;
+	ID3D11DeviceContext* m_context = nullptr;
+
+	// The loading thread
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::deque<ReadRequest> m_requests;
+	std::vector<ReadResult> m_results;
+	bool m_stopping = false;
+
+	void ThreadLoop();
+
+	// --------------------------------------------------------
+	// Frees resources that no cell has used since the last update.
+	// They're kept until then so the cells' entities are destroyed first.
+	// --------------------------------------------------------
+	void FreeReleasedResources();
+	void ReceiveResults();
+	void LoadCell(size_t index);
+	void UnloadCell(size_t index);
+
+	// --------------------------------------------------------
+	// Creates the cell's textures and materials and spawns its scene
+	// @returns bool false if one of its meshes is still being read for another cell
+	// --------------------------------------------------------
+	bool SpawnCell(Cell& cell);
+	void ReleaseResources(Cell& cell);
+
+	// --------------------------------------------------------
+	// Gives up on a cell that was read but hasn't spawned anything,
+	// releasing its resources
+	// --------------------------------------------------------
+	void FailCell(Cell& cell);
+
+	float GetDistance(const Cell& cell, DirectX::XMFLOAT3 position);
+	size_t GetLoadCost(const Cell& cell);
+	size_t GetMemoryUsage();
+public:
+	LevelStreamer() { }
+	LevelStreamer(const LevelStreamer&) = delete;
+	LevelStreamer& operator=(const LevelStreamer&) = delete;
+
+	// --------------------------------------------------------
+	// Starts streaming a level. Closes the current one first.
+	// @param const std::string & manifestPath the level's JSON manifest
+	// @returns bool false if the manifest couldn't be read
+	// --------------------------------------------------------
+	bool Open(const std::string& manifestPath, ID3D11Device* device, ID3D11DeviceContext* context);
+
+	// --------------------------------------------------------
+	// Destroys every cell's entities. Their resources are freed in the next Update.
+	// --------------------------------------------------------
+	void Close();
+
+	// --------------------------------------------------------
+	// Stops the loading thread without touching the World. Called as the World shuts down.
+	// --------------------------------------------------------
+	void Stop();
+
+	// --------------------------------------------------------
+	// Loads, spawns and unloads cells around a position. Called by the World each tick.
+	// --------------------------------------------------------
+	void Update(DirectX::XMFLOAT3 position);
+
+	// --------------------------------------------------------
+	// Cells within the load radius are loaded, and cells past the unload
+	// radius are unloaded. Keep the unload radius larger, so cells on the
+	// edge don't load and unload over and over.
+	// --------------------------------------------------------
+	void SetRadii(float loadRadius, float unloadRadius);
+	void SetMemoryBudget(size_t bytes) { m_memoryBudget = bytes; }
+	void SetMaxSpawnsPerUpdate(size_t count) { m_maxSpawnsPerUpdate = count; }
+
+	Stats GetStats();
+
+	~LevelStreamer();
+};
@@ -1,6 +1,7 @@
 #include "LightComponent.h"
 #include "Transform.h"
 #include "Entity.h"
+#include "SceneArchive.h"
 
 void LightComponent::Start()
 {
@@ -10,6 +11,14 @@ void LightComponent::Start()
 void LightComponent::Tick(float deltaTime)
 {
 	Transform* transform = GetOwner()->GetTransform();
-	m_data.position = transform->GetPosition();
+	m_data.position = transform->GetWorldPosition();
 	m_data.direction = transform->GetForward();
 }
+
+void LightComponent::Serialize(SceneArchive& archive)
+{
+	archive.Fields(this);
+	if (m_data.type < Directional || m_data.type > Spot) {
+		m_data.type = Point;
+	}
+}
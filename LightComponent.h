@@ -40,5 +40,16 @@ public:
 
 	virtual void Tick(float deltaTime) override;
 
+	virtual bool CanSleep() override { return true; }
+
+	virtual void Serialize(SceneArchive& archive) override;
+
+	REFLECT_FIELDS(LightComponent,
+		REFLECT_FIELD("type", m_data.type),
+		REFLECT_FIELD("range", m_data.range),
+		REFLECT_FIELD("intensity", m_data.intensity),
+		REFLECT_FIELD("color", m_data.color),
+		REFLECT_FIELD("spotFalloff", m_data.spotFalloff))
+
 };
 
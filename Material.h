@@ -1,6 +1,9 @@
 #pragma once
 #include "SimpleShader.h"
+#include "ResourceCache.h"
 #include <DirectXMath.h>
+#include <cstdint>
+#include <string>
 
 // --------------------------------------------------------
 // Material class which is a container for a vertex and 
@@ -11,12 +14,23 @@ class Material
 private:
 	SimpleVertexShader* m_vertexShader;
 	SimplePixelShader* m_pixelShader;
+	SimpleVertexShader* m_instancedVertexShader = nullptr;
 	ID3D11ShaderResourceView* m_diffuseSRV;
 	ID3D11ShaderResourceView* m_normalSRV;
 	ID3D11ShaderResourceView* m_reflectionSRV;
 	ID3D11SamplerState* m_samplerState;
 	ID3D11BlendState* m_blendState;
 	ID3D11DepthStencilState* m_depthStencilState;
+
+	// Small ids used to build render queue sort keys. Assigned by the World.
+	uint16_t m_sortId = 0;
+	uint16_t m_shaderSortId = 0;
+
+	std::string m_name; // Name in the World, if it was made with World::CreateMaterial
+
+	// The World's textures this uses, so they aren't freed or evicted while it's alive
+	TextureHandle m_diffuseTexture;
+	TextureHandle m_normalTexture;
 public:
 	float m_shiniess = 128.0f;
 	float m_roughness = 0; //How rouch the object is 0 is a mirror
@@ -39,12 +53,28 @@ public:
 		ID3D11DepthStencilState* depthStencilState = nullptr
 	);
 
+	const std::string& GetName() { return m_name; }
+	void SetName(const std::string& name) { m_name = name; }
+	void SetTextureHandles(TextureHandle diffuse, TextureHandle normal) { m_diffuseTexture = diffuse; m_normalTexture = normal; }
+
 	SimpleVertexShader* GetVertexShader() { return m_vertexShader; }
 	SimplePixelShader*  GetPixelShader()  { return m_pixelShader;  }
+
+	// --------------------------------------------------------
+	// Optional vertex shader that reads the world matrix from per-instance
+	// data. When set, entities sharing this material and a mesh are drawn
+	// with a single instanced draw call.
+	// --------------------------------------------------------
+	SimpleVertexShader* GetInstancedVertexShader() { return m_instancedVertexShader; }
+	void SetInstancedVertexShader(SimpleVertexShader* instancedVertexShader) { m_instancedVertexShader = instancedVertexShader; }
 	ID3D11ShaderResourceView* GetDiffuse() { return m_diffuseSRV; }
 	ID3D11ShaderResourceView* GetNormals() { return m_normalSRV; }
 	ID3D11ShaderResourceView* GetReflectionSRV() { return m_reflectionSRV; }
 	ID3D11SamplerState* GetSamplerState() { return m_samplerState; }
 	ID3D11BlendState* GetBlendState() { return m_blendState; }
 	ID3D11DepthStencilState* GetDepthStencilState() { return m_depthStencilState; }
+
+	uint16_t GetSortId() { return m_sortId; }
+	uint16_t GetShaderSortId() { return m_shaderSortId; }
+	void SetSortIds(uint16_t sortId, uint16_t shaderSortId) { m_sortId = sortId; m_shaderSortId = shaderSortId; }
 };
@@ -1,4 +1,5 @@
 #include "MaterialComponent.h"
+#include "SceneArchive.h"
 
 void MaterialComponent::Start()
 {
@@ -7,3 +8,8 @@ void MaterialComponent::Start()
 void MaterialComponent::Tick(float deltaTime)
 {
 }
+
+void MaterialComponent::Serialize(SceneArchive& archive)
+{
+	archive.Fields(this);
+}
@@ -8,7 +8,7 @@
 class MaterialComponent : public Component
 {
 public:
-	Material* m_material;
+	MaterialHandle m_material;
 
 	MaterialComponent(Entity* entity) : Component(entity) { }
 
@@ -16,5 +16,12 @@ public:
 
 	virtual void Tick(float deltaTime) override;
 
+	virtual bool CanSleep() override { return true; }
+
+	virtual void Serialize(SceneArchive& archive) override;
+
+	REFLECT_FIELDS(MaterialComponent,
+		REFLECT_FIELD("material", m_material))
+
 };
 
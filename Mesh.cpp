@@ -82,8 +82,19 @@ void Mesh::Initialize(Vertex* vertices, int numVertices, unsigned int* indices,
 	// Calculate the tangents before copying to buffer
 	CalculateTangents(vertices, numVertices, indices, numIndices);
 
+	// Bounds are used for culling and spatial queries
+	BoundingBox::CreateFromPoints(m_localBox, numVertices, &vertices[0].Position, sizeof(Vertex));
+	BoundingSphere::CreateFromPoints(m_localSphere, numVertices, &vertices[0].Position, sizeof(Vertex));
+
 	m_indexBufferSize = numIndices;
 
+	// Keep positions and indices around for building colliders
+	m_positions.resize(numVertices);
+	for (int i = 0; i < numVertices; ++i) {
+		m_positions[i] = vertices[i].Position;
+	}
+	m_indices.assign(indices, indices + numIndices);
+
 	// Create the VERTEX BUFFER description -----------------------------------
 	// - The description is created on the stack because we only need
 	//    it to create the buffer.  The description is then useless.
@@ -1,6 +1,10 @@
 #pragma once
 #include <d3d11.h>
+#include <DirectXCollision.h>
 #include "Vertex.h"
+#include <cstdint>
+#include <vector>
+#include <string>
 
 // --------------------------------------------------------
 // This is a container class which holds and sets up 
@@ -12,6 +16,16 @@ private:
 	ID3D11Buffer* m_vertexBuffer = nullptr;
 	ID3D11Buffer* m_indexBuffer = nullptr;
 	int m_indexBufferSize = 0;
+	uint16_t m_sortId = 0; // Used by the render queue. Assigned by the World.
+	std::string m_name; // Name in the World, if it was made with World::CreateMesh
+
+	// Local space bounds, computed from the vertices at load
+	DirectX::BoundingBox m_localBox;
+	DirectX::BoundingSphere m_localSphere;
+
+	// CPU side copies of the positions and indices, used to build colliders
+	std::vector<DirectX::XMFLOAT3> m_positions;
+	std::vector<unsigned int> m_indices;
 
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
 	void Initialize(Vertex* vertices, int numVertices, unsigned int* indices, int numIndices, ID3D11Device* device);
@@ -34,6 +48,14 @@ public:
 	ID3D11Buffer* GetVertexBuffer() { return m_vertexBuffer; }
 	ID3D11Buffer* GetIndexBuffer() { return m_indexBuffer; }
 	int			  GetIndexCount() { return m_indexBufferSize; }
+	uint16_t	  GetSortId() { return m_sortId; }
+	const DirectX::BoundingBox& GetLocalBox() { return m_localBox; }
+	const DirectX::BoundingSphere& GetLocalSphere() { return m_localSphere; }
+	const std::vector<DirectX::XMFLOAT3>& GetPositions() { return m_positions; }
+	const std::vector<unsigned int>& GetIndices() { return m_indices; }
+	void		  SetSortId(uint16_t sortId) { m_sortId = sortId; }
+	const std::string& GetName() { return m_name; }
+	void		  SetName(const std::string& name) { m_name = name; }
 	 
 	~Mesh();
 
@@ -1,4 +1,22 @@
 #include "MeshComponent.h"
+#include "SceneArchive.h"
+
+using namespace DirectX;
+
+bool MeshComponent::UpdateWorldBounds(const DirectX::XMFLOAT4X4& world, uint32_t worldVersion)
+{
+	if (!m_mesh || (worldVersion == m_boundsVersion && m_boundsMesh == m_mesh)) {
+		return false;
+	}
+
+	// World matrices are stored transposed for the GPU
+	XMMATRIX worldMatrix = XMMatrixTranspose(XMLoadFloat4x4(&world));
+	m_mesh->GetLocalBox().Transform(m_worldBox, worldMatrix);
+	m_mesh->GetLocalSphere().Transform(m_worldSphere, worldMatrix);
+	m_boundsMesh = m_mesh;
+	m_boundsVersion = worldVersion;
+	return true;
+}
 
 void MeshComponent::Start()
 {
@@ -7,3 +25,8 @@ void MeshComponent::Start()
 void MeshComponent::Tick(float deltaTime)
 {
 }
+
+void MeshComponent::Serialize(SceneArchive& archive)
+{
+	archive.Fields(this);
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include "Component.h"
 #include "Mesh.h"
+#include <DirectXCollision.h>
+#include <cstdint>
 
 
 // --------------------------------------------------------
@@ -8,14 +10,45 @@
 // --------------------------------------------------------
 class MeshComponent : public Component
 {
+private:
+	// World space bounds of the mesh, and the mesh they were computed for
+	DirectX::BoundingBox m_worldBox;
+	DirectX::BoundingSphere m_worldSphere;
+	Mesh* m_boundsMesh = nullptr;
+	uint32_t m_boundsVersion = 0;
+
+	// The World's spatial tree proxy for these bounds, or -1 if not in the tree
+	int m_proxyId = -1;
 public:
 
 	MeshComponent(Entity* entity) : Component(entity) {} 
 
-	Mesh* m_mesh;
+	MeshHandle m_mesh;
+
+	// --------------------------------------------------------
+	// Recomputes the world space bounds if the transform moved 
+	// or the mesh was swapped since the last update.
+	// @param DirectX::XMFLOAT4X4 world the owner's (transposed) world matrix
+	// @param uint32_t worldVersion the owner Transform's world version
+	// @returns bool whether the bounds changed
+	// --------------------------------------------------------
+	bool UpdateWorldBounds(const DirectX::XMFLOAT4X4& world, uint32_t worldVersion);
+
+	const DirectX::BoundingBox& GetWorldBox() { return m_worldBox; }
+	const DirectX::BoundingSphere& GetWorldSphere() { return m_worldSphere; }
+
+	int GetProxyId() { return m_proxyId; }
+	void SetProxyId(int proxyId) { m_proxyId = proxyId; }
 
 	virtual void Start() override;
 	virtual void Tick(float deltaTime) override;
 
+	virtual bool CanSleep() override { return true; }
+
+	virtual void Serialize(SceneArchive& archive) override;
+
+	REFLECT_FIELDS(MeshComponent,
+		REFLECT_FIELD("mesh", m_mesh))
+
 };
 
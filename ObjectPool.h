@@ -0,0 +1,149 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <mutex>
+#include "SpinLock.h"
+
+// --------------------------------------------------------
+// Counters kept by each ObjectPool
+// --------------------------------------------------------
+struct PoolStats
+{
+	size_t slabAllocations = 0;	// Times the pool went to the heap for more memory
+	size_t capacity = 0;		// Objects the pool can hold without allocating
+	size_t live = 0;			// Objects currently in use
+	size_t allocations = 0;		// Objects ever handed out by the pool
+};
+
+// --------------------------------------------------------
+// Allocation counters reported by the World. Once a scene reaches
+// a steady state, slabAllocations and heapSpills should stop growing.
+// --------------------------------------------------------
+struct AllocationStats
+{
+	PoolStats entities;
+	PoolStats components;		// Totals across every component type's pool
+	size_t heapSpills = 0;		// SmallVectors that outgrew their inline storage
+};
+
+// --------------------------------------------------------
+// Type-independent part of an ObjectPool. Every pool registers
+// itself so their counters can be totalled.
+// --------------------------------------------------------
+class ObjectPoolBase
+{
+protected:
+	PoolStats m_stats;
+
+	ObjectPoolBase()
+	{
+		static SpinLock registryLock;
+		std::lock_guard<SpinLock> lock(registryLock);
+		GetPools().push_back(this);
+	}
+public:
+	// --------------------------------------------------------
+	// Returns every pool that has been created
+	// --------------------------------------------------------
+	static std::vector<ObjectPoolBase*>& GetPools()
+	{
+		static std::vector<ObjectPoolBase*>* pools = new std::vector<ObjectPoolBase*>();
+		return *pools;
+	}
+
+	const PoolStats& GetStats() const { return m_stats; }
+
+	virtual ~ObjectPoolBase() { }
+};
+
+// --------------------------------------------------------
+// Slab allocator for a single type. Memory is requested from the
+// heap SLAB_SIZE objects at a time and never given back until the
+// program exits. Freed objects go on a free list for reuse, so
+// creating and destroying objects at a steady rate doesn't touch the heap.
+// Create, Destroy and Reserve may be called from any thread.
+// --------------------------------------------------------
+template <class T, size_t SLAB_SIZE = 64>
+class ObjectPool : public ObjectPoolBase
+{
+private:
+	union Slot
+	{
+		Slot* next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	std::vector<Slot*> m_slabs;
+	Slot* m_freeList = nullptr;
+	SpinLock m_lock;
+
+	void AddSlab()
+	{
+		Slot* slab = static_cast<Slot*>(::operator new(sizeof(Slot) * SLAB_SIZE));
+		for (size_t i = 0; i < SLAB_SIZE; ++i) {
+			slab[i].next = i + 1 < SLAB_SIZE ? &slab[i + 1] : m_freeList;
+		}
+		m_freeList = slab;
+		m_slabs.push_back(slab);
+		m_stats.slabAllocations++;
+		m_stats.capacity += SLAB_SIZE;
+	}
+
+	ObjectPool() { }
+public:
+	// --------------------------------------------------------
+	// Get the pool for this type. Pools are never destroyed, so the
+	// World can still give objects back to them while it shuts down.
+	// --------------------------------------------------------
+	static ObjectPool& GetInstance()
+	{
+		static ObjectPool* pool = new ObjectPool();
+		return *pool;
+	}
+
+	// --------------------------------------------------------
+	// Grows the pool ahead of time so it can hold at least count objects
+	// --------------------------------------------------------
+	void Reserve(size_t count)
+	{
+		std::lock_guard<SpinLock> lock(m_lock);
+		while (m_stats.capacity < count) {
+			AddSlab();
+		}
+	}
+
+	// --------------------------------------------------------
+	// Constructs an object in pooled memory
+	// --------------------------------------------------------
+	template <class... Args>
+	T* Create(Args&&... args)
+	{
+		Slot* slot;
+		{
+			std::lock_guard<SpinLock> lock(m_lock);
+			if (!m_freeList) {
+				AddSlab();
+			}
+			slot = m_freeList;
+			m_freeList = slot->next;
+			m_stats.live++;
+			m_stats.allocations++;
+		}
+		return new (slot->storage) T(std::forward<Args>(args)...);
+	}
+
+	// --------------------------------------------------------
+	// Destructs an object made by Create and returns its memory to the pool
+	// --------------------------------------------------------
+	void Destroy(T* object)
+	{
+		object->~T();
+		Slot* slot = reinterpret_cast<Slot*>(object);
+		std::lock_guard<SpinLock> lock(m_lock);
+		slot->next = m_freeList;
+		m_freeList = slot;
+		m_stats.live--;
+	}
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <DirectXMath.h>
+#include "EntityHandle.h"
+#include <cstdint>
+
+// --------------------------------------------------------
+// A ray to cast against the physics world
+// --------------------------------------------------------
+struct RaycastQuery
+{
+	DirectX::XMFLOAT3 origin;
+	DirectX::XMFLOAT3 direction; // Normalized
+	float maxDistance;
+	uint32_t layerMask = 0xFFFFFFFF; // Layers it can hit, as CollisionLayers::GetGroup bits
+};
+
+// --------------------------------------------------------
+// Closest thing a ray or sweep ran into
+// --------------------------------------------------------
+struct RaycastHit
+{
+	bool hit = false;
+	EntityHandle entity;
+	DirectX::XMFLOAT3 point = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 normal = DirectX::XMFLOAT3(0, 0, 0);
+	float distance = 0.0f; // Along the ray, or how far the shape moved before touching
+};
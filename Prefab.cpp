@@ -0,0 +1,28 @@
+#include "Prefab.h"
+
+void Prefab::Apply(Entity* entity) const
+{
+	for (const std::string& tag : m_tags) {
+		entity->AddTag(tag);
+	}
+
+	Transform* transform = entity->GetTransform();
+	transform->SetPosition(m_position);
+	transform->SetRotation(m_rotation);
+	transform->SetScale(m_scale);
+
+	for (const auto& addComponent : m_components) {
+		addComponent(entity);
+	}
+}
+
+void Prefab::Reserve(size_t count) const
+{
+	// Every Entity gets a Transform
+	ObjectPool<Transform>& transforms = ObjectPool<Transform>::GetInstance();
+	transforms.Reserve(transforms.GetStats().live + count);
+
+	for (const auto& reserve : m_reservers) {
+		reserve(count);
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <DirectXMath.h>
+#include "Entity.h"
+
+// --------------------------------------------------------
+// A reusable Entity template: a list of components to add, in
+// order, each with a function that sets its default values.
+// Register prefabs with World::CreatePrefab and spawn them with
+// World::InstantiateBatch.
+// --------------------------------------------------------
+class Prefab
+{
+private:
+	std::string m_name;
+	std::vector<std::string> m_tags;
+	DirectX::XMFLOAT3 m_position = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT4 m_rotation = DirectX::XMFLOAT4(0, 0, 0, 1);
+	DirectX::XMFLOAT3 m_scale = DirectX::XMFLOAT3(1, 1, 1);
+
+	// Adds one component to an Entity and applies its defaults
+	std::vector<std::function<void(Entity*)>> m_components;
+
+	// Grows one component type's pool by the given count
+	std::vector<std::function<void(size_t)>> m_reservers;
+public:
+	Prefab(const std::string& name) : m_name(name) { }
+
+	// --------------------------------------------------------
+	// Adds a component to the layout. T must extend from Component!
+	// @param std::function<void(T*)> init sets the new component's default values
+	// @returns Prefab& this prefab, so calls can be chained
+	// --------------------------------------------------------
+	template <class T>
+	Prefab& AddComponent(std::function<void(T*)> init = nullptr)
+	{
+		m_components.push_back([init](Entity* entity) {
+			T* component = entity->AddComponent<T>();
+			if (init) {
+				init(component);
+			}
+		});
+		m_reservers.push_back([](size_t count) {
+			ObjectPool<T>& pool = ObjectPool<T>::GetInstance();
+			pool.Reserve(pool.GetStats().live + count);
+		});
+		return *this;
+	}
+
+	Prefab& AddTag(const std::string& tag) { m_tags.push_back(tag); return *this; }
+
+	// Default transform values
+	Prefab& SetPosition(DirectX::XMFLOAT3 position) { m_position = position; return *this; }
+	Prefab& SetRotation(DirectX::XMFLOAT4 rotation) { m_rotation = rotation; return *this; }
+	Prefab& SetScale(DirectX::XMFLOAT3 scale) { m_scale = scale; return *this; }
+
+	const std::string& GetName() const { return m_name; }
+
+	// --------------------------------------------------------
+	// Gives a freshly instantiated Entity this prefab's tags,
+	// transform and components
+	// --------------------------------------------------------
+	void Apply(Entity* entity) const;
+
+	// --------------------------------------------------------
+	// Grows the pools of every component in the layout so count
+	// more copies can be made without allocating
+	// --------------------------------------------------------
+	void Reserve(size_t count) const;
+};
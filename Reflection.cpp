@@ -0,0 +1,161 @@
+#include "Reflection.h"
+#include "WorldSnapshot.h"
+#include "World.h"
+#include <cstring>
+
+FieldList::FieldList(std::initializer_list<FieldInfo> fields) : m_fields(fields)
+{
+	for (size_t i = 0; i < m_fields.size(); ++i) {
+		const FieldInfo& field = m_fields[i];
+		bool plainData = field.IsPlainData();
+		m_plainData = m_plainData && plainData;
+
+		// Extend the last segment if this field comes straight after it in memory
+		if (plainData && !m_segments.empty()) {
+			Segment& last = m_segments.back();
+			if (last.plainData && last.offset + last.size == field.offset) {
+				last.size += field.size;
+				last.count++;
+				continue;
+			}
+		}
+		m_segments.push_back({ field.offset, field.size, i, 1, plainData });
+	}
+}
+
+const FieldInfo* FieldList::Find(const std::string& name) const
+{
+	for (const FieldInfo& field : m_fields) {
+		if (name == field.name) {
+			return &field;
+		}
+	}
+	return nullptr;
+}
+
+void FieldList::Copy(void* destination, const void* source) const
+{
+	for (const Segment& segment : m_segments) {
+		const FieldInfo& field = m_fields[segment.first];
+		if (segment.plainData) {
+			std::memcpy(static_cast<char*>(destination) + segment.offset, static_cast<const char*>(source) + segment.offset, segment.size);
+			continue;
+		}
+		switch (field.type) {
+		case FieldType::String: field.Get<std::string>(destination) = field.Get<std::string>(source); break;
+		case FieldType::Mesh: field.Get<MeshHandle>(destination) = field.Get<MeshHandle>(source); break;
+		case FieldType::Material: field.Get<MaterialHandle>(destination) = field.Get<MaterialHandle>(source); break;
+		case FieldType::Sound: field.Get<FMOD::Sound*>(destination) = field.Get<FMOD::Sound*>(source); break;
+		default: break;
+		}
+	}
+}
+
+bool FieldList::Equal(const void* a, const void* b) const
+{
+	std::vector<const FieldInfo*> changed;
+	return !Diff(a, b, changed);
+}
+
+bool FieldList::Diff(const void* a, const void* b, std::vector<const FieldInfo*>& changed) const
+{
+	size_t start = changed.size();
+	for (const Segment& segment : m_segments) {
+		const FieldInfo& first = m_fields[segment.first];
+		if (!segment.plainData) {
+			bool equal = true;
+			switch (first.type) {
+			case FieldType::String: equal = first.Get<std::string>(a) == first.Get<std::string>(b); break;
+			case FieldType::Mesh: equal = first.Get<MeshHandle>(a).Get() == first.Get<MeshHandle>(b).Get(); break;
+			case FieldType::Material: equal = first.Get<MaterialHandle>(a).Get() == first.Get<MaterialHandle>(b).Get(); break;
+			case FieldType::Sound: equal = first.Get<FMOD::Sound*>(a) == first.Get<FMOD::Sound*>(b); break;
+			default: break;
+			}
+			if (!equal) {
+				changed.push_back(&first);
+			}
+			continue;
+		}
+
+		// Compare the whole segment, and only look at its fields if something changed
+		if (std::memcmp(static_cast<const char*>(a) + segment.offset, static_cast<const char*>(b) + segment.offset, segment.size) == 0) {
+			continue;
+		}
+		for (size_t i = segment.first; i < segment.first + segment.count; ++i) {
+			const FieldInfo& field = m_fields[i];
+			if (std::memcmp(static_cast<const char*>(a) + field.offset, static_cast<const char*>(b) + field.offset, field.size) != 0) {
+				changed.push_back(&field);
+			}
+		}
+	}
+	return changed.size() > start;
+}
+
+namespace
+{
+	void WriteString(SnapshotWriter& writer, const std::string& value)
+	{
+		writer.Write((uint32_t)value.size());
+		writer.WriteBytes(value.data(), value.size());
+	}
+
+	bool ReadString(SnapshotReader& reader, std::string& value)
+	{
+		uint32_t length = 0;
+		reader.Read(length);
+		SnapshotReader bytes = reader.ReadBlock(length);
+		if (reader.Failed()) {
+			return false;
+		}
+		value.resize(length);
+		bytes.ReadBytes(&value[0], length);
+		return true;
+	}
+}
+
+void FieldList::Write(SnapshotWriter& writer, const void* object) const
+{
+	for (const Segment& segment : m_segments) {
+		const FieldInfo& field = m_fields[segment.first];
+		switch (segment.plainData ? FieldType::Bool : field.type) {
+		case FieldType::String: WriteString(writer, field.Get<std::string>(object)); break;
+		case FieldType::Mesh: WriteString(writer, field.Get<MeshHandle>(object).GetName()); break;
+		case FieldType::Material: WriteString(writer, field.Get<MaterialHandle>(object).GetName()); break;
+		default: writer.WriteBytes(static_cast<const char*>(object) + segment.offset, segment.size); break;
+		}
+	}
+}
+
+bool FieldList::Read(SnapshotReader& reader, void* object) const
+{
+	World* world = World::GetInstance();
+	std::string name;
+	for (const Segment& segment : m_segments) {
+		const FieldInfo& field = m_fields[segment.first];
+		switch (segment.plainData ? FieldType::Bool : field.type) {
+		case FieldType::String:
+			if (!ReadString(reader, field.Get<std::string>(object))) {
+				return false;
+			}
+			break;
+		case FieldType::Mesh:
+			if (!ReadString(reader, name)) {
+				return false;
+			}
+			field.Get<MeshHandle>(object) = name.empty() ? MeshHandle() : world->GetMesh(name);
+			break;
+		case FieldType::Material:
+			if (!ReadString(reader, name)) {
+				return false;
+			}
+			field.Get<MaterialHandle>(object) = name.empty() ? MaterialHandle() : world->GetMaterial(name);
+			break;
+		default:
+			if (!reader.ReadBytes(static_cast<char*>(object) + segment.offset, segment.size)) {
+				return false;
+			}
+			break;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <initializer_list>
+#include <type_traits>
+#include <DirectXMath.h>
+#include "ResourceCache.h"
+class SnapshotWriter;
+class SnapshotReader;
+namespace FMOD
+{
+	class Sound;
+}
+
+// --------------------------------------------------------
+// The kinds of field a class can describe with REFLECT_FIELDS
+// --------------------------------------------------------
+enum class FieldType
+{
+	// Plain data, saved by copying its bytes
+	Bool,
+	Int,
+	Float,
+	Float3,
+	Float4,
+
+	// Saved by value or by resource name
+	String,
+	Mesh,
+	Material,
+	Sound
+};
+
+// --------------------------------------------------------
+// Maps a member's C++ type to its FieldType. Types without a
+// mapping don't compile. Enums are stored as Int.
+// --------------------------------------------------------
+template <class T, class Enable = void>
+struct FieldTraits;
+
+template <> struct FieldTraits<bool> { static const FieldType type = FieldType::Bool; };
+template <> struct FieldTraits<int> { static const FieldType type = FieldType::Int; };
+template <> struct FieldTraits<float> { static const FieldType type = FieldType::Float; };
+template <> struct FieldTraits<DirectX::XMFLOAT3> { static const FieldType type = FieldType::Float3; };
+template <> struct FieldTraits<DirectX::XMFLOAT4> { static const FieldType type = FieldType::Float4; };
+template <> struct FieldTraits<std::string> { static const FieldType type = FieldType::String; };
+template <> struct FieldTraits<MeshHandle> { static const FieldType type = FieldType::Mesh; };
+template <> struct FieldTraits<MaterialHandle> { static const FieldType type = FieldType::Material; };
+template <> struct FieldTraits<FMOD::Sound*> { static const FieldType type = FieldType::Sound; };
+
+template <class T>
+struct FieldTraits<T, typename std::enable_if<std::is_enum<T>::value>::type>
+{
+	static_assert(sizeof(T) == sizeof(int), "Reflected enums must be the size of an int");
+	static const FieldType type = FieldType::Int;
+};
+
+// --------------------------------------------------------
+// One reflected member: its name in files, its type, and where
+// it is in the object
+// --------------------------------------------------------
+struct FieldInfo
+{
+	const char* name;
+	FieldType type;
+	size_t offset;
+	size_t size;
+
+	// --------------------------------------------------------
+	// Whether the field can be copied and compared as raw bytes
+	// --------------------------------------------------------
+	bool IsPlainData() const { return type <= FieldType::Float4; }
+
+	template <class T>
+	T& Get(void* object) const { return *reinterpret_cast<T*>(static_cast<char*>(object) + offset); }
+
+	template <class T>
+	const T& Get(const void* object) const { return *reinterpret_cast<const T*>(static_cast<const char*>(object) + offset); }
+};
+
+template <class T>
+FieldInfo MakeField(const char* name, size_t offset)
+{
+	return { name, FieldTraits<T>::type, offset, sizeof(T) };
+}
+
+// --------------------------------------------------------
+// The reflected fields of a class, made once by REFLECT_FIELDS.
+// Plain data fields that follow each other both in the list and in
+// memory are merged into a single segment when the list is made, so
+// saving, copying and comparing an object is a few memcpys and
+// memcmps plus the fields that aren't plain data, with no virtual
+// calls.
+// --------------------------------------------------------
+class FieldList
+{
+public:
+	struct Segment
+	{
+		size_t offset;
+		size_t size;
+		size_t first;	// Index of the segment's first field
+		size_t count;	// Always 1 for fields that aren't plain data
+		bool plainData;
+	};
+private:
+	std::vector<FieldInfo> m_fields;
+	std::vector<Segment> m_segments;
+	bool m_plainData = true;
+public:
+	FieldList(std::initializer_list<FieldInfo> fields);
+
+	const std::vector<FieldInfo>& GetFields() const { return m_fields; }
+	const std::vector<Segment>& GetSegments() const { return m_segments; }
+
+	// --------------------------------------------------------
+	// Whether every field is plain data, so the whole list can be memcpy'd
+	// --------------------------------------------------------
+	bool IsPlainData() const { return m_plainData; }
+
+	// --------------------------------------------------------
+	// @returns const FieldInfo* the field with this name, or nullptr
+	// --------------------------------------------------------
+	const FieldInfo* Find(const std::string& name) const;
+
+	// --------------------------------------------------------
+	// Copies or compares the reflected fields of two objects of the class
+	// --------------------------------------------------------
+	void Copy(void* destination, const void* source) const;
+	bool Equal(const void* a, const void* b) const;
+
+	// --------------------------------------------------------
+	// Finds the fields that differ between two objects of the class
+	// @param std::vector<const FieldInfo*> & changed the differing fields are appended here, in list order
+	// @returns bool whether any field differs
+	// --------------------------------------------------------
+	bool Diff(const void* a, const void* b, std::vector<const FieldInfo*>& changed) const;
+
+	// --------------------------------------------------------
+	// Writes the fields to a snapshot, and reads them back. Meshes and
+	// materials are stored by name and sounds as pointers, so this is
+	// only for data that stays in memory. Scene files store every
+	// resource by name (see SceneArchive).
+	// --------------------------------------------------------
+	void Write(SnapshotWriter& writer, const void* object) const;
+	bool Read(SnapshotReader& reader, void* object) const;
+};
+
+// --------------------------------------------------------
+// Declares a class's reflected fields, in the order they're saved:
+//
+//     REFLECT_FIELDS(CameraComponent,
+//         REFLECT_FIELD("nearClip", m_nearClip),
+//         REFLECT_FIELD("farClip", m_farClip))
+//
+// This adds a public static GetFields() returning the FieldList,
+// and leaves the class public, so put it with the public members.
+// Private and nested members (m_data.range) can be listed.
+// --------------------------------------------------------
+#define REFLECT_FIELDS(Type, ...) \
+	public: \
+	static const FieldList& GetFields() \
+	{ \
+		typedef Type ReflectedType; \
+		static const FieldList fields({ __VA_ARGS__ }); \
+		return fields; \
+	}
+
+#define REFLECT_FIELD(name, member) MakeField<decltype(ReflectedType::member)>(name, offsetof(ReflectedType, member))
@@ -0,0 +1,321 @@
+#include "RenderQueue.h"
+#include "Entity.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace DirectX;
+
+uint64_t RenderQueue::MakeSortKey(RenderPass pass, uint16_t shaderId, uint16_t materialId, uint16_t meshId, float depth)
+{
+	if (depth < 0.0f) depth = 0.0f;
+	if (depth > 1.0f) depth = 1.0f;
+	uint64_t quantizedDepth = (uint64_t)(depth * 65535.0f);
+
+	// Blending needs back to front order, so depth decides before state does
+	if (pass == RenderPass::Transparent) {
+		return ((uint64_t)pass & 0x3) << 62 |
+			quantizedDepth << 46 |
+			((uint64_t)shaderId & 0x3FFF) << 32 |
+			(uint64_t)materialId << 16 |
+			(uint64_t)meshId;
+	}
+	return ((uint64_t)pass & 0x3) << 62 |
+		((uint64_t)shaderId & 0x3FFF) << 48 |
+		(uint64_t)materialId << 32 |
+		(uint64_t)meshId << 16 |
+		quantizedDepth;
+}
+
+void RenderQueue::Clear()
+{
+	m_packets.clear();
+	m_stats = RenderStats();
+}
+
+void RenderQueue::Submit(Entity* entity, uint64_t key)
+{
+	m_packets.push_back({ key, entity });
+}
+
+void RenderQueue::RadixSort()
+{
+	size_t count = m_packets.size();
+	if (count < 2) {
+		return;
+	}
+	m_scratch.resize(count);
+
+	// Build all eight histograms in a single pass over the keys
+	size_t histograms[8][256] = {};
+	for (const DrawPacket& packet : m_packets) {
+		for (int byte = 0; byte < 8; ++byte) {
+			histograms[byte][(packet.key >> (byte * 8)) & 0xFF]++;
+		}
+	}
+
+	DrawPacket* src = m_packets.data();
+	DrawPacket* dst = m_scratch.data();
+	for (int byte = 0; byte < 8; ++byte) {
+		size_t* histogram = histograms[byte];
+
+		// All keys share this byte, so this pass wouldn't move anything
+		if (histogram[(src[0].key >> (byte * 8)) & 0xFF] == count) {
+			continue;
+		}
+
+		// Exclusive prefix sum gives the first output slot of each bucket
+		size_t offset = 0;
+		for (int bucket = 0; bucket < 256; ++bucket) {
+			size_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			dst[histogram[(src[i].key >> (byte * 8)) & 0xFF]++] = src[i];
+		}
+		std::swap(src, dst);
+	}
+
+	// An odd number of passes leaves the result in the scratch buffer
+	if (src != m_packets.data()) {
+		m_packets.swap(m_scratch);
+	}
+}
+
+void RenderQueue::BuildGroups()
+{
+	m_groups.clear();
+	m_instanceData.clear();
+
+	size_t first = 0;
+	while (first < m_packets.size()) {
+		Entity* entity = m_packets[first].entity;
+		Material* material = entity->GetMaterial();
+		Mesh* mesh = entity->GetMesh();
+
+		// Sorting put everything sharing a material and mesh next to each other
+		size_t end = first + 1;
+		while (end < m_packets.size() &&
+			m_packets[end].entity->GetMaterial() == material &&
+			m_packets[end].entity->GetMesh() == mesh) {
+			++end;
+		}
+
+		DrawGroup group = { first, end - first, -1 };
+
+		// Transparent groups stay per-entity so they keep their back to front order
+		bool opaque = (m_packets[first].key >> 62) == (uint64_t)RenderPass::Opaque;
+		if (opaque && group.count >= MIN_INSTANCES && material->GetInstancedVertexShader()) {
+			group.instanceOffset = (int)m_instanceData.size();
+			for (size_t i = first; i < end; ++i) {
+				// Stored world matrices are transposed for constant buffers.
+				// Instance data is read row by row, so undo the transpose.
+				XMFLOAT4X4 world = m_packets[i].entity->GetTransform()->GetWorldMatrix();
+				XMFLOAT4X4 instanceWorld;
+				XMStoreFloat4x4(&instanceWorld, XMMatrixTranspose(XMLoadFloat4x4(&world)));
+				m_instanceData.push_back(instanceWorld);
+			}
+		}
+
+		m_groups.push_back(group);
+		first = end;
+	}
+}
+
+bool RenderQueue::UploadInstanceData(ID3D11DeviceContext* context)
+{
+	if (m_instanceData.empty()) {
+		return true;
+	}
+
+	// Grow by doubling so the buffer is rarely recreated
+	if (m_instanceData.size() > m_instanceCapacity) {
+		if (m_instanceBuffer) {
+			m_instanceBuffer->Release();
+			m_instanceBuffer = nullptr;
+		}
+		m_instanceCapacity = m_instanceCapacity ? m_instanceCapacity : 64;
+		while (m_instanceCapacity < m_instanceData.size()) {
+			m_instanceCapacity *= 2;
+		}
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.ByteWidth = (UINT)(sizeof(XMFLOAT4X4) * m_instanceCapacity);
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		ID3D11Device* device;
+		context->GetDevice(&device);
+		HRESULT result = device->CreateBuffer(&desc, 0, &m_instanceBuffer);
+		device->Release();
+		if (FAILED(result)) {
+			// Tried again next frame
+			m_instanceBuffer = nullptr;
+			m_instanceCapacity = 0;
+			return false;
+		}
+	}
+
+	// One upload per frame for every instanced group
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(m_instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+		return false;
+	}
+	memcpy(mapped.pData, m_instanceData.data(), sizeof(XMFLOAT4X4) * m_instanceData.size());
+	context->Unmap(m_instanceBuffer, 0);
+	return true;
+}
+
+void RenderQueue::Execute(ID3D11DeviceContext* context, DirectX::XMFLOAT4X4 view, DirectX::XMFLOAT4X4 projection,
+	DirectX::XMFLOAT3 cameraPos, LightComponent::Light lights[], int numLights)
+{
+	RadixSort();
+	BuildGroups();
+
+	// Without the instance data, every group is drawn one entity at a time this frame
+	if (!UploadInstanceData(context)) {
+		for (DrawGroup& group : m_groups) {
+			group.instanceOffset = -1;
+		}
+	}
+	m_stats.packets = (int)m_packets.size();
+
+	// State that's currently bound. Reset every frame since other
+	// rendering (sky, particles, UI) changes it between frames.
+	SimpleVertexShader* boundVS = nullptr;
+	SimplePixelShader* boundPS = nullptr;
+	Material* boundMaterial = nullptr;
+	Mesh* boundMesh = nullptr;
+	ID3D11BlendState* boundBlendState = nullptr;
+	bool instanceBufferBound = false;
+
+	UINT stride = sizeof(Vertex);
+	UINT instanceStride = sizeof(XMFLOAT4X4);
+	UINT offset = 0;
+	float blendFactor[4] = { 1,1,1,1 };
+
+	for (const DrawGroup& group : m_groups) {
+		Entity* entity = m_packets[group.first].entity;
+		Material* material = entity->GetMaterial();
+		Mesh* mesh = entity->GetMesh();
+		bool instanced = group.instanceOffset >= 0;
+		SimpleVertexShader* vs = instanced ? material->GetInstancedVertexShader() : material->GetVertexShader();
+		SimplePixelShader* ps = material->GetPixelShader();
+		bool psDataDirty = false;
+
+		if (vs != boundVS) {
+			vs->SetMatrix4x4("view", view);
+			vs->SetMatrix4x4("projection", projection);
+			vs->SetShader();
+			boundVS = vs;
+			m_stats.shaderBinds++;
+
+			// The instanced shader has no per-draw constants, so upload once per bind
+			if (instanced) {
+				vs->CopyAllBufferData();
+				m_stats.constantBufferUpdates++;
+			}
+		}
+		else {
+			m_stats.redundantBindsSkipped++;
+		}
+
+		if (ps != boundPS) {
+			// Per-frame data only needs to be set once per pixel shader
+			ps->SetFloat3("cameraPos", cameraPos);
+			ps->SetData("lights", lights, sizeof(LightComponent::Light) * MAX_LIGHTS);
+			ps->SetInt("lightCount", numLights);
+			ps->SetShader();
+			boundPS = ps;
+			psDataDirty = true;
+			m_stats.shaderBinds++;
+		}
+		else {
+			m_stats.redundantBindsSkipped++;
+		}
+
+		if (material != boundMaterial) {
+			ps->SetSamplerState("samplerState", material->GetSamplerState());
+			ps->SetShaderResourceView("diffuseTexture", material->GetDiffuse());
+			ps->SetShaderResourceView("normalTexture", material->GetNormals());
+			ps->SetShaderResourceView("reflectionTexture", material->GetReflectionSRV());
+			ps->SetFloat("shininess", material->m_shiniess);
+			ps->SetFloat("metalness", material->m_metalness);
+			ps->SetFloat("roughness", material->m_roughness);
+			ps->SetFloat3("specColor", material->m_specColor);
+			if (material->GetBlendState() != boundBlendState) {
+				boundBlendState = material->GetBlendState();
+				context->OMSetBlendState(boundBlendState, blendFactor, 0xFFFFFFFF);
+			}
+			boundMaterial = material;
+			psDataDirty = true;
+			m_stats.materialBinds++;
+		}
+		else {
+			m_stats.redundantBindsSkipped++;
+		}
+
+		// The pixel shader's constant buffer holds both lights and material
+		// data, so it only needs uploading when either of those changed
+		if (psDataDirty) {
+			ps->CopyAllBufferData();
+			m_stats.constantBufferUpdates++;
+		}
+
+		if (mesh != boundMesh) {
+			ID3D11Buffer* vb = mesh->GetVertexBuffer();
+			context->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+			context->IASetIndexBuffer(mesh->GetIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
+			boundMesh = mesh;
+			m_stats.bufferBinds++;
+		}
+		else {
+			m_stats.redundantBindsSkipped++;
+		}
+
+		// Every entity after the first in a group reuses all of the state above
+		m_stats.redundantBindsSkipped += 4 * (int)(group.count - 1);
+
+		if (instanced) {
+			// Every instanced group reads from the same buffer at a different offset
+			if (!instanceBufferBound) {
+				context->IASetVertexBuffers(1, 1, &m_instanceBuffer, &instanceStride, &offset);
+				instanceBufferBound = true;
+				m_stats.bufferBinds++;
+			}
+
+			context->DrawIndexedInstanced(mesh->GetIndexCount(), (UINT)group.count, 0, 0, (UINT)group.instanceOffset);
+			m_stats.drawCalls++;
+			m_stats.instancedDrawCalls++;
+			m_stats.instances += (int)group.count;
+		}
+		else {
+			for (size_t i = group.first; i < group.first + group.count; ++i) {
+				// The world matrix is the only truly per-draw data
+				vs->SetMatrix4x4("world", m_packets[i].entity->GetTransform()->GetWorldMatrix());
+				vs->CopyAllBufferData();
+				m_stats.constantBufferUpdates++;
+
+				context->DrawIndexed(mesh->GetIndexCount(), 0, 0);
+				m_stats.drawCalls++;
+			}
+		}
+	}
+
+	if (boundBlendState) {
+		context->OMSetBlendState(0, blendFactor, 0xFFFFFFFF);
+	}
+	// Unbind the instance buffer so later non-instanced layouts don't see it
+	if (instanceBufferBound) {
+		ID3D11Buffer* nullBuffer = nullptr;
+		UINT zero = 0;
+		context->IASetVertexBuffers(1, 1, &nullBuffer, &zero, &zero);
+	}
+}
+
+RenderQueue::~RenderQueue()
+{
+	if (m_instanceBuffer) m_instanceBuffer->Release();
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+#include "LightComponent.h"
+class Entity;
+
+// --------------------------------------------------------
+// Render passes, in the order they are submitted.
+// The pass occupies the highest bits of a sort key.
+// --------------------------------------------------------
+enum class RenderPass : uint8_t
+{
+	Opaque = 0,
+	Transparent = 1
+};
+
+// --------------------------------------------------------
+// A single draw request. The key encodes everything the
+// queue needs to order draws so that state changes are minimal.
+// --------------------------------------------------------
+struct DrawPacket
+{
+	uint64_t key;
+	Entity* entity;
+};
+
+// --------------------------------------------------------
+// Per-frame counters describing how much pipeline state
+// the render queue had to change.
+// --------------------------------------------------------
+struct RenderStats
+{
+	int packets = 0;
+	int drawCalls = 0;
+	int shaderBinds = 0;		// Vertex or pixel shader changes
+	int materialBinds = 0;		// Texture, sampler and material constant changes
+	int bufferBinds = 0;		// Vertex/index buffer changes
+	int constantBufferUpdates = 0;
+	int redundantBindsSkipped = 0;	// Binds that unsorted, per-entity drawing would have issued
+	int instancedDrawCalls = 0;
+	int instances = 0;				// Entities drawn through instanced draw calls
+
+	int GetStateChanges() const { return shaderBinds + materialBinds + bufferBinds; }
+};
+
+// --------------------------------------------------------
+// Collects draw packets for 3D entities, sorts them by a 64-bit
+// key (pass, then state and depth) and submits them,
+// skipping binds for state that is already set.
+// --------------------------------------------------------
+class RenderQueue
+{
+private:
+	// --------------------------------------------------------
+	// A run of sorted packets sharing a material and mesh.
+	// instanceOffset is the group's first element in the instance
+	// buffer, or -1 if the group is drawn one entity at a time.
+	// --------------------------------------------------------
+	struct DrawGroup
+	{
+		size_t first;
+		size_t count;
+		int instanceOffset;
+	};
+
+	// Groups smaller than this aren't worth an instanced draw
+	static const size_t MIN_INSTANCES = 2;
+
+	std::vector<DrawPacket> m_packets;
+	std::vector<DrawPacket> m_scratch;
+	std::vector<DrawGroup> m_groups;
+	std::vector<DirectX::XMFLOAT4X4> m_instanceData;
+	ID3D11Buffer* m_instanceBuffer = nullptr;
+	size_t m_instanceCapacity = 0;
+	RenderStats m_stats;
+
+	// --------------------------------------------------------
+	// LSD radix sort on the packet keys, 8 bits per pass.
+	// Passes where every key shares the same byte are skipped.
+	// --------------------------------------------------------
+	void RadixSort();
+
+	// --------------------------------------------------------
+	// Splits the sorted packets into runs sharing a material and mesh,
+	// and gathers the world matrices of runs that will be instanced
+	// --------------------------------------------------------
+	void BuildGroups();
+
+	// --------------------------------------------------------
+	// Copies this frame's instance data into the dynamic instance
+	// buffer, growing it first if needed
+	// @returns bool false if the buffer couldn't be made or written
+	// --------------------------------------------------------
+	bool UploadInstanceData(ID3D11DeviceContext* context);
+public:
+	// --------------------------------------------------------
+	// Builds a sort key. Layout from most to least significant:
+	// pass (2 bits) | shader (14) | material (16) | mesh (16) | depth (16)
+	// Transparent keys put depth first so blending stays back to front:
+	// pass (2 bits) | depth (16) | shader (14) | material (16) | mesh (16)
+	// @param float depth normalized [0, 1] distance from the camera
+	// --------------------------------------------------------
+	static uint64_t MakeSortKey(RenderPass pass, uint16_t shaderId, uint16_t materialId, uint16_t meshId, float depth);
+
+	// --------------------------------------------------------
+	// Empties the queue. Call at the start of each frame.
+	// --------------------------------------------------------
+	void Clear();
+
+	// --------------------------------------------------------
+	// Adds an entity with a mesh and material to the queue
+	// --------------------------------------------------------
+	void Submit(Entity* entity, uint64_t key);
+
+	// --------------------------------------------------------
+	// Sorts the queued packets and draws them
+	// --------------------------------------------------------
+	void Execute(ID3D11DeviceContext* context, DirectX::XMFLOAT4X4 view, DirectX::XMFLOAT4X4 projection,
+		DirectX::XMFLOAT3 cameraPos, LightComponent::Light lights[], int numLights);
+
+	const RenderStats& GetStats() { return m_stats; }
+
+	~RenderQueue();
+};
@@ -0,0 +1,397 @@
+#pragma once
+#include <d3d11.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+class Mesh;
+class Material;
+
+// --------------------------------------------------------
+// How a cache frees each type of resource
+// --------------------------------------------------------
+template <class T>
+struct ResourceTraits
+{
+	static void Free(T* resource) { delete resource; }
+};
+
+template <>
+struct ResourceTraits<ID3D11ShaderResourceView>
+{
+	static void Free(ID3D11ShaderResourceView* resource) { resource->Release(); }
+};
+
+template <class T>
+class ResourceCache;
+
+// --------------------------------------------------------
+// A counted reference to a resource in one of the World's caches.
+// A resource can't be evicted or freed while it has handles.
+// Handles convert to the resource's pointer, so they're used like one.
+// Copying handles is thread safe.
+// --------------------------------------------------------
+template <class T>
+class ResourceHandle
+{
+	friend class ResourceCache<T>;
+public:
+	struct Entry
+	{
+		T* resource = nullptr;			// nullptr while evicted
+		std::string name;
+		size_t size = 0;
+		std::atomic<int> refs;
+		std::atomic<uint64_t> lastUsed;	// Set when it's asked for, and when its last handle goes away
+		std::atomic<uint64_t>* clock = nullptr;
+		bool named = true;				// false once another resource replaced it
+
+		// Makes the resource again after it's evicted. Resources without one are never evicted.
+		std::function<T*(size_t& size)> load;
+		bool loadFailed = false;		// Not tried again until the resource is swapped
+
+		// Versions swapped out while something could still point into them
+		std::vector<T*> retired;
+		size_t retiredSize = 0;
+
+		Entry() : refs(0), lastUsed(0) { }
+	};
+private:
+	Entry* m_entry = nullptr;
+
+	explicit ResourceHandle(Entry* entry) : m_entry(entry)
+	{
+		if (m_entry) {
+			m_entry->refs++;
+		}
+	}
+
+	void Reset(Entry* entry)
+	{
+		if (entry) {
+			entry->refs++;
+		}
+		// Dropping the last handle counts as a use, so eviction goes by when it was last held
+		if (m_entry && --m_entry->refs == 0) {
+			m_entry->lastUsed = ++(*m_entry->clock);
+		}
+		m_entry = entry;
+	}
+public:
+	ResourceHandle() { }
+	ResourceHandle(std::nullptr_t) { }
+	ResourceHandle(const ResourceHandle& other) : ResourceHandle(other.m_entry) { }
+	ResourceHandle(ResourceHandle&& other) : m_entry(other.m_entry) { other.m_entry = nullptr; }
+
+	ResourceHandle& operator=(const ResourceHandle& other) { Reset(other.m_entry); return *this; }
+	ResourceHandle& operator=(ResourceHandle&& other)
+	{
+		if (this != &other) {
+			Reset(nullptr);
+			m_entry = other.m_entry;
+			other.m_entry = nullptr;
+		}
+		return *this;
+	}
+	ResourceHandle& operator=(std::nullptr_t) { Reset(nullptr); return *this; }
+
+	~ResourceHandle() { Reset(nullptr); }
+
+	T* Get() const { return m_entry ? m_entry->resource : nullptr; }
+	T* operator->() const { return Get(); }
+	operator T*() const { return Get(); }
+
+	// --------------------------------------------------------
+	// Returns the name the resource was created with
+	// --------------------------------------------------------
+	const std::string& GetName() const
+	{
+		static const std::string noName;
+		return m_entry ? m_entry->name : noName;
+	}
+};
+
+typedef ResourceHandle<Mesh> MeshHandle;
+typedef ResourceHandle<Material> MaterialHandle;
+typedef ResourceHandle<ID3D11ShaderResourceView> TextureHandle;
+
+// --------------------------------------------------------
+// A line of the World's resource report
+// --------------------------------------------------------
+struct ResourceReportEntry
+{
+	const char* type;
+	std::string name;
+	size_t size;		// Estimated bytes, counting retired versions, or 0 while evicted
+	int handles;
+	bool resident;
+	bool replaced;		// Replaced by a newer resource, and freed once its handles are gone
+};
+
+// --------------------------------------------------------
+// Named resources of one type, counted by their handles.
+// Creating a resource with a name that's taken replaces the old
+// one: it's freed straight away if nothing uses it, or once its
+// last handle goes away. Resources that can be loaded again can
+// be evicted while they have no handles, least recently used first,
+// and are loaded again the next time they're asked for.
+// Resources are added, evicted and freed on the main thread.
+// --------------------------------------------------------
+template <class T>
+class ResourceCache
+{
+public:
+	typedef ResourceHandle<T> Handle;
+	typedef typename Handle::Entry Entry;
+private:
+	const char* m_typeName;
+	std::atomic<uint64_t>* m_clock;		// Shared by the World's caches, so their use can be compared
+	std::map<std::string, Entry*> m_named;
+	std::unordered_map<const T*, Entry*> m_byResource;
+	std::vector<Entry*> m_replaced;
+	std::vector<Entry*> m_retiring;	// Named entries with retired versions
+	size_t m_size = 0;
+
+	void Touch(Entry* entry) { entry->lastUsed = ++(*m_clock); }
+
+	void FreeRetired(Entry* entry)
+	{
+		for (T* resource : entry->retired) {
+			ResourceTraits<T>::Free(resource);
+		}
+		entry->retired.clear();
+		m_size -= entry->retiredSize;
+		entry->retiredSize = 0;
+	}
+
+	void Unload(Entry* entry)
+	{
+		FreeRetired(entry);
+		if (!entry->resource) {
+			return;
+		}
+		m_byResource.erase(entry->resource);
+		ResourceTraits<T>::Free(entry->resource);
+		entry->resource = nullptr;
+		m_size -= entry->size;
+		entry->size = 0;
+	}
+public:
+	ResourceCache(const char* typeName, std::atomic<uint64_t>* clock) : m_typeName(typeName), m_clock(clock) { }
+	ResourceCache(const ResourceCache&) = delete;
+	ResourceCache& operator=(const ResourceCache&) = delete;
+
+	// --------------------------------------------------------
+	// Adds a resource under a name, replacing any resource that had it
+	// @param size_t size estimated bytes the resource uses
+	// @param load makes the resource again after it's evicted, or nullptr to never evict it
+	// --------------------------------------------------------
+	Handle Add(const std::string& name, T* resource, size_t size, std::function<T*(size_t& size)> load = nullptr)
+	{
+		Remove(name);
+		Entry* entry = new Entry();
+		entry->resource = resource;
+		entry->name = name;
+		entry->size = size;
+		entry->load = load;
+		entry->clock = m_clock;
+		m_named[name] = entry;
+		if (resource) {
+			m_byResource[resource] = entry;
+		}
+		m_size += size;
+		Touch(entry);
+		return Handle(entry);
+	}
+
+	// --------------------------------------------------------
+	// Returns the resource with a name, loading it again if it was
+	// evicted, or a null handle if there isn't one. If loading it again
+	// fails, the handle is empty and it isn't tried again.
+	// --------------------------------------------------------
+	Handle Get(const std::string& name)
+	{
+		auto it = m_named.find(name);
+		if (it == m_named.end()) {
+			return Handle();
+		}
+		Entry* entry = it->second;
+		if (!entry->resource && entry->load && !entry->loadFailed) {
+			size_t size = 0;
+			entry->resource = entry->load(size);
+			if (entry->resource) {
+				entry->size = size;
+				m_size += size;
+				m_byResource[entry->resource] = entry;
+			}
+			else {
+				entry->loadFailed = true;
+			}
+		}
+		Touch(entry);
+		return Handle(entry);
+	}
+
+	// --------------------------------------------------------
+	// Replaces the resource behind a name in place, so its handles
+	// see the new one from then on. Used for hot reloading.
+	// @param bool keepOld keep the old resource until the name has no
+	// handles, for when something may still point into it
+	// @returns bool false if there's no such name, and the resource wasn't taken
+	// --------------------------------------------------------
+	bool Swap(const std::string& name, T* resource, size_t size, bool keepOld)
+	{
+		auto it = m_named.find(name);
+		if (it == m_named.end()) {
+			return false;
+		}
+		Entry* entry = it->second;
+		if (entry->resource) {
+			m_byResource.erase(entry->resource);
+			if (keepOld) {
+				if (entry->retired.empty()) {
+					m_retiring.push_back(entry);
+				}
+				entry->retired.push_back(entry->resource);
+				entry->retiredSize += entry->size;
+			}
+			else {
+				ResourceTraits<T>::Free(entry->resource);
+				m_size -= entry->size;
+			}
+		}
+		entry->resource = resource;
+		entry->size = size;
+		entry->loadFailed = false;
+		m_size += size;
+		m_byResource[resource] = entry;
+		return true;
+	}
+
+	// --------------------------------------------------------
+	// Returns the loaded resource with a name, without loading it or
+	// counting it as used, or nullptr
+	// --------------------------------------------------------
+	T* Peek(const std::string& name)
+	{
+		auto it = m_named.find(name);
+		return it != m_named.end() ? it->second->resource : nullptr;
+	}
+
+	// --------------------------------------------------------
+	// Returns a handle to a resource that's in the cache, or a null handle
+	// --------------------------------------------------------
+	Handle Find(const T* resource)
+	{
+		auto it = resource ? m_byResource.find(resource) : m_byResource.end();
+		return it != m_byResource.end() ? Handle(it->second) : Handle();
+	}
+
+	// --------------------------------------------------------
+	// Takes a name out of the cache. Its resource is freed now if
+	// nothing uses it, or once its last handle goes away.
+	// --------------------------------------------------------
+	void Remove(const std::string& name)
+	{
+		auto it = m_named.find(name);
+		if (it == m_named.end()) {
+			return;
+		}
+		Entry* entry = it->second;
+		m_named.erase(it);
+		entry->named = false;
+		if (!entry->retired.empty()) {
+			m_retiring.erase(std::find(m_retiring.begin(), m_retiring.end(), entry));
+		}
+		if (entry->refs == 0) {
+			Unload(entry);
+			delete entry;
+		}
+		else {
+			m_replaced.push_back(entry);
+		}
+	}
+
+	// --------------------------------------------------------
+	// Frees replaced and retired resources whose handles are all gone
+	// --------------------------------------------------------
+	void FreeReplaced()
+	{
+		for (size_t i = m_retiring.size(); i-- > 0; ) {
+			Entry* entry = m_retiring[i];
+			if (entry->refs == 0) {
+				FreeRetired(entry);
+				m_retiring[i] = m_retiring.back();
+				m_retiring.pop_back();
+			}
+		}
+		for (size_t i = m_replaced.size(); i-- > 0; ) {
+			Entry* entry = m_replaced[i];
+			if (entry->refs == 0) {
+				Unload(entry);
+				delete entry;
+				m_replaced[i] = m_replaced.back();
+				m_replaced.pop_back();
+			}
+		}
+	}
+
+	// --------------------------------------------------------
+	// Returns the least recently used resource that could be evicted, or nullptr
+	// --------------------------------------------------------
+	Entry* FindEvictable()
+	{
+		Entry* oldest = nullptr;
+		for (auto& pair : m_named) {
+			Entry* entry = pair.second;
+			if (entry->resource && entry->load && entry->refs == 0 && (!oldest || entry->lastUsed < oldest->lastUsed)) {
+				oldest = entry;
+			}
+		}
+		return oldest;
+	}
+
+	void Evict(Entry* entry) { Unload(entry); }
+
+	// --------------------------------------------------------
+	// Returns the estimated bytes used by the cache's loaded resources
+	// --------------------------------------------------------
+	size_t GetSize() { return m_size; }
+
+	void Report(std::vector<ResourceReportEntry>& report)
+	{
+		for (auto& pair : m_named) {
+			Entry* entry = pair.second;
+			report.push_back({ m_typeName, entry->name, entry->size + entry->retiredSize, entry->refs, entry->resource != nullptr, false });
+		}
+		for (Entry* entry : m_replaced) {
+			report.push_back({ m_typeName, entry->name, entry->size + entry->retiredSize, entry->refs, entry->resource != nullptr, true });
+		}
+	}
+
+	// --------------------------------------------------------
+	// Frees everything, whether or not it has handles
+	// --------------------------------------------------------
+	void Clear()
+	{
+		for (auto& pair : m_named) {
+			Unload(pair.second);
+			delete pair.second;
+		}
+		for (Entry* entry : m_replaced) {
+			Unload(entry);
+			delete entry;
+		}
+		m_named.clear();
+		m_replaced.clear();
+		m_retiring.clear();
+		m_byResource.clear();
+	}
+
+	~ResourceCache() { Clear(); }
+};
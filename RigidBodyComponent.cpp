@@ -1,17 +1,72 @@
 #include "RigidBodyComponent.h"
 #include "Transform.h"
 #include "Entity.h"
+#include "WorldSnapshot.h"
+#include "SceneArchive.h"
+#include <cassert>
 
 using namespace DirectX;
 
 void RigidBodyComponent::SetBoxCollider(float halfX, float halfY, float halfZ)
 {
-	m_shape = new btBoxShape(btVector3((btScalar)halfX, (btScalar)halfY, (btScalar)halfZ));
+	SetCollider(ShapeDesc::Box(halfX, halfY, halfZ));
 }
 
 void RigidBodyComponent::SetSphereCollider(float radius)
 {
-	m_shape = new btSphereShape((btScalar)radius);
+	SetCollider(ShapeDesc::Sphere(radius));
+}
+
+void RigidBodyComponent::SetCollider(const ShapeDesc& desc)
+{
+	CollisionShapeCache* cache = World::GetInstance()->GetShapeCache();
+	btCollisionShape* shape = cache->Acquire(desc);
+	if (m_shape) {
+		cache->Release(m_shape);
+	}
+	m_shape = shape;
+	m_colliderMesh = nullptr;
+	m_colliderDesc = desc;
+	m_hasColliderDesc = true;
+}
+
+void RigidBodyComponent::SetMeshCollider(MeshHandle mesh, DirectX::XMFLOAT3 scale)
+{
+	m_colliderMesh = mesh;
+	m_colliderScale = scale;
+	m_hasColliderDesc = false;
+}
+
+void RigidBodyComponent::SetCompoundCollider(const std::string& name, const std::vector<CompoundChild>& children)
+{
+	CollisionShapeCache* cache = World::GetInstance()->GetShapeCache();
+	btCollisionShape* shape = cache->AcquireCompound(name, children);
+	if (m_shape) {
+		cache->Release(m_shape);
+	}
+	m_shape = shape;
+	m_colliderMesh = nullptr;
+	m_hasColliderDesc = false;
+}
+
+void RigidBodyComponent::SetCollisionLayer(const std::string& name)
+{
+	int layer = World::GetInstance()->GetCollisionLayers()->CreateLayer(name);
+	if (layer >= 0) {
+		SetCollisionLayer(layer);
+	}
+}
+
+void RigidBodyComponent::SetCollisionLayer(int layer)
+{
+	if (!World::GetInstance()->GetCollisionLayers()->IsLayer(layer)) {
+		assert(!"RigidBodyComponent: no such collision layer");
+		return;
+	}
+	m_layer = layer;
+	if (m_body) {
+		World::GetInstance()->GetCollisionLayers()->SetObjectLayer(m_body, layer);
+	}
 }
 
 void RigidBodyComponent::ApplyImpulse(DirectX::XMFLOAT3 impulse)
@@ -19,79 +74,197 @@ void RigidBodyComponent::ApplyImpulse(DirectX::XMFLOAT3 impulse)
 	// Convert to a btVector3
 	btVector3 btForce(impulse.x, impulse.y, impulse.z);
 	m_body->applyCentralImpulse(btForce);
+	Wake();
+}
+
+void RigidBodyComponent::Wake()
+{
+	m_body->activate(true);
+	GetOwner()->Wake();
+}
+
+void RigidBodyComponent::Sleep()
+{
+	// Static bodies are never active
+	if (!m_body->isStaticObject()) {
+		m_body->setActivationState(ISLAND_SLEEPING);
+	}
+	GetOwner()->Sleep();
 }
 
 void RigidBodyComponent::Start()
 {
+	// Concave shapes can't be simulated, so moving bodies use the hull
+	if (m_colliderMesh) {
+		bool isStatic = m_mass == 0.0f || m_kinematic;
+		MeshHandle mesh = m_colliderMesh;
+		SetCollider(isStatic ? ShapeDesc::TriangleMesh(mesh, m_colliderScale) : ShapeDesc::ConvexHull(mesh, m_colliderScale));
+	}
+
 	// Shape should have been set by this point
 	if (!m_shape) {
-		throw "Use SetBoxCollider or SetSphereCollider to set a shape collider";
+		throw "Use SetBoxCollider, SetSphereCollider, SetMeshCollider or SetCollider to set a shape collider";
+	}
+	if (m_shape->getShapeType() == TRIANGLE_MESH_SHAPE_PROXYTYPE || m_shape->getShapeType() == SCALED_TRIANGLE_MESH_SHAPE_PROXYTYPE) {
+		if (m_mass != 0.0f && !m_kinematic) {
+			throw "Triangle mesh colliders can only be used by static bodies";
+		}
 	}
 
 	Transform* transform = GetOwner()->GetTransform();
-	XMFLOAT3 pos = transform->GetPosition();
-	XMFLOAT4 rot = transform->GetRotation();
-
-	btTransform btTransform;
-	// Copy the DirectX world matrix into the bullet transform, excluding scale, as bt does not support it
-	btTransform.setOrigin(btVector3(pos.x, pos.y, pos.z));
-	btTransform.setRotation(btQuaternion(rot.x, rot.y, rot.z, rot.w));
 
-	bool isDynamic = m_mass != 0.0f;
+	// Kinematic bodies are simulated as if they had infinite mass
+	float mass = m_kinematic ? 0.0f : m_mass;
 	btVector3 localInertia(0, 0, 0);
-	if (isDynamic) {
-		m_shape->calculateLocalInertia(m_mass, localInertia);
+	if (mass != 0.0f) {
+		m_shape->calculateLocalInertia(mass, localInertia);
 	}
 
-	// Setup the motion state
-	m_motionState = new btDefaultMotionState(btTransform);
-	btRigidBody::btRigidBodyConstructionInfo rbInfo(m_mass, m_motionState, m_shape, localInertia);
+	// The body takes its starting position from the motion state
+	m_motionState = new TransformMotionState(transform);
+	btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, m_motionState, m_shape, localInertia);
 	m_body = new btRigidBody(rbInfo);
+	if (m_kinematic) {
+		m_body->setCollisionFlags(m_body->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
+	}
+	m_syncedVersion = transform->GetLocalVersion();
 
 	// Embed a link back to this component
 	m_body->setUserPointer((void*)GetOwner());
 
-	World::GetInstance()->GetPhysicsWorld()->addRigidBody(m_body);
+	CollisionLayers* layers = World::GetInstance()->GetCollisionLayers();
+	World::GetInstance()->GetPhysicsWorld()->addRigidBody(m_body, layers->GetGroup(m_layer), layers->GetMask(m_layer));
 }
 
 void RigidBodyComponent::Tick(float deltaTime)
 {
-	if (m_mass > 0) {
-		// Retrieve the motion state's transform
-		btTransform btTransform;
-		m_motionState->getWorldTransform(btTransform);
-		btVector3 origin = btTransform.getOrigin();
-		btQuaternion rotation = btTransform.getRotation();
+	// Dynamic bodies write to the Transform through the motion state when they move
+	if (!m_body->isStaticOrKinematicObject()) {
+		if (!m_body->isActive()) {
+			SleepOwner();
+		}
+		return;
+	}
+
+	// Static and kinematic bodies follow the Transform, but only when it changed
+	Transform* transform = GetOwner()->GetTransform();
+	if (transform->GetLocalVersion() == m_syncedVersion) {
+		if (m_body->isStaticObject() || !m_body->isActive()) {
+			SleepOwner();
+		}
+		return;
+	}
+	m_syncedVersion = transform->GetLocalVersion();
 
-		// Copy over the btTransform to the Transform component
-		Transform* transform = GetOwner()->GetTransform();
-		transform->SetPosition(XMFLOAT3(origin.x(), origin.y(), origin.z()));
-		transform->SetRotation(XMFLOAT4(rotation.x(), rotation.y(), rotation.z(), rotation.w()));
+	if (m_kinematic) {
+		// Bullet reads the motion state each step while the body is awake
+		m_body->activate(true);
 	}
 	else {
-		// If this is a static body, copy over the position from Transform into the bullet body
-		Transform* transform = GetOwner()->GetTransform();
-		XMFLOAT3 pos = transform->GetPosition();
-		XMFLOAT4 rot = transform->GetRotation();
+		btTransform newTransform;
+		m_motionState->getWorldTransform(newTransform);
+		m_body->setWorldTransform(newTransform);
+		m_body->setInterpolationWorldTransform(newTransform);
 
-		btVector3 origin = btVector3(pos.x, pos.y, pos.z);
-		btQuaternion orientation = btQuaternion(rot.x, rot.y, rot.z, rot.w);
+		// Only awake bodies get their bounds refreshed each step
+		World::GetInstance()->GetPhysicsWorld()->updateSingleAabb(m_body);
+	}
+}
 
-		btTransform newTransform;
-		newTransform.setOrigin(origin);
-		newTransform.setRotation(orientation);
+void RigidBodyComponent::SaveState(SnapshotWriter& writer)
+{
+	if (!m_body) {
+		return;
+	}
+	writer.WriteTransform(m_body->getWorldTransform());
+	writer.WriteTransform(m_body->getInterpolationWorldTransform());
+	writer.WriteVector(m_body->getLinearVelocity());
+	writer.WriteVector(m_body->getAngularVelocity());
+	writer.WriteVector(m_body->getInterpolationLinearVelocity());
+	writer.WriteVector(m_body->getInterpolationAngularVelocity());
+	writer.WriteVector(m_body->getTotalForce());
+	writer.WriteVector(m_body->getTotalTorque());
+	writer.Write(m_body->getActivationState());
+	writer.Write(m_body->getDeactivationTime());
+	writer.Write(m_body->getHitFraction());
+}
 
-		m_body->setWorldTransform(newTransform);
+void RigidBodyComponent::LoadState(SnapshotReader& reader)
+{
+	if (!m_body) {
+		return;
+	}
+	btTransform worldTransform, interpolationTransform;
+	btVector3 linearVelocity, angularVelocity, interpolationLinear, interpolationAngular, force, torque;
+	int activationState;
+	btScalar deactivationTime, hitFraction;
+	if (!reader.ReadTransform(worldTransform) || !reader.ReadTransform(interpolationTransform) ||
+		!reader.ReadVector(linearVelocity) || !reader.ReadVector(angularVelocity) ||
+		!reader.ReadVector(interpolationLinear) || !reader.ReadVector(interpolationAngular) ||
+		!reader.ReadVector(force) || !reader.ReadVector(torque) ||
+		!reader.Read(activationState) || !reader.Read(deactivationTime) || !reader.Read(hitFraction)) {
+		return;
+	}
+
+	// Also refreshes the world space inertia tensor
+	m_body->setCenterOfMassTransform(worldTransform);
+	m_body->setInterpolationWorldTransform(interpolationTransform);
+	m_body->setLinearVelocity(linearVelocity);
+	m_body->setAngularVelocity(angularVelocity);
+	m_body->setInterpolationLinearVelocity(interpolationLinear);
+	m_body->setInterpolationAngularVelocity(interpolationAngular);
+	m_body->clearForces();
+	m_body->applyCentralForce(force);
+	m_body->applyTorque(torque);
+	m_body->forceActivationState(activationState);
+	m_body->setDeactivationTime(deactivationTime);
+	m_body->setHitFraction(hitFraction);
+}
 
+void RigidBodyComponent::SleepOwner()
+{
+	if (!m_sleepWithBody) {
+		return;
+	}
+	Entity* owner = GetOwner();
+	for (Component* component : owner->GetAllComponents()) {
+		if (component->GetEnabled() && !component->CanSleep()) {
+			return;
+		}
 	}
+	owner->Sleep();
+}
 
+void RigidBodyComponent::Serialize(SceneArchive& archive)
+{
+	CollisionLayers* layers = World::GetInstance()->GetCollisionLayers();
+	std::string layer = archive.IsLoading() ? std::string() : layers->GetLayerName(m_layer);
+	ShapeDesc collider = m_colliderDesc;
+	bool hasCollider = m_hasColliderDesc;
 
+	// Binary scenes read fields back in this order, so the layer stays between them
+	archive.Fields(this);
+	archive.Field("layer", layer);
+	archive.Field("colliderMesh", m_colliderMesh);
+	archive.Field("colliderScale", m_colliderScale);
+	collider.Serialize(archive, hasCollider);
+
+	if (archive.IsLoading()) {
+		if (!layer.empty()) {
+			SetCollisionLayer(layer);
+		}
+		if (hasCollider) {
+			SetCollider(collider);
+		}
+	}
 }
 
 RigidBodyComponent::~RigidBodyComponent()
 {
-	// We can only delete the shape here because the other 
-	// pointers to data on the heap must be taken care of in a specific order
-	// which is done by the World's destructor
-	delete m_shape;
+	// Shapes are shared, so give this body's reference back to the cache. The 
+	// body and motion state are deleted by the World, which needs to 
+	// remove them from the simulation in a specific order.
+	if (m_shape) {
+		World::GetInstance()->GetShapeCache()->Release(m_shape);
+	}
 }
@@ -2,6 +2,9 @@
 #include "Component.h"
 #include <bullet/btBulletDynamicsCommon.h>
 #include <DirectXMath.h>
+#include <cstdint>
+#include "TransformMotionState.h"
+#include "CollisionShapeCache.h"
 
 // --------------------------------------------------------
 // Abstraction of Bullet physics to allow for easy
@@ -10,13 +13,39 @@
 class RigidBodyComponent : public Component
 {
 private:
-	btCollisionShape* m_shape = nullptr;
-	btDefaultMotionState* m_motionState = nullptr;
+	btCollisionShape* m_shape = nullptr; // Shared, from the World's shape cache
+	TransformMotionState* m_motionState = nullptr;
 	btRigidBody* m_body = nullptr;
+
+	// Mesh to build a collider from at Start, once the body's type is known
+	MeshHandle m_colliderMesh;
+	DirectX::XMFLOAT3 m_colliderScale = DirectX::XMFLOAT3(1, 1, 1);
+
+	// The shape given to SetCollider, kept for scene files
+	ShapeDesc m_colliderDesc;
+	bool m_hasColliderDesc = false;
+
+	// The Transform's local version when it was last copied to a static or kinematic body
+	uint32_t m_syncedVersion = 0;
+
+	int m_layer = CollisionLayers::DEFAULT_LAYER;
+
+	// --------------------------------------------------------
+	// Puts the Entity to sleep with the body if all its components can sleep
+	// --------------------------------------------------------
+	void SleepOwner();
 public:
 
 	float m_mass = 0.0f; // 0 indicates this is a static object
 
+	// Kinematic bodies are moved through their Transform rather than 
+	// by the simulation, and push other bodies out of the way. Set before Start.
+	bool m_kinematic = false;
+
+	// Puts the Entity to sleep along with its body when Bullet deactivates it,
+	// as long as the Entity's other components can sleep
+	bool m_sleepWithBody = true;
+
 	btRigidBody* GetBody() { return m_body; }
 
 	RigidBodyComponent(Entity* entity) : Component(entity) { }
@@ -36,6 +65,27 @@ public:
 	// --------------------------------------------------------
 	void SetSphereCollider(float radius);
 
+	// --------------------------------------------------------
+	// Sets the collider to any shape the World's shape cache can make.
+	// Triangle mesh colliders can only be used by static bodies.
+	// @param const ShapeDesc & desc
+	// --------------------------------------------------------
+	void SetCollider(const ShapeDesc& desc);
+
+	// --------------------------------------------------------
+	// Sets the collider to match a Mesh. Static and kinematic bodies get an
+	// exact triangle mesh, and dynamic bodies get the mesh's convex hull.
+	// @param Mesh * mesh
+	// @param DirectX::XMFLOAT3 scale scale to apply to the mesh's vertices
+	// --------------------------------------------------------
+	void SetMeshCollider(MeshHandle mesh, DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3(1, 1, 1));
+
+	// --------------------------------------------------------
+	// Sets the collider to a compound of several shapes. Bodies that 
+	// use the same name share the compound made by the first one.
+	// --------------------------------------------------------
+	void SetCompoundCollider(const std::string& name, const std::vector<CompoundChild>& children);
+
 
 	// --------------------------------------------------------
 	// Applies an impulse to this Entity. 
@@ -43,11 +93,43 @@ public:
 	// --------------------------------------------------------
 	void ApplyImpulse(DirectX::XMFLOAT3 impulse);
 
+	// --------------------------------------------------------
+	// Wakes or deactivates the body along with its Entity
+	// --------------------------------------------------------
+	void Wake();
+	void Sleep();
+
+	// --------------------------------------------------------
+	// Puts this body on a collision layer from the World's CollisionLayers.
+	// Can be changed at any time.
+	// @param const std::string & name layer name, created if it doesn't exist yet
+	// --------------------------------------------------------
+	void SetCollisionLayer(const std::string& name);
+	void SetCollisionLayer(int layer);
+	int GetCollisionLayer() { return m_layer; }
+
 
 	virtual void Start() override;
 
 	virtual void Tick(float deltaTime) override;
 
+	virtual bool CanSleep() override { return true; }
+
+	virtual void SaveState(SnapshotWriter& writer) override;
+	virtual void LoadState(SnapshotReader& reader) override;
+
+	// --------------------------------------------------------
+	// Compound colliders can't be stored in scenes, so bodies using
+	// them, or without a collider yet, are left out of scene files
+	// --------------------------------------------------------
+	virtual void Serialize(SceneArchive& archive) override;
+	virtual bool CanSerialize() override { return m_hasColliderDesc || m_colliderMesh; }
+
+	REFLECT_FIELDS(RigidBodyComponent,
+		REFLECT_FIELD("mass", m_mass),
+		REFLECT_FIELD("kinematic", m_kinematic),
+		REFLECT_FIELD("sleepWithBody", m_sleepWithBody))
+
 	~RigidBodyComponent();
 
 };
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <DirectXMath.h>
+#include "Reflection.h"
+
+// --------------------------------------------------------
+// Visits a component's settings, either reading them from a scene
+// file or writing them out. Components describe their settings once,
+// in Serialize, and that works for every scene format.
+// JSON scenes find fields by name, so missing fields keep their
+// defaults. Binary scenes ignore the names and read the fields back
+// in the order they were visited, so always visit the same fields
+// in the same order.
+// --------------------------------------------------------
+class SceneArchive
+{
+public:
+	virtual bool IsLoading() const = 0;
+
+	virtual void Field(const char* name, bool& value) = 0;
+	virtual void Field(const char* name, int& value) = 0;
+	virtual void Field(const char* name, float& value) = 0;
+	virtual void Field(const char* name, DirectX::XMFLOAT3& value) = 0;
+	virtual void Field(const char* name, DirectX::XMFLOAT4& value) = 0;
+	virtual void Field(const char* name, std::string& value) = 0;
+
+	// --------------------------------------------------------
+	// Resources are saved as the name they were created with in the
+	// World, and looked up again when loading. They need to be
+	// created before the scene is loaded.
+	// --------------------------------------------------------
+	virtual void Field(const char* name, MeshHandle& value) = 0;
+	virtual void Field(const char* name, MaterialHandle& value) = 0;
+	virtual void Field(const char* name, FMOD::Sound*& value) = 0;
+
+	// --------------------------------------------------------
+	// Visits every field a class declares with REFLECT_FIELDS.
+	// Binary archives copy runs of plain data fields in one go,
+	// rather than visiting each field.
+	// --------------------------------------------------------
+	template <class T>
+	void Fields(T* object) { Fields(static_cast<void*>(object), T::GetFields()); }
+
+	virtual void Fields(void* object, const FieldList& fields)
+	{
+		for (const FieldInfo& field : fields.GetFields()) {
+			switch (field.type) {
+			case FieldType::Bool: Field(field.name, field.Get<bool>(object)); break;
+			case FieldType::Int: Field(field.name, field.Get<int>(object)); break;
+			case FieldType::Float: Field(field.name, field.Get<float>(object)); break;
+			case FieldType::Float3: Field(field.name, field.Get<DirectX::XMFLOAT3>(object)); break;
+			case FieldType::Float4: Field(field.name, field.Get<DirectX::XMFLOAT4>(object)); break;
+			case FieldType::String: Field(field.name, field.Get<std::string>(object)); break;
+			case FieldType::Mesh: Field(field.name, field.Get<MeshHandle>(object)); break;
+			case FieldType::Material: Field(field.name, field.Get<MaterialHandle>(object)); break;
+			case FieldType::Sound: Field(field.name, field.Get<FMOD::Sound*>(object)); break;
+			}
+		}
+	}
+
+	virtual ~SceneArchive() { }
+};
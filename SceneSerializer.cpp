@@ -0,0 +1,810 @@
+#include "SceneSerializer.h"
+#include "SceneArchive.h"
+#include "ComponentRegistry.h"
+#include "WorldSnapshot.h"
+#include <rapidjson/document.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+#include <fstream>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+#include <cstdio>
+
+using namespace DirectX;
+using namespace rapidjson;
+
+namespace
+{
+	const uint32_t SCENE_MAGIC = 0x42535446; // "FTSB"
+	const uint32_t SCENE_VERSION = 1;
+	const uint32_t NO_STRING = 0xFFFFFFFF;
+	const int NO_PARENT = -1;
+
+	// Smallest possible binary entity record, used to reject bad entity counts
+	const size_t MIN_RECORD_SIZE = sizeof(uint32_t) * 4 + sizeof(XMFLOAT3) * 2 + sizeof(XMFLOAT4);
+
+	typedef ComponentRegistry::TypeInfo TypeInfo;
+	typedef std::vector<std::pair<Component*, const TypeInfo*>> SavedComponents;
+
+	// --------------------------------------------------------
+	// File helpers
+	// --------------------------------------------------------
+	bool ReadFile(const std::string& path, std::vector<char>& contents)
+	{
+		std::ifstream input(path, std::ios::binary);
+		if (!input) {
+			return false;
+		}
+		contents.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	bool WriteFile(const std::string& path, const void* data, size_t size)
+	{
+		std::ofstream output(path, std::ios::binary | std::ios::trunc);
+		if (!output) {
+			return false;
+		}
+		output.write(static_cast<const char*>(data), size);
+		return output.good();
+	}
+
+	// --------------------------------------------------------
+	// Entity helpers shared by both formats
+	// --------------------------------------------------------
+
+	// The components that go in a scene: every registered one. The Transform is stored with the Entity.
+	void GetSavedComponents(Entity* entity, SavedComponents& saved)
+	{
+		saved.clear();
+		ComponentRegistry& registry = ComponentRegistry::GetInstance();
+		for (Component* component : entity->GetAllComponents()) {
+			const TypeInfo* type = component == entity->GetTransform() ? nullptr : registry.Find(component);
+			if (!type) {
+				continue;
+			}
+			// Saving it anyway would give a file that can't be started after loading
+			if (!component->CanSerialize()) {
+				printf("Not saving %s on %s, since its settings can't be stored in a scene\n", type->name.c_str(), entity->GetName().c_str());
+				continue;
+			}
+			saved.push_back({ component, type });
+		}
+	}
+
+	int GetParentIndex(Entity* entity, const std::unordered_map<Entity*, int>& indices)
+	{
+		Transform* parent = entity->GetTransform()->GetParent();
+		if (!parent) {
+			return NO_PARENT;
+		}
+		auto it = indices.find(parent->GetOwner());
+		return it != indices.end() ? it->second : NO_PARENT;
+	}
+
+	void ApplyTransform(Entity* entity, XMFLOAT3 position, XMFLOAT4 rotation, XMFLOAT3 scale)
+	{
+		Transform* transform = entity->GetTransform();
+		transform->SetPosition(position);
+		transform->SetRotation(rotation);
+		transform->SetScale(scale);
+	}
+
+	// Parents are set once every Entity in the scene exists, since a parent can come after its children
+	void LinkParents(const std::vector<Entity*>& created, const std::vector<int>& parents, std::vector<EntityHandle>* entities)
+	{
+		for (size_t i = 0; i < created.size(); ++i) {
+			int parent = parents[i];
+			if (parent != NO_PARENT && parent >= 0 && (size_t)parent < created.size() && (size_t)parent != i) {
+				created[i]->GetTransform()->SetParent(created[parent]->GetTransform(), false);
+			}
+		}
+		if (entities) {
+			entities->reserve(entities->size() + created.size());
+			for (Entity* entity : created) {
+				entities->push_back(entity->GetHandle());
+			}
+		}
+	}
+
+	void ReserveTransforms(size_t count)
+	{
+		ObjectPool<Transform>& transforms = ObjectPool<Transform>::GetInstance();
+		transforms.Reserve(transforms.GetStats().live + count);
+	}
+
+	// --------------------------------------------------------
+	// JSON archives
+	// --------------------------------------------------------
+	typedef PrettyWriter<StringBuffer> JsonWriter;
+
+	class JsonWriteArchive : public SceneArchive
+	{
+	private:
+		JsonWriter& m_writer;
+
+		void WriteFloats(const char* name, const float* values, int count)
+		{
+			m_writer.Key(name);
+			m_writer.StartArray();
+			for (int i = 0; i < count; ++i) {
+				m_writer.Double(values[i]);
+			}
+			m_writer.EndArray();
+		}
+
+		void WriteName(const char* name, const std::string& value)
+		{
+			m_writer.Key(name);
+			if (value.empty()) {
+				m_writer.Null();
+			}
+			else {
+				m_writer.String(value.c_str(), (SizeType)value.size());
+			}
+		}
+	public:
+		JsonWriteArchive(JsonWriter& writer) : m_writer(writer) { }
+
+		bool IsLoading() const override { return false; }
+
+		void Field(const char* name, bool& value) override { m_writer.Key(name); m_writer.Bool(value); }
+		void Field(const char* name, int& value) override { m_writer.Key(name); m_writer.Int(value); }
+		void Field(const char* name, float& value) override { m_writer.Key(name); m_writer.Double(value); }
+		void Field(const char* name, XMFLOAT3& value) override { WriteFloats(name, &value.x, 3); }
+		void Field(const char* name, XMFLOAT4& value) override { WriteFloats(name, &value.x, 4); }
+		void Field(const char* name, std::string& value) override
+		{
+			m_writer.Key(name);
+			m_writer.String(value.c_str(), (SizeType)value.size());
+		}
+
+		void Field(const char* name, MeshHandle& value) override { WriteName(name, value.GetName()); }
+		void Field(const char* name, MaterialHandle& value) override { WriteName(name, value.GetName()); }
+		void Field(const char* name, FMOD::Sound*& value) override
+		{
+			WriteName(name, value ? World::GetInstance()->GetSoundName(value) : std::string());
+		}
+	};
+
+	class JsonReadArchive : public SceneArchive
+	{
+	private:
+		const Value& m_object;
+
+		const Value* Find(const char* name)
+		{
+			Value::ConstMemberIterator member = m_object.FindMember(name);
+			return member != m_object.MemberEnd() ? &member->value : nullptr;
+		}
+
+		void ReadFloats(const char* name, float* values, SizeType count)
+		{
+			const Value* value = Find(name);
+			if (!value || !value->IsArray() || value->Size() < count) {
+				return;
+			}
+			for (SizeType i = 0; i < count; ++i) {
+				if (!(*value)[i].IsNumber()) {
+					return;
+				}
+			}
+			for (SizeType i = 0; i < count; ++i) {
+				values[i] = (float)(*value)[i].GetDouble();
+			}
+		}
+
+		// @returns bool whether the field holds a resource name or null
+		bool ReadName(const char* name, std::string& resource)
+		{
+			const Value* value = Find(name);
+			if (!value || !(value->IsString() || value->IsNull())) {
+				return false;
+			}
+			resource = value->IsString() ? value->GetString() : "";
+			return true;
+		}
+	public:
+		JsonReadArchive(const Value& object) : m_object(object) { }
+
+		bool IsLoading() const override { return true; }
+
+		void Field(const char* name, bool& value) override
+		{
+			const Value* field = Find(name);
+			if (field && field->IsBool()) {
+				value = field->GetBool();
+			}
+		}
+
+		void Field(const char* name, int& value) override
+		{
+			const Value* field = Find(name);
+			if (field && field->IsInt()) {
+				value = field->GetInt();
+			}
+		}
+
+		void Field(const char* name, float& value) override
+		{
+			const Value* field = Find(name);
+			if (field && field->IsNumber()) {
+				value = (float)field->GetDouble();
+			}
+		}
+
+		void Field(const char* name, XMFLOAT3& value) override { ReadFloats(name, &value.x, 3); }
+		void Field(const char* name, XMFLOAT4& value) override { ReadFloats(name, &value.x, 4); }
+
+		void Field(const char* name, std::string& value) override
+		{
+			const Value* field = Find(name);
+			if (field && field->IsString()) {
+				value.assign(field->GetString(), field->GetStringLength());
+			}
+		}
+
+		void Field(const char* name, MeshHandle& value) override
+		{
+			std::string resource;
+			if (ReadName(name, resource)) {
+				value = resource.empty() ? MeshHandle() : World::GetInstance()->GetMesh(resource);
+			}
+		}
+
+		void Field(const char* name, MaterialHandle& value) override
+		{
+			std::string resource;
+			if (ReadName(name, resource)) {
+				value = resource.empty() ? MaterialHandle() : World::GetInstance()->GetMaterial(resource);
+			}
+		}
+
+		void Field(const char* name, FMOD::Sound*& value) override
+		{
+			std::string resource;
+			if (ReadName(name, resource)) {
+				value = resource.empty() ? nullptr : World::GetInstance()->GetSound(resource);
+			}
+		}
+	};
+
+	// --------------------------------------------------------
+	// Binary archives
+	// --------------------------------------------------------
+
+	// Every string in a binary scene is stored once, and referred to by index
+	class StringTable
+	{
+	private:
+		std::unordered_map<std::string, uint32_t> m_ids;
+		std::vector<std::string> m_strings;
+	public:
+		uint32_t Intern(const std::string& value)
+		{
+			auto it = m_ids.find(value);
+			if (it != m_ids.end()) {
+				return it->second;
+			}
+			uint32_t id = (uint32_t)m_strings.size();
+			m_ids[value] = id;
+			m_strings.push_back(value);
+			return id;
+		}
+
+		const std::vector<std::string>& GetStrings() const { return m_strings; }
+	};
+
+	// Resolves each resource name in a binary scene at most once
+	template <class T>
+	class ResourceLookup
+	{
+	private:
+		std::vector<T> m_values;
+		std::vector<bool> m_resolved;
+	public:
+		ResourceLookup(size_t stringCount) : m_values(stringCount), m_resolved(stringCount, false) { }
+
+		template <class Find>
+		T Get(uint32_t index, const std::vector<std::string>& strings, Find find)
+		{
+			if (index >= m_values.size()) {
+				return T();
+			}
+			if (!m_resolved[index]) {
+				m_values[index] = find(strings[index]);
+				m_resolved[index] = true;
+			}
+			return m_values[index];
+		}
+	};
+
+	class BinaryWriteArchive : public SceneArchive
+	{
+	private:
+		SnapshotWriter& m_writer;
+		StringTable& m_strings;
+
+		void WriteName(const std::string& value)
+		{
+			m_writer.Write(value.empty() ? NO_STRING : m_strings.Intern(value));
+		}
+	public:
+		BinaryWriteArchive(SnapshotWriter& writer, StringTable& strings) : m_writer(writer), m_strings(strings) { }
+
+		bool IsLoading() const override { return false; }
+
+		void Field(const char* name, bool& value) override { m_writer.Write((uint8_t)(value ? 1 : 0)); }
+		void Field(const char* name, int& value) override { m_writer.Write((int32_t)value); }
+		void Field(const char* name, float& value) override { m_writer.Write(value); }
+		void Field(const char* name, XMFLOAT3& value) override { m_writer.Write(value); }
+		void Field(const char* name, XMFLOAT4& value) override { m_writer.Write(value); }
+		void Field(const char* name, std::string& value) override { m_writer.Write(m_strings.Intern(value)); }
+
+		void Field(const char* name, MeshHandle& value) override { WriteName(value.GetName()); }
+		void Field(const char* name, MaterialHandle& value) override { WriteName(value.GetName()); }
+		void Field(const char* name, FMOD::Sound*& value) override
+		{
+			WriteName(value ? World::GetInstance()->GetSoundName(value) : std::string());
+		}
+
+		void Fields(void* object, const FieldList& fields) override
+		{
+			for (const FieldList::Segment& segment : fields.GetSegments()) {
+				if (segment.plainData) {
+					m_writer.WriteBytes(static_cast<const char*>(object) + segment.offset, segment.size);
+					continue;
+				}
+				const FieldInfo& field = fields.GetFields()[segment.first];
+				switch (field.type) {
+				case FieldType::String: BinaryWriteArchive::Field(field.name, field.Get<std::string>(object)); break;
+				case FieldType::Mesh: BinaryWriteArchive::Field(field.name, field.Get<MeshHandle>(object)); break;
+				case FieldType::Material: BinaryWriteArchive::Field(field.name, field.Get<MaterialHandle>(object)); break;
+				case FieldType::Sound: BinaryWriteArchive::Field(field.name, field.Get<FMOD::Sound*>(object)); break;
+				default: break;
+				}
+			}
+		}
+	};
+
+	class BinaryReadArchive : public SceneArchive
+	{
+	private:
+		SnapshotReader& m_reader;
+		const std::vector<std::string>& m_strings;
+		ResourceLookup<MeshHandle>& m_meshes;
+		ResourceLookup<MaterialHandle>& m_materials;
+		ResourceLookup<FMOD::Sound*>& m_sounds;
+
+		uint32_t ReadIndex()
+		{
+			uint32_t index = NO_STRING;
+			m_reader.Read(index);
+			return index;
+		}
+	public:
+		BinaryReadArchive(SnapshotReader& reader, const std::vector<std::string>& strings,
+			ResourceLookup<MeshHandle>& meshes, ResourceLookup<MaterialHandle>& materials, ResourceLookup<FMOD::Sound*>& sounds)
+			: m_reader(reader), m_strings(strings), m_meshes(meshes), m_materials(materials), m_sounds(sounds) { }
+
+		bool IsLoading() const override { return true; }
+
+		void Field(const char* name, bool& value) override
+		{
+			uint8_t stored;
+			if (m_reader.Read(stored)) {
+				value = stored != 0;
+			}
+		}
+
+		void Field(const char* name, int& value) override
+		{
+			int32_t stored;
+			if (m_reader.Read(stored)) {
+				value = stored;
+			}
+		}
+
+		void Field(const char* name, float& value) override { m_reader.Read(value); }
+		void Field(const char* name, XMFLOAT3& value) override { m_reader.Read(value); }
+		void Field(const char* name, XMFLOAT4& value) override { m_reader.Read(value); }
+
+		void Field(const char* name, std::string& value) override
+		{
+			uint32_t index = ReadIndex();
+			if (index < m_strings.size()) {
+				value = m_strings[index];
+			}
+		}
+
+		void Field(const char* name, MeshHandle& value) override
+		{
+			value = m_meshes.Get(ReadIndex(), m_strings, [](const std::string& resource) { return World::GetInstance()->GetMesh(resource); });
+		}
+
+		void Field(const char* name, MaterialHandle& value) override
+		{
+			value = m_materials.Get(ReadIndex(), m_strings, [](const std::string& resource) { return World::GetInstance()->GetMaterial(resource); });
+		}
+
+		void Field(const char* name, FMOD::Sound*& value) override
+		{
+			value = m_sounds.Get(ReadIndex(), m_strings, [](const std::string& resource) { return World::GetInstance()->GetSound(resource); });
+		}
+
+		void Fields(void* object, const FieldList& fields) override
+		{
+			for (const FieldList::Segment& segment : fields.GetSegments()) {
+				if (segment.plainData) {
+					char* start = static_cast<char*>(object) + segment.offset;
+					if (!m_reader.ReadBytes(start, segment.size)) {
+						return;
+					}
+					// Bools are read as bytes, so make sure they hold true or false
+					for (size_t i = segment.first; i < segment.first + segment.count; ++i) {
+						const FieldInfo& field = fields.GetFields()[i];
+						if (field.type == FieldType::Bool) {
+							uint8_t stored = *reinterpret_cast<uint8_t*>(start + field.offset - segment.offset);
+							field.Get<bool>(object) = stored != 0;
+						}
+					}
+					continue;
+				}
+				const FieldInfo& field = fields.GetFields()[segment.first];
+				switch (field.type) {
+				case FieldType::String: BinaryReadArchive::Field(field.name, field.Get<std::string>(object)); break;
+				case FieldType::Mesh: BinaryReadArchive::Field(field.name, field.Get<MeshHandle>(object)); break;
+				case FieldType::Material: BinaryReadArchive::Field(field.name, field.Get<MaterialHandle>(object)); break;
+				case FieldType::Sound: BinaryReadArchive::Field(field.name, field.Get<FMOD::Sound*>(object)); break;
+				default: break;
+				}
+			}
+		}
+	};
+}
+
+bool SceneSerializer::SaveJson(const std::string& path)
+{
+	const std::vector<Entity*>& all = World::GetInstance()->GetEntities();
+	std::unordered_map<Entity*, int> indices;
+	for (size_t i = 0; i < all.size(); ++i) {
+		indices[all[i]] = (int)i;
+	}
+
+	StringBuffer buffer;
+	JsonWriter writer(buffer);
+	JsonWriteArchive archive(writer);
+	SavedComponents saved;
+
+	writer.StartObject();
+	writer.Key("entities");
+	writer.StartArray();
+	for (Entity* entity : all) {
+		writer.StartObject();
+
+		std::string name = entity->GetName();
+		archive.Field("name", name);
+		if (entity->GetTagCount() > 0) {
+			writer.Key("tags");
+			writer.StartArray();
+			for (size_t i = 0; i < entity->GetTagCount(); ++i) {
+				std::string tag = entity->GetTag(i);
+				writer.String(tag.c_str(), (SizeType)tag.size());
+			}
+			writer.EndArray();
+		}
+
+		int parent = GetParentIndex(entity, indices);
+		if (parent != NO_PARENT) {
+			archive.Field("parent", parent);
+		}
+		Transform* transform = entity->GetTransform();
+		XMFLOAT3 position = transform->GetPosition();
+		XMFLOAT4 rotation = transform->GetRotation();
+		XMFLOAT3 scale = transform->GetScale();
+		archive.Field("position", position);
+		archive.Field("rotation", rotation);
+		archive.Field("scale", scale);
+
+		GetSavedComponents(entity, saved);
+		writer.Key("components");
+		writer.StartArray();
+		for (auto& component : saved) {
+			writer.StartObject();
+			writer.Key("type");
+			writer.String(component.second->name.c_str(), (SizeType)component.second->name.size());
+			component.first->Serialize(archive);
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	return WriteFile(path, buffer.GetString(), buffer.GetSize());
+}
+
+bool SceneSerializer::LoadJson(const std::string& path, std::vector<EntityHandle>* entities)
+{
+	std::vector<char> contents;
+	if (!ReadFile(path, contents)) {
+		return false;
+	}
+	contents.push_back('\0');
+
+	Document document;
+	document.Parse(contents.data());
+	if (document.HasParseError() || !document.IsObject()) {
+		return false;
+	}
+	Value::ConstMemberIterator list = document.FindMember("entities");
+	if (list == document.MemberEnd() || !list->value.IsArray()) {
+		return false;
+	}
+	const Value& records = list->value;
+
+	// Count each component type first, so the pools only grow once
+	ComponentRegistry& registry = ComponentRegistry::GetInstance();
+	std::unordered_map<const TypeInfo*, size_t> counts;
+	for (const Value& record : records.GetArray()) {
+		if (!record.IsObject() || !record.HasMember("components") || !record["components"].IsArray()) {
+			continue;
+		}
+		for (const Value& component : record["components"].GetArray()) {
+			if (component.IsObject() && component.HasMember("type") && component["type"].IsString()) {
+				const TypeInfo* type = registry.Find(component["type"].GetString());
+				if (type) {
+					counts[type]++;
+				}
+			}
+		}
+	}
+	for (auto& count : counts) {
+		count.first->reserve(count.second);
+	}
+	ReserveTransforms(records.Size());
+
+	std::vector<Entity*> created(records.Size());
+	std::vector<int> parents(records.Size(), NO_PARENT);
+	World::GetInstance()->InstantiateBatch(records.Size(), [&](Entity* entity, size_t i) {
+		created[i] = entity;
+		const Value& record = records[(SizeType)i];
+		if (!record.IsObject()) {
+			return;
+		}
+
+		JsonReadArchive archive(record);
+		std::string name;
+		archive.Field("name", name);
+		entity->SetName(name);
+		if (record.HasMember("tags") && record["tags"].IsArray()) {
+			for (const Value& tag : record["tags"].GetArray()) {
+				if (tag.IsString()) {
+					entity->AddTag(tag.GetString());
+				}
+			}
+		}
+
+		archive.Field("parent", parents[i]);
+		XMFLOAT3 position(0, 0, 0);
+		XMFLOAT4 rotation(0, 0, 0, 1);
+		XMFLOAT3 scale(1, 1, 1);
+		archive.Field("position", position);
+		archive.Field("rotation", rotation);
+		archive.Field("scale", scale);
+		ApplyTransform(entity, position, rotation, scale);
+
+		if (!record.HasMember("components") || !record["components"].IsArray()) {
+			return;
+		}
+		for (const Value& component : record["components"].GetArray()) {
+			if (!component.IsObject() || !component.HasMember("type") || !component["type"].IsString()) {
+				continue;
+			}
+			// Types that aren't registered are skipped
+			const TypeInfo* type = registry.Find(component["type"].GetString());
+			if (type) {
+				JsonReadArchive componentArchive(component);
+				type->create(entity)->Serialize(componentArchive);
+			}
+		}
+	});
+
+	LinkParents(created, parents, entities);
+	return true;
+}
+
+bool SceneSerializer::SaveBinary(const std::string& path)
+{
+	const std::vector<Entity*>& all = World::GetInstance()->GetEntities();
+	std::unordered_map<Entity*, int> indices;
+	for (size_t i = 0; i < all.size(); ++i) {
+		indices[all[i]] = (int)i;
+	}
+
+	// Entity records go in their own buffer, since the string and type tables have to come first
+	std::vector<uint8_t> records;
+	SnapshotWriter writer(records);
+	StringTable strings;
+	BinaryWriteArchive archive(writer, strings);
+	std::unordered_map<const TypeInfo*, uint32_t> typeIds;
+	std::vector<std::pair<uint32_t, uint32_t>> types; // Name and instance count
+	SavedComponents saved;
+
+	for (Entity* entity : all) {
+		writer.Write(strings.Intern(entity->GetName()));
+		writer.Write((int32_t)GetParentIndex(entity, indices));
+		writer.Write((uint32_t)entity->GetTagCount());
+		for (size_t i = 0; i < entity->GetTagCount(); ++i) {
+			writer.Write(strings.Intern(entity->GetTag(i)));
+		}
+
+		Transform* transform = entity->GetTransform();
+		writer.Write(transform->GetPosition());
+		writer.Write(transform->GetRotation());
+		writer.Write(transform->GetScale());
+
+		GetSavedComponents(entity, saved);
+		writer.Write((uint32_t)saved.size());
+		for (auto& component : saved) {
+			auto id = typeIds.find(component.second);
+			if (id == typeIds.end()) {
+				id = typeIds.insert({ component.second, (uint32_t)types.size() }).first;
+				types.push_back({ strings.Intern(component.second->name), 0 });
+			}
+			types[id->second].second++;
+			writer.Write(id->second);
+
+			// Sized, so loaders can skip types they don't have registered
+			size_t sizeOffset = writer.GetSize();
+			writer.Write((uint32_t)0);
+			component.first->Serialize(archive);
+			uint32_t size = (uint32_t)(writer.GetSize() - sizeOffset - sizeof(uint32_t));
+			std::memcpy(records.data() + sizeOffset, &size, sizeof(size));
+		}
+	}
+
+	std::vector<uint8_t> file;
+	SnapshotWriter header(file);
+	header.Write(SCENE_MAGIC);
+	header.Write(SCENE_VERSION);
+	header.Write((uint32_t)strings.GetStrings().size());
+	for (const std::string& value : strings.GetStrings()) {
+		header.Write((uint32_t)value.size());
+		header.WriteBytes(value.data(), value.size());
+	}
+	header.Write((uint32_t)types.size());
+	for (auto& type : types) {
+		header.Write(type.first);
+		header.Write(type.second);
+	}
+	header.Write((uint32_t)all.size());
+	header.WriteBytes(records.data(), records.size());
+
+	return WriteFile(path, file.data(), file.size());
+}
+
+bool SceneSerializer::LoadBinary(const std::string& path, std::vector<EntityHandle>* entities)
+{
+	std::vector<char> file;
+	if (!ReadFile(path, file)) {
+		return false;
+	}
+	return LoadBinary(file.data(), file.size(), entities);
+}
+
+bool SceneSerializer::LoadBinary(const char* data, size_t size, std::vector<EntityHandle>* entities)
+{
+	SnapshotReader reader(reinterpret_cast<const uint8_t*>(data), size);
+
+	uint32_t magic, version, stringCount;
+	if (!reader.Read(magic) || !reader.Read(version) || magic != SCENE_MAGIC || version != SCENE_VERSION ||
+		!reader.Read(stringCount) || stringCount > size) {
+		return false;
+	}
+	std::vector<std::string> strings(stringCount);
+	for (std::string& value : strings) {
+		uint32_t length = 0;
+		reader.Read(length);
+		SnapshotReader bytes = reader.ReadBlock(length);
+		if (reader.Failed()) {
+			return false;
+		}
+		value.resize(length);
+		bytes.ReadBytes(&value[0], length);
+	}
+
+	// Component types are looked up by name once per file, and their pools grown to fit
+	ComponentRegistry& registry = ComponentRegistry::GetInstance();
+	uint32_t typeCount = 0;
+	reader.Read(typeCount);
+	if (typeCount > size) {
+		return false;
+	}
+	std::vector<const TypeInfo*> types(typeCount, nullptr);
+	std::vector<uint32_t> typeCounts(typeCount, 0);
+	for (uint32_t t = 0; t < typeCount; ++t) {
+		uint32_t name = NO_STRING;
+		reader.Read(name);
+		reader.Read(typeCounts[t]);
+		types[t] = name < strings.size() ? registry.Find(strings[name]) : nullptr;
+	}
+
+	uint32_t entityCount = 0;
+	if (!reader.Read(entityCount) || entityCount > size / MIN_RECORD_SIZE) {
+		return false;
+	}
+	ReserveTransforms(entityCount);
+
+	// Every component record has a type and size, so a count the rest of the file can't hold is bogus
+	size_t maxComponents = reader.GetRemaining() / (2 * sizeof(uint32_t));
+	for (uint32_t t = 0; t < typeCount; ++t) {
+		if (types[t]) {
+			types[t]->reserve(typeCounts[t] < maxComponents ? typeCounts[t] : maxComponents);
+		}
+	}
+
+	ResourceLookup<MeshHandle> meshes(strings.size());
+	ResourceLookup<MaterialHandle> materials(strings.size());
+	ResourceLookup<FMOD::Sound*> sounds(strings.size());
+	std::vector<Entity*> created(entityCount);
+	std::vector<int> parents(entityCount, NO_PARENT);
+	if (entityCount == 0) {
+		return reader.AtEnd();
+	}
+
+	// A bad record throws the whole batch away before anything in it starts
+	bool loaded = World::GetInstance()->TryInstantiateBatch(entityCount, [&](Entity* entity, size_t i) {
+		created[i] = entity;
+		uint32_t name = NO_STRING, tagCount = 0, componentCount = 0;
+		int32_t parent = NO_PARENT;
+		XMFLOAT3 position(0, 0, 0);
+		XMFLOAT4 rotation(0, 0, 0, 1);
+		XMFLOAT3 scale(1, 1, 1);
+		if (!reader.Read(name) || !reader.Read(parent) || !reader.Read(tagCount)) {
+			return false;
+		}
+		if (name < strings.size()) {
+			entity->SetName(strings[name]);
+		}
+		parents[i] = parent;
+		for (uint32_t t = 0; t < tagCount && !reader.Failed(); ++t) {
+			uint32_t tag = NO_STRING;
+			reader.Read(tag);
+			if (tag < strings.size()) {
+				entity->AddTag(strings[tag]);
+			}
+		}
+
+		reader.Read(position);
+		reader.Read(rotation);
+		reader.Read(scale);
+		ApplyTransform(entity, position, rotation, scale);
+
+		reader.Read(componentCount);
+		for (uint32_t c = 0; c < componentCount && !reader.Failed(); ++c) {
+			uint32_t typeId = 0, size = 0;
+			reader.Read(typeId);
+			reader.Read(size);
+			SnapshotReader block = reader.ReadBlock(size);
+			if (typeId < types.size() && types[typeId]) {
+				BinaryReadArchive archive(block, strings, meshes, materials, sounds);
+				types[typeId]->create(entity)->Serialize(archive);
+				if (block.Failed()) {
+					return false;
+				}
+			}
+		}
+
+		// The last record has to end the file
+		return !reader.Failed() && (i + 1 < entityCount || reader.AtEnd());
+	});
+	if (!loaded) {
+		return false;
+	}
+	LinkParents(created, parents, entities);
+	return true;
+}
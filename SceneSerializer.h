@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "EntityHandle.h"
+
+// --------------------------------------------------------
+// Saves the World's entities to scene files and spawns them back.
+// A scene stores each Entity's name, tags, parent and Transform,
+// and the settings of every registered component (see
+// ComponentRegistry and Component::Serialize).
+//
+// JSON scenes are for editing by hand. Binary scenes are for
+// shipping: names are stored once in a string table, component
+// types are looked up once per file, pools are grown to fit the
+// whole scene before anything is made, and fields are read back
+// in order with no lookups.
+// --------------------------------------------------------
+class SceneSerializer
+{
+public:
+	// --------------------------------------------------------
+	// Writes every spawned Entity to a file
+	// @returns bool false if the file couldn't be written
+	// --------------------------------------------------------
+	static bool SaveJson(const std::string& path);
+	static bool SaveBinary(const std::string& path);
+
+	// --------------------------------------------------------
+	// Spawns a scene's entities as a single batch. Like other
+	// batches, their components are started in the next Flush.
+	// @param std::vector<EntityHandle> * entities if given, the new entities are appended in file order
+	// @returns bool false if the file couldn't be read or isn't a valid scene,
+	// in which case none of its entities are left spawned
+	// --------------------------------------------------------
+	static bool LoadJson(const std::string& path, std::vector<EntityHandle>* entities = nullptr);
+	static bool LoadBinary(const std::string& path, std::vector<EntityHandle>* entities = nullptr);
+
+	// --------------------------------------------------------
+	// Spawns a binary scene that's already been read into memory,
+	// e.g. on a loading thread
+	// --------------------------------------------------------
+	static bool LoadBinary(const char* data, size_t size, std::vector<EntityHandle>* entities = nullptr);
+};
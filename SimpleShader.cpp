@@ -46,14 +46,17 @@ void ISimpleShader::CleanUp()
 	if (constantBuffers)
 	{
 		delete[] constantBuffers;
+		constantBuffers = 0;
 		constantBufferCount = 0;
 	}
 
 	for (unsigned int i = 0; i < shaderResourceViews.size(); i++)
 		delete shaderResourceViews[i];
+	shaderResourceViews.clear();
 	
 	for (unsigned int i = 0; i < samplerStates.size(); i++)
 		delete samplerStates[i];
+	samplerStates.clear();
 
 	// Clean up tables
 	varTable.clear();
@@ -74,11 +77,29 @@ void ISimpleShader::CleanUp()
 bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 {
 	// Load the shader to a blob and ensure it worked
-	HRESULT hr = D3DReadFileToBlob(shaderFile, &shaderBlob);
+	ID3DBlob* blob = 0;
+	HRESULT hr = D3DReadFileToBlob(shaderFile, &blob);
 	if (hr != S_OK)
 	{
 		return false;
 	}
+	return LoadShaderBlob(blob);
+}
+
+// --------------------------------------------------------
+// Builds the shader and its variable table from compiled shader
+// code, replacing whatever was loaded before. Used to hot reload
+// shaders, since the blob can be read on another thread.
+//
+// blob - The compiled shader. The shader takes over the reference.
+// 
+// Returns true if shader is loaded properly, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::LoadShaderBlob(ID3DBlob* blob)
+{
+	if (shaderBlob)
+		shaderBlob->Release();
+	shaderBlob = blob;
 
 	// Create the shader - Calls an overloaded version of this abstract
 	// method in the appropriate child class
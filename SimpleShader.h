@@ -67,6 +67,7 @@ public:
 	// Initialization method (since we can't invoke derived class
 	// overrides in the base class constructor)
 	bool LoadShaderFile(LPCWSTR shaderFile);
+	bool LoadShaderBlob(ID3DBlob* blob);
 
 	// Simple helpers
 	bool IsShaderValid() { return shaderValid; }
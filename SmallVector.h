@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <atomic>
+
+// --------------------------------------------------------
+// Counts SmallVectors that have outgrown their inline storage
+// --------------------------------------------------------
+inline std::atomic<size_t>& SmallVectorHeapSpills()
+{
+	static std::atomic<size_t> spills(0);
+	return spills;
+}
+
+// --------------------------------------------------------
+// Vector of trivially copyable values that stores its first N
+// elements inline, and only goes to the heap when it grows past them.
+// --------------------------------------------------------
+template <class T, size_t N>
+class SmallVector
+{
+	static_assert(std::is_trivially_copyable<T>::value, "SmallVector only holds trivially copyable types");
+private:
+	T m_inline[N];
+	T* m_data = m_inline;
+	size_t m_size = 0;
+	size_t m_capacity = N;
+
+	void Grow()
+	{
+		size_t capacity = m_capacity * 2;
+		T* data = static_cast<T*>(::operator new(sizeof(T) * capacity));
+		std::memcpy(data, m_data, sizeof(T) * m_size);
+		if (m_data != m_inline) {
+			::operator delete(m_data);
+		}
+		else {
+			SmallVectorHeapSpills()++;
+		}
+		m_data = data;
+		m_capacity = capacity;
+	}
+public:
+	SmallVector() { }
+	SmallVector(const SmallVector&) = delete;
+	SmallVector& operator=(const SmallVector&) = delete;
+
+	void push_back(const T& value)
+	{
+		if (m_size == m_capacity) {
+			Grow();
+		}
+		m_data[m_size++] = value;
+	}
+
+	void pop_back() { m_size--; }
+	void clear() { m_size = 0; }
+
+	T& operator[](size_t index) { return m_data[index]; }
+	const T& operator[](size_t index) const { return m_data[index]; }
+	T& back() { return m_data[m_size - 1]; }
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	T* begin() { return m_data; }
+	T* end() { return m_data + m_size; }
+	const T* begin() const { return m_data; }
+	const T* end() const { return m_data + m_size; }
+
+	~SmallVector()
+	{
+		if (m_data != m_inline) {
+			::operator delete(m_data);
+		}
+	}
+};
@@ -1,6 +1,7 @@
 #include "SoundComponent.h"
 #include "World.h"
 #include "Entity.h"
+#include "SceneArchive.h"
 
 SoundComponent::SoundComponent(Entity* entity) : Component(entity)
 {
@@ -70,6 +71,15 @@ void SoundComponent::Tick(float deltaTime)
 {
 }
 
+void SoundComponent::Serialize(SceneArchive& archive)
+{
+	archive.Fields(this);
+	if (archive.IsLoading()) {
+		SetSound(m_sound);
+		SetVolume(m_volume);
+	}
+}
+
 SoundComponent::~SoundComponent()
 {
 	m_channelGroup->release();
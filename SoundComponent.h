@@ -39,6 +39,12 @@ public:
 
 	virtual void Tick(float deltaTime) override;
 
+	virtual void Serialize(SceneArchive& archive) override;
+
+	REFLECT_FIELDS(SoundComponent,
+		REFLECT_FIELD("sound", m_sound),
+		REFLECT_FIELD("volume", m_volume))
+
 	~SoundComponent();
 };
 
@@ -0,0 +1,25 @@
+#pragma once
+#include <atomic>
+#include <thread>
+
+// --------------------------------------------------------
+// Minimal lock for very short critical sections, like taking
+// an object off a free list. Works with std::lock_guard.
+// --------------------------------------------------------
+class SpinLock
+{
+private:
+	std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+public:
+	void lock()
+	{
+		while (m_flag.test_and_set(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+	}
+
+	void unlock()
+	{
+		m_flag.clear(std::memory_order_release);
+	}
+};
@@ -1,5 +1,7 @@
 #include "Transform.h"
 #include "Entity.h"
+#include "TransformHierarchy.h"
+#include "WorldSnapshot.h"
 
 using namespace DirectX;
 
@@ -9,6 +11,23 @@ Transform::Transform(Entity* entity) : Component(entity)
 	m_scale = XMFLOAT3(1, 1, 1);
 	XMStoreFloat4(&m_rotation, XMQuaternionIdentity());
 	XMStoreFloat4x4(&m_world, XMMatrixIdentity());
+	m_worldPosition = m_position;
+	m_worldRotation = m_rotation;
+}
+
+void Transform::SaveState(SnapshotWriter& writer)
+{
+	writer.Write(m_position);
+	writer.Write(m_rotation);
+	writer.Write(m_scale);
+}
+
+void Transform::LoadState(SnapshotReader& reader)
+{
+	reader.Read(m_position);
+	reader.Read(m_rotation);
+	reader.Read(m_scale);
+	MarkDirty();
 }
 
 void Transform::Start()
@@ -18,7 +37,8 @@ void Transform::Start()
 
 DirectX::XMFLOAT3 Transform::GetForward()
 {
-	XMVECTOR forwardVec = XMVector3Rotate(XMVectorSet(0, 0, 1, 0), XMLoadFloat4(&m_rotation));
+	XMFLOAT4 rotation = GetWorldRotation();
+	XMVECTOR forwardVec = XMVector3Rotate(XMVectorSet(0, 0, 1, 0), XMLoadFloat4(&rotation));
 	XMFLOAT3 forward;
 	XMStoreFloat3(&forward, forwardVec);
 	return forward;
@@ -26,28 +46,41 @@ DirectX::XMFLOAT3 Transform::GetForward()
 
 DirectX::XMFLOAT3 Transform::GetRight()
 {
-	XMVECTOR rightVec = XMVector3Rotate(XMVectorSet(-1, 0, 0, 0), XMLoadFloat4(&m_rotation));
+	XMFLOAT4 rotation = GetWorldRotation();
+	XMVECTOR rightVec = XMVector3Rotate(XMVectorSet(-1, 0, 0, 0), XMLoadFloat4(&rotation));
 	XMFLOAT3 right;
 	XMStoreFloat3(&right, rightVec);
 	return right;
 }
 
+void Transform::MarkDirty()
+{
+	m_worldDirty = true;
+	m_localVersion++;
+	if (m_hierarchy) {
+		m_hierarchy->Queue(this);
+	}
+
+	// Moving a sleeping Entity wakes it
+	GetOwner()->Wake();
+}
+
 void Transform::SetPosition(DirectX::XMFLOAT3 position)
 {
 	m_position = position;
-	m_worldDirty = true;
+	MarkDirty();
 }
 
 void Transform::SetScale(DirectX::XMFLOAT3 scale)
 {
 	m_scale = scale;
-	m_worldDirty = true;
+	MarkDirty();
 }
 
 void Transform::SetRotation(XMFLOAT4 rotation)
 {
 	m_rotation = rotation;
-	m_worldDirty = true;
+	MarkDirty();
 }
 
 void Transform::Translate(DirectX::XMFLOAT3 translation)
@@ -55,7 +88,7 @@ void Transform::Translate(DirectX::XMFLOAT3 translation)
 	XMVECTOR position = XMLoadFloat3(&m_position);
 	position += XMLoadFloat3(&translation);
 	XMStoreFloat3(&m_position, position);
-	m_worldDirty = true;
+	MarkDirty();
 }
 
 void Transform::Scale(DirectX::XMFLOAT3 scaleAmt)
@@ -63,7 +96,7 @@ void Transform::Scale(DirectX::XMFLOAT3 scaleAmt)
 	XMVECTOR scale = XMLoadFloat3(&m_scale);
 	scale += XMLoadFloat3(&scaleAmt);
 	XMStoreFloat3(&m_scale, scale);
-	m_worldDirty = true;
+	MarkDirty();
 }
 
 void Transform::Rotate(DirectX::XMFLOAT4 rotationAmt)
@@ -71,22 +104,123 @@ void Transform::Rotate(DirectX::XMFLOAT4 rotationAmt)
 	XMVECTOR rotation = XMLoadFloat4(&m_rotation);
 	XMVECTOR newRotation = XMQuaternionMultiply(rotation, XMLoadFloat4(&rotationAmt));
 	XMStoreFloat4(&m_rotation, newRotation);
-	m_worldDirty = true;
+	MarkDirty();
 }
 
-void Transform::RecalculateWorldMatrix(bool force)
+namespace
 {
-	if (force || m_worldDirty) {
+	// Computes a world matrix from scratch by walking up the parents,
+	// for when cached world matrices might be out of date
+	XMMATRIX ComputeWorldMatrix(Transform* transform)
+	{
+		XMMATRIX world = XMMatrixIdentity();
+		for (; transform; transform = transform->GetParent()) {
+			XMFLOAT3 position = transform->GetPosition();
+			XMFLOAT4 rotation = transform->GetRotation();
+			XMFLOAT3 scale = transform->GetScale();
+			world = world * XMMatrixAffineTransformation(XMLoadFloat3(&scale), XMVectorZero(), XMLoadFloat4(&rotation), XMLoadFloat3(&position));
+		}
+		return world;
+	}
+}
+
+bool Transform::SetParent(Transform* parent, bool keepWorld)
+{
+	if (parent == m_parent) {
+		return true;
+	}
+	for (Transform* ancestor = parent; ancestor; ancestor = ancestor->m_parent) {
+		if (ancestor == this) {
+			return false;
+		}
+	}
+
+	if (keepWorld) {
+		// Express the current world transform relative to the new parent
+		XMMATRIX local = ComputeWorldMatrix(this);
+		if (parent) {
+			local = local * XMMatrixInverse(nullptr, ComputeWorldMatrix(parent));
+		}
+		XMVECTOR scale, rotation, position;
+		if (XMMatrixDecompose(&scale, &rotation, &position, local)) {
+			XMStoreFloat3(&m_scale, scale);
+			XMStoreFloat4(&m_rotation, rotation);
+			XMStoreFloat3(&m_position, position);
+		}
+	}
+
+	if (m_parent) {
+		m_parent->RemoveChild(this);
+	}
+	m_parent = parent;
+	if (parent) {
+		parent->m_children.push_back(this);
+		m_parentVersion = parent->m_worldVersion;
+	}
+	SetDepth(parent ? parent->m_depth + 1 : 0);
+	MarkDirty();
+	return true;
+}
+
+void Transform::RemoveChild(Transform* child)
+{
+	for (size_t i = 0; i < m_children.size(); ++i) {
+		if (m_children[i] == child) {
+			m_children[i] = m_children.back();
+			m_children.pop_back();
+			return;
+		}
+	}
+}
+
+void Transform::SetDepth(int depth)
+{
+	if (depth == m_depth) {
+		return;
+	}
+
+	// Move to the right level of the hierarchy so parents stay ahead of their children
+	if (m_hierarchy) {
+		m_hierarchy->Erase(this);
+		m_depth = depth;
+		m_hierarchy->Insert(this);
+	}
+	else {
+		m_depth = depth;
+	}
+	for (Transform* child : m_children) {
+		child->SetDepth(depth + 1);
+	}
+}
+
+bool Transform::RecalculateWorldMatrix(bool force)
+{
+	if (force || NeedsWorldUpdate()) {
 		XMMATRIX translation = XMMatrixTranslationFromVector(XMLoadFloat3(&m_position));
 		XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&m_rotation));
 		XMMATRIX scale = XMMatrixScalingFromVector(XMLoadFloat3(&m_scale));
 
 		XMMATRIX newWorld = scale * rotation * translation;
 
+		if (m_parent) {
+			// The parent's world matrix is stored transposed as well
+			newWorld = newWorld * XMMatrixTranspose(XMLoadFloat4x4(&m_parent->m_world));
+			XMStoreFloat3(&m_worldPosition, newWorld.r[3]);
+			XMStoreFloat4(&m_worldRotation, XMQuaternionMultiply(XMLoadFloat4(&m_rotation), XMLoadFloat4(&m_parent->m_worldRotation)));
+			m_parentVersion = m_parent->m_worldVersion;
+		}
+		else {
+			m_worldPosition = m_position;
+			m_worldRotation = m_rotation;
+		}
+
 		XMStoreFloat4x4(&m_world, XMMatrixTranspose(newWorld));
 
 		m_worldDirty = false;
+		m_worldVersion++;
+		return true;
 	}
+	return false;
 }
 
 void Transform::Tick(float deltaTime)
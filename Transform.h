@@ -2,18 +2,63 @@
 #include "Component.h"
 #include "Mesh.h" // TODO turn Mesh into a component
 #include "Material.h"
+#include "SmallVector.h"
+#include <cstdint>
+class TransformHierarchy;
+
 // --------------------------------------------------------
 // Transform Component. Maintains position, rotation, and scale.
+// Position, rotation and scale are relative to the parent 
+// Transform if there is one, and to the world otherwise.
+// Only change Transforms on the main thread. Changes queue the
+// Transform on the World's hierarchy and wake its Entity, and
+// neither is locked.
 // --------------------------------------------------------
 class Transform : public Component
 {
+	friend class TransformHierarchy;
 private:
+	static const size_t NOT_QUEUED = (size_t)-1;
+
 	DirectX::XMFLOAT4X4 m_world;
 	DirectX::XMFLOAT3 m_position;
 	DirectX::XMFLOAT3 m_scale;
 	DirectX::XMFLOAT4 m_rotation;
 
+	// World space position and rotation as of the last world matrix update
+	DirectX::XMFLOAT3 m_worldPosition;
+	DirectX::XMFLOAT4 m_worldRotation;
+
 	bool m_worldDirty = true;
+
+	Transform* m_parent = nullptr;
+	SmallVector<Transform*, 4> m_children;
+	int m_depth = 0;
+
+	// Where this Transform lives in the World's hierarchy, if it's been spawned
+	TransformHierarchy* m_hierarchy = nullptr;
+	size_t m_hierarchyIndex = 0;
+	size_t m_dirtyIndex = NOT_QUEUED; // Place in the hierarchy's update queue
+
+	// Incremented each time the world matrix changes. Children compare their 
+	// parent's version against the one they last saw to know when to update.
+	uint32_t m_worldVersion = 0;
+	uint32_t m_parentVersion = 0;
+
+	// Incremented each time the local position, rotation, scale or parent changes
+	uint32_t m_localVersion = 0;
+
+	// --------------------------------------------------------
+	// Flags the world matrix for recalculation, queues it with the
+	// hierarchy, and wakes the owner if it's asleep
+	// --------------------------------------------------------
+	void MarkDirty();
+
+	// Whether the world matrix is out of date with the local values or the parent
+	bool NeedsWorldUpdate() { return m_worldDirty || (m_parent && m_parent->m_worldVersion != m_parentVersion); }
+
+	void SetDepth(int depth);
+	void RemoveChild(Transform* child);
 public:
 	Transform(Entity* entity);
 
@@ -24,13 +69,46 @@ public:
 	DirectX::XMFLOAT4X4 GetWorldMatrix() { return m_world; }
 
 	// --------------------------------------------------------
-	// Returns the forward vector of this entity
+	// World space position and rotation. For Transforms with a parent
+	// these are as of the last world matrix update.
+	// --------------------------------------------------------
+	DirectX::XMFLOAT3 GetWorldPosition() { return m_parent ? m_worldPosition : m_position; }
+	DirectX::XMFLOAT4 GetWorldRotation() { return m_parent ? m_worldRotation : m_rotation; }
+
+	// --------------------------------------------------------
+	// Returns a number that changes every time the world matrix does
+	// --------------------------------------------------------
+	uint32_t GetWorldVersion() { return m_worldVersion; }
+
+	// --------------------------------------------------------
+	// Returns a number that changes every time the local values or parent
+	// do, without waiting for the world matrix to be recalculated
+	// --------------------------------------------------------
+	uint32_t GetLocalVersion() { return m_localVersion; }
+
+	Transform* GetParent() { return m_parent; }
+	const SmallVector<Transform*, 4>& GetChildren() { return m_children; }
+
+	// --------------------------------------------------------
+	// Attaches this Transform to another, or detaches it when parent is null.
+	// Destroying a parent also destroys its children.
+	// Rigidbodies are simulated in world space, so entities with a
+	// RigidBodyComponent should not be given a parent.
+	// @param Transform * parent
+	// @param bool keepWorld keep the current world position, rotation and scale
+	// by adjusting the local ones. Otherwise the local values are kept as they are.
+	// @returns bool false if parent is a descendant of this Transform
+	// --------------------------------------------------------
+	bool SetParent(Transform* parent, bool keepWorld = true);
+
+	// --------------------------------------------------------
+	// Returns the world space forward vector of this entity
 	// @returns DirectX::XMFLOAT3
 	// --------------------------------------------------------
 	DirectX::XMFLOAT3 GetForward();
 
 	// --------------------------------------------------------
-	// Returns the right vector of this entity
+	// Returns the world space right vector of this entity
 	// @returns DirectX::XMFLOAT3
 	// --------------------------------------------------------
 	DirectX::XMFLOAT3 GetRight();
@@ -62,14 +140,20 @@ public:
 
 	// --------------------------------------------------------
 	// Recalculates the world matrix. Call this before drawing and after updating.
+	// The parent's world matrix must already be up to date; the World's
+	// TransformHierarchy updates every spawned Transform in that order.
 	// @param bool force Force an update to occur even if the world matrix isn't dirty
-	// @returns void
+	// @returns bool whether the world matrix was recalculated
 	// --------------------------------------------------------
-	void RecalculateWorldMatrix(bool force = false);
+	bool RecalculateWorldMatrix(bool force = false);
 
 	virtual void Start() override;
 
 	virtual void Tick(float deltaTime) override;
 
+	virtual bool CanSleep() override { return true; }
+
+	virtual void SaveState(SnapshotWriter& writer) override;
+	virtual void LoadState(SnapshotReader& reader) override;
 };
 
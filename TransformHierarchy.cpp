@@ -0,0 +1,187 @@
+#include "TransformHierarchy.h"
+#include "Transform.h"
+#include "Entity.h"
+#include "JobSystem.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Transforms per ParallelFor chunk. Small levels are done inline.
+	const size_t GRAIN_SIZE = 1024;
+}
+
+void TransformHierarchy::Insert(Transform* transform)
+{
+	size_t depth = (size_t)transform->m_depth;
+	if (depth >= m_levels.size()) {
+		m_levels.resize(depth + 1);
+	}
+	std::vector<Transform*>& level = m_levels[depth].transforms;
+	transform->m_hierarchyIndex = level.size();
+	level.push_back(transform);
+}
+
+void TransformHierarchy::Erase(Transform* transform)
+{
+	// A Transform is queued again by whatever moves it, or by its parent
+	Unqueue(transform);
+
+	// Swap the last transform in the level into this one's place
+	std::vector<Transform*>& level = m_levels[transform->m_depth].transforms;
+	Transform* last = level.back();
+	level[transform->m_hierarchyIndex] = last;
+	last->m_hierarchyIndex = transform->m_hierarchyIndex;
+	level.pop_back();
+}
+
+void TransformHierarchy::Queue(Transform* transform)
+{
+	if (transform->m_dirtyIndex != Transform::NOT_QUEUED) {
+		return;
+	}
+	std::vector<Transform*>& dirty = m_levels[transform->m_depth].dirty;
+	transform->m_dirtyIndex = dirty.size();
+	dirty.push_back(transform);
+}
+
+void TransformHierarchy::Unqueue(Transform* transform)
+{
+	if (transform->m_dirtyIndex == Transform::NOT_QUEUED) {
+		return;
+	}
+	std::vector<Transform*>& dirty = m_levels[transform->m_depth].dirty;
+	Transform* last = dirty.back();
+	dirty[transform->m_dirtyIndex] = last;
+	last->m_dirtyIndex = transform->m_dirtyIndex;
+	dirty.pop_back();
+	transform->m_dirtyIndex = Transform::NOT_QUEUED;
+}
+
+void TransformHierarchy::Add(Transform* transform)
+{
+	Insert(transform);
+	transform->m_hierarchy = this;
+	Queue(transform);
+	m_count++;
+}
+
+void TransformHierarchy::Remove(Transform* transform)
+{
+	Erase(transform);
+	transform->m_hierarchy = nullptr;
+	m_count--;
+}
+
+void TransformHierarchy::ComposeBatch(Transform* const* batch, size_t count)
+{
+	// Unused lanes repeat the first Transform and are never written back
+	Transform* t[4];
+	for (size_t i = 0; i < 4; ++i) {
+		t[i] = batch[i < count ? i : 0];
+	}
+
+	// Transpose the AoS values so each vector holds one component of all four
+	XMMATRIX q = XMMatrixTranspose(XMMATRIX(
+		XMLoadFloat4(&t[0]->m_rotation), XMLoadFloat4(&t[1]->m_rotation),
+		XMLoadFloat4(&t[2]->m_rotation), XMLoadFloat4(&t[3]->m_rotation)));
+	XMMATRIX s = XMMatrixTranspose(XMMATRIX(
+		XMLoadFloat3(&t[0]->m_scale), XMLoadFloat3(&t[1]->m_scale),
+		XMLoadFloat3(&t[2]->m_scale), XMLoadFloat3(&t[3]->m_scale)));
+	XMMATRIX p = XMMatrixTranspose(XMMATRIX(
+		XMLoadFloat3(&t[0]->m_position), XMLoadFloat3(&t[1]->m_position),
+		XMLoadFloat3(&t[2]->m_position), XMLoadFloat3(&t[3]->m_position)));
+
+	// Scale * rotation, expanded the same way as XMMatrixRotationQuaternion
+	XMVECTOR one = XMVectorSplatOne();
+	XMVECTOR x = q.r[0], y = q.r[1], z = q.r[2], w = q.r[3];
+	XMVECTOR x2 = x + x, y2 = y + y, z2 = z + z;
+	XMVECTOR xx = x * x2, yy = y * y2, zz = z * z2;
+	XMVECTOR xy = x * y2, xz = x * z2, yz = y * z2;
+	XMVECTOR wx = w * x2, wy = w * y2, wz = w * z2;
+
+	XMVECTOR m00 = (one - (yy + zz)) * s.r[0];
+	XMVECTOR m01 = (xy + wz) * s.r[0];
+	XMVECTOR m02 = (xz - wy) * s.r[0];
+	XMVECTOR m10 = (xy - wz) * s.r[1];
+	XMVECTOR m11 = (one - (xx + zz)) * s.r[1];
+	XMVECTOR m12 = (yz + wx) * s.r[1];
+	XMVECTOR m20 = (xz + wy) * s.r[2];
+	XMVECTOR m21 = (yz - wx) * s.r[2];
+	XMVECTOR m22 = (one - (xx + yy)) * s.r[2];
+
+	// World matrices are stored transposed, so each stored row is a column 
+	// of scale * rotation * translation. Transposing back gives one row per Transform.
+	XMMATRIX row0 = XMMatrixTranspose(XMMATRIX(m00, m10, m20, p.r[0]));
+	XMMATRIX row1 = XMMatrixTranspose(XMMATRIX(m01, m11, m21, p.r[1]));
+	XMMATRIX row2 = XMMatrixTranspose(XMMATRIX(m02, m12, m22, p.r[2]));
+
+	for (size_t i = 0; i < count; ++i) {
+		Transform* transform = t[i];
+		XMMATRIX local = XMMATRIX(row0.r[i], row1.r[i], row2.r[i], g_XMIdentityR3);
+		Transform* parent = transform->m_parent;
+		if (parent) {
+			// Transposed, local * parent becomes parent * local
+			XMMATRIX world = XMMatrixMultiply(XMLoadFloat4x4(&parent->m_world), local);
+			XMStoreFloat4x4(&transform->m_world, world);
+			transform->m_worldPosition = XMFLOAT3(transform->m_world._14, transform->m_world._24, transform->m_world._34);
+			XMStoreFloat4(&transform->m_worldRotation, XMQuaternionMultiply(
+				XMLoadFloat4(&transform->m_rotation), XMLoadFloat4(&parent->m_worldRotation)));
+			transform->m_parentVersion = parent->m_worldVersion;
+		}
+		else {
+			XMStoreFloat4x4(&transform->m_world, local);
+			transform->m_worldPosition = transform->m_position;
+			transform->m_worldRotation = transform->m_rotation;
+		}
+		transform->m_worldDirty = false;
+		transform->m_worldVersion++;
+	}
+}
+
+void TransformHierarchy::ComposeRange(const std::vector<Transform*>& dirty, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i += 4) {
+		ComposeBatch(&dirty[i], end - i < 4 ? end - i : 4);
+	}
+}
+
+size_t TransformHierarchy::Update(JobSystem* jobs, std::vector<Transform*>* changed)
+{
+	// Every parent is a level ahead of its children, so each level 
+	// only reads world matrices that are already finished
+	size_t recalculated = 0;
+	for (size_t depth = 0; depth < m_levels.size(); ++depth) {
+		std::vector<Transform*>& dirty = m_levels[depth].dirty;
+		if (dirty.empty()) {
+			continue;
+		}
+
+		if (jobs) {
+			jobs->ParallelFor(dirty.size(), GRAIN_SIZE, [&](size_t begin, size_t end) {
+				ComposeRange(dirty, begin, end);
+			});
+		}
+		else {
+			ComposeRange(dirty, 0, dirty.size());
+		}
+
+		// Children of anything that moved need updating on the next level,
+		// and are woken since they moved too
+		for (Transform* transform : dirty) {
+			transform->m_dirtyIndex = Transform::NOT_QUEUED;
+			for (Transform* child : transform->m_children) {
+				if (child->m_hierarchy == this) {
+					Queue(child);
+				}
+				child->GetOwner()->Wake();
+			}
+		}
+		if (changed) {
+			changed->insert(changed->end(), dirty.begin(), dirty.end());
+		}
+		recalculated += dirty.size();
+		dirty.clear();
+	}
+	return recalculated;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+class Transform;
+class JobSystem;
+
+// --------------------------------------------------------
+// Every spawned Transform, grouped by depth in the hierarchy.
+// Parents are always in an earlier level than their children,
+// so world matrices can be brought up to date in one linear pass.
+// Changed Transforms are queued on their level, so Transforms that
+// don't move cost nothing.
+// --------------------------------------------------------
+class TransformHierarchy
+{
+	friend class Transform;
+private:
+	struct Level
+	{
+		std::vector<Transform*> transforms;
+		std::vector<Transform*> dirty; // Queued for a world matrix update
+	};
+
+	std::vector<Level> m_levels;
+	size_t m_count = 0;
+
+	void Insert(Transform* transform);
+	void Erase(Transform* transform);
+
+	// --------------------------------------------------------
+	// Queues a Transform's world matrix to be recalculated, or takes it off the queue.
+	// Not locked, so only the main thread may queue.
+	// --------------------------------------------------------
+	void Queue(Transform* transform);
+	void Unqueue(Transform* transform);
+
+	// --------------------------------------------------------
+	// Recalculates the world matrices of part of a level's queue
+	// --------------------------------------------------------
+	static void ComposeRange(const std::vector<Transform*>& dirty, size_t begin, size_t end);
+
+	// --------------------------------------------------------
+	// Composes world matrices for up to four Transforms at once,
+	// with each SIMD lane working on a different Transform
+	// --------------------------------------------------------
+	static void ComposeBatch(Transform* const* batch, size_t count);
+public:
+	// --------------------------------------------------------
+	// Adds or removes a single Transform. Children are not included.
+	// --------------------------------------------------------
+	void Add(Transform* transform);
+	void Remove(Transform* transform);
+
+	// --------------------------------------------------------
+	// Recalculates the world matrix of every Transform that changed, 
+	// or whose parent's world matrix changed, parents first.
+	// Each level is split across the job system's workers when given one.
+	// @param std::vector<Transform*> * changed if given, the recalculated Transforms are appended to it
+	// @returns size_t how many world matrices were recalculated
+	// --------------------------------------------------------
+	size_t Update(JobSystem* jobs = nullptr, std::vector<Transform*>* changed = nullptr);
+
+	size_t GetCount() const { return m_count; }
+	size_t GetDepth() const { return m_levels.size(); }
+};
@@ -0,0 +1,21 @@
+#include "TransformMotionState.h"
+#include "Transform.h"
+
+using namespace DirectX;
+
+void TransformMotionState::getWorldTransform(btTransform& worldTrans) const
+{
+	// Bullet does not support scale, so it's left out
+	XMFLOAT3 pos = m_transform->GetPosition();
+	XMFLOAT4 rot = m_transform->GetRotation();
+	worldTrans.setOrigin(btVector3(pos.x, pos.y, pos.z));
+	worldTrans.setRotation(btQuaternion(rot.x, rot.y, rot.z, rot.w));
+}
+
+void TransformMotionState::setWorldTransform(const btTransform& worldTrans)
+{
+	btVector3 origin = worldTrans.getOrigin();
+	btQuaternion rotation = worldTrans.getRotation();
+	m_transform->SetPosition(XMFLOAT3(origin.x(), origin.y(), origin.z()));
+	m_transform->SetRotation(XMFLOAT4(rotation.x(), rotation.y(), rotation.z(), rotation.w()));
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <bullet/btBulletDynamicsCommon.h>
+class Transform;
+
+// --------------------------------------------------------
+// Connects a Bullet rigid body to a Transform. Bullet reads the 
+// Transform when the body is created and for every step a kinematic 
+// body is awake, and writes it back only for dynamic bodies that 
+// moved, so sleeping bodies never dirty their Transform.
+// --------------------------------------------------------
+class TransformMotionState : public btMotionState
+{
+private:
+	Transform* m_transform;
+public:
+	TransformMotionState(Transform* transform) : m_transform(transform) { }
+
+	virtual void getWorldTransform(btTransform& worldTrans) const override;
+	virtual void setWorldTransform(const btTransform& worldTrans) override;
+};
@@ -0,0 +1,162 @@
+#include "TriggerComponent.h"
+#include "Entity.h"
+#include "WorldSnapshot.h"
+#include "SceneArchive.h"
+
+using namespace DirectX;
+
+bool TriggerComponent::Overlap::operator<(const Overlap& other) const
+{
+	if (object != other.object) {
+		return object < other.object;
+	}
+	if (entity.index != other.entity.index) {
+		return entity.index < other.entity.index;
+	}
+	return entity.generation < other.entity.generation;
+}
+
+void TriggerComponent::SetBox(float halfX, float halfY, float halfZ)
+{
+	SetShape(ShapeDesc::Box(halfX, halfY, halfZ));
+}
+
+void TriggerComponent::SetSphere(float radius)
+{
+	SetShape(ShapeDesc::Sphere(radius));
+}
+
+void TriggerComponent::SetShape(const ShapeDesc& desc)
+{
+	CollisionShapeCache* cache = World::GetInstance()->GetShapeCache();
+	btCollisionShape* shape = cache->Acquire(desc);
+	if (m_shape) {
+		cache->Release(m_shape);
+	}
+	m_shape = shape;
+	m_shapeDesc = desc;
+}
+
+void TriggerComponent::SetCollisionLayer(const std::string& name)
+{
+	CollisionLayers* layers = World::GetInstance()->GetCollisionLayers();
+	int layer = layers->CreateLayer(name);
+	if (layer < 0) {
+		return;
+	}
+	m_layer = layer;
+	if (m_ghost) {
+		layers->SetObjectLayer(m_ghost, layer);
+	}
+}
+
+void TriggerComponent::GetOverlapping(std::vector<EntityHandle>& results)
+{
+	for (const Overlap& overlap : m_overlaps) {
+		if (overlap.entity.IsValid()) {
+			results.push_back(overlap.entity);
+		}
+	}
+}
+
+uint32_t TriggerComponent::GetTransformVersion()
+{
+	// Attached triggers follow the world matrix, and roots follow their own values
+	Transform* transform = GetOwner()->GetTransform();
+	return transform->GetParent() ? transform->GetWorldVersion() : transform->GetLocalVersion();
+}
+
+void TriggerComponent::SyncTransform()
+{
+	Transform* transform = GetOwner()->GetTransform();
+	XMFLOAT3 pos = transform->GetWorldPosition();
+	XMFLOAT4 rot = transform->GetWorldRotation();
+	m_ghost->setWorldTransform(btTransform(btQuaternion(rot.x, rot.y, rot.z, rot.w), btVector3(pos.x, pos.y, pos.z)));
+	m_syncedVersion = GetTransformVersion();
+}
+
+void TriggerComponent::Start()
+{
+	if (!m_shape) {
+		throw "Use SetBox, SetSphere or SetShape to give a trigger a shape";
+	}
+
+	m_ghost = new btPairCachingGhostObject();
+	m_ghost->setCollisionShape(m_shape);
+	m_ghost->setCollisionFlags(m_ghost->getCollisionFlags() | btCollisionObject::CF_NO_CONTACT_RESPONSE);
+	m_ghost->setUserPointer((void*)GetOwner());
+	SyncTransform();
+
+	World* world = World::GetInstance();
+	CollisionLayers* layers = world->GetCollisionLayers();
+	world->GetPhysicsWorld()->addCollisionObject(m_ghost, layers->GetGroup(m_layer), layers->GetMask(m_layer));
+	world->AddTrigger(this);
+}
+
+void TriggerComponent::Tick(float deltaTime)
+{
+	// Only move the ghost when its Transform moved
+	if (GetTransformVersion() != m_syncedVersion) {
+		SyncTransform();
+		World::GetInstance()->GetPhysicsWorld()->updateSingleAabb(m_ghost);
+	}
+}
+
+void TriggerComponent::SaveState(SnapshotWriter& writer)
+{
+	// Overlapping objects are always rigid bodies, so the Entity is enough to find them again
+	writer.Write((uint32_t)m_overlaps.size());
+	for (const Overlap& overlap : m_overlaps) {
+		writer.Write(overlap.entity);
+	}
+}
+
+void TriggerComponent::LoadState(SnapshotReader& reader)
+{
+	uint32_t count = 0;
+	reader.Read(count);
+	m_overlaps.clear();
+	for (uint32_t i = 0; i < count; ++i) {
+		EntityHandle handle;
+		if (!reader.Read(handle)) {
+			break;
+		}
+		Entity* entity = handle.Get();
+		if (entity && entity->GetRigidBody() && entity->GetRigidBody()->GetBody()) {
+			m_overlaps.push_back({ entity->GetRigidBody()->GetBody(), handle });
+		}
+	}
+	std::sort(m_overlaps.begin(), m_overlaps.end());
+}
+
+void TriggerComponent::Serialize(SceneArchive& archive)
+{
+	CollisionLayers* layers = World::GetInstance()->GetCollisionLayers();
+	std::string layer = archive.IsLoading() ? std::string() : layers->GetLayerName(m_layer);
+	ShapeDesc shape = m_shapeDesc;
+	bool hasShape = m_shape != nullptr;
+
+	archive.Field("layer", layer);
+	shape.Serialize(archive, hasShape);
+
+	if (archive.IsLoading()) {
+		if (!layer.empty()) {
+			SetCollisionLayer(layer);
+		}
+		if (hasShape) {
+			SetShape(shape);
+		}
+	}
+}
+
+TriggerComponent::~TriggerComponent()
+{
+	World* world = World::GetInstance();
+	if (m_ghost) {
+		world->RemoveTrigger(this);
+		delete m_ghost;
+	}
+	if (m_shape) {
+		world->GetShapeCache()->Release(m_shape);
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "Component.h"
+#include "CollisionShapeCache.h"
+#include "CollisionLayers.h"
+#include <bullet/BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <vector>
+#include <cstdint>
+
+// --------------------------------------------------------
+// Volume that reports when colliders enter and leave it, through
+// OnTriggerEnter and OnTriggerExit on both Entities' components.
+// Overlaps are found by the broadphase, so they're based on the 
+// colliders' bounding boxes, and no contacts are ever generated.
+// --------------------------------------------------------
+class TriggerComponent : public Component
+{
+	friend class World;
+private:
+	struct Overlap
+	{
+		const btCollisionObject* object;
+		EntityHandle entity;
+
+		bool operator<(const Overlap& other) const;
+		bool operator==(const Overlap& other) const { return object == other.object && entity == other.entity; }
+	};
+
+	btCollisionShape* m_shape = nullptr; // Shared, from the World's shape cache
+	btPairCachingGhostObject* m_ghost = nullptr;
+	int m_layer = CollisionLayers::DEFAULT_LAYER;
+
+	// The shape given to SetShape, kept for scene files
+	ShapeDesc m_shapeDesc;
+
+	// Version of the Transform the ghost was last moved to
+	uint32_t m_syncedVersion = 0;
+
+	// Overlaps as of the last update, sorted
+	std::vector<Overlap> m_overlaps;
+	std::vector<Overlap> m_current;
+
+	// The World's list of triggers
+	size_t m_triggerIndex = 0;
+
+	uint32_t GetTransformVersion();
+	void SyncTransform();
+public:
+	TriggerComponent(Entity* entity) : Component(entity) { }
+
+	// --------------------------------------------------------
+	// Sets the shape of the volume. Call before Start.
+	// --------------------------------------------------------
+	void SetBox(float halfX, float halfY, float halfZ);
+	void SetSphere(float radius);
+	void SetShape(const ShapeDesc& desc);
+
+	// --------------------------------------------------------
+	// Puts this trigger on a collision layer, so it only notices
+	// colliders on layers that collide with it
+	// --------------------------------------------------------
+	void SetCollisionLayer(const std::string& name);
+	int GetCollisionLayer() { return m_layer; }
+
+	// --------------------------------------------------------
+	// Returns the Entities currently inside the volume
+	// --------------------------------------------------------
+	void GetOverlapping(std::vector<EntityHandle>& results);
+
+	virtual void Start() override;
+	virtual void Tick(float deltaTime) override;
+
+	virtual bool CanSleep() override { return true; }
+
+	virtual void SaveState(SnapshotWriter& writer) override;
+	virtual void LoadState(SnapshotReader& reader) override;
+
+	virtual void Serialize(SceneArchive& archive) override;
+
+	virtual ~TriggerComponent();
+};
@@ -0,0 +1,45 @@
+// Instanced variant of VertexShader.hlsl
+// - The world matrix comes from a per-instance vertex buffer instead
+//    of the constant buffer, so many entities sharing a mesh and
+//    material can be drawn with a single DrawIndexedInstanced call
+// - SimpleShader sees the "_PER_INSTANCE" semantic and reads it from
+//    input slot 1 with a per-instance step rate
+cbuffer externalData : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+struct VertexShaderInput
+{
+	float3 position		: POSITION;     // XYZ position
+	float2 uv			: TEXCOORD;
+	float3 normal		: NORMAL;
+	float3 tangent		: TANGENT;
+	float4x4 world		: WORLD_PER_INSTANCE; // One row per element, untransposed
+};
+
+// Must match VertexShader.hlsl so both can share PixelShader.hlsl
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv			: TEXCOORD;
+	float3 normal		: NORMAL;
+	float3 tangent		: TANGENT;
+	float3 worldPos		: POSITION;
+};
+
+VertexToPixel main(VertexShaderInput input)
+{
+	VertexToPixel output;
+
+	matrix worldViewProj = mul(mul(input.world, view), projection);
+
+	output.position = mul(float4(input.position, 1.0f), worldViewProj);
+	output.normal = normalize(mul(input.normal, (float3x3)input.world));
+	output.tangent = normalize(mul(input.tangent, (float3x3)input.world));
+	output.worldPos = mul(float4(input.position, 1.0f), input.world).xyz;
+	output.uv = input.uv;
+
+	return output;
+}
@@ -4,13 +4,123 @@
 #include "Entity.h"
 #include <algorithm>
 #include <iostream>
+#include <cassert>
+#include <cstdlib>
 #include <WICTextureLoader.h>
 #include "DDSTextureLoader.h"
 #include "RigidBodyComponent.h"
 #include "UITextComponent.h"
+#include "Prefab.h"
+#include "TriggerComponent.h"
+#include <fstream>
+#include <memory>
 
 using namespace DirectX;
 
+namespace
+{
+	// Ghost objects only need their broadphase pairs, so skip the narrowphase for them
+	void SkipGhostsNearCallback(btBroadphasePair& pair, btCollisionDispatcher& dispatcher, const btDispatcherInfo& info)
+	{
+		const btCollisionObject* object0 = static_cast<btCollisionObject*>(pair.m_pProxy0->m_clientObject);
+		const btCollisionObject* object1 = static_cast<btCollisionObject*>(pair.m_pProxy1->m_clientObject);
+		if (object0->getInternalType() == btCollisionObject::CO_GHOST_OBJECT || 
+			object1->getInternalType() == btCollisionObject::CO_GHOST_OBJECT) {
+			return;
+		}
+		btCollisionDispatcher::defaultNearCallback(pair, dispatcher, info);
+	}
+
+	// Command buffers that no unregistered thread holds. Never destroyed,
+	// so threads that exit while the World shuts down can still give theirs back.
+	struct SpareCommandBuffers
+	{
+		SpinLock lock;
+		std::vector<int> indices;
+	};
+
+	SpareCommandBuffers& GetSpareCommandBuffers()
+	{
+		static SpareCommandBuffers* spares = new SpareCommandBuffers();
+		return *spares;
+	}
+
+	void SetSpareCommandBuffers(int first, int end)
+	{
+		SpareCommandBuffers& spares = GetSpareCommandBuffers();
+		std::lock_guard<SpinLock> lock(spares.lock);
+		spares.indices.clear();
+		for (int i = first; i < end; ++i) {
+			spares.indices.push_back(i);
+		}
+	}
+
+	// Holds an unregistered thread's buffer, and gives it back when the thread exits.
+	// Commands still in the buffer are applied by the next Flush as usual.
+	struct CommandBufferLease
+	{
+		int index = -1;
+
+		void Release()
+		{
+			if (index < 0) {
+				return;
+			}
+			SpareCommandBuffers& spares = GetSpareCommandBuffers();
+			std::lock_guard<SpinLock> lock(spares.lock);
+			spares.indices.push_back(index);
+			index = -1;
+		}
+
+		~CommandBufferLease() { Release(); }
+	};
+
+	// Estimated bytes for a mesh's GPU buffers and the copies of its positions and indices
+	size_t GetMeshSize(Mesh* mesh)
+	{
+		size_t vertices = mesh->GetPositions().size();
+		size_t indices = mesh->GetIndices().size();
+		return vertices * (sizeof(Vertex) + sizeof(XMFLOAT3)) + indices * 2 * sizeof(unsigned int);
+	}
+
+	std::string ToNarrow(const std::wstring& text)
+	{
+		int length = WideCharToMultiByte(CP_ACP, 0, text.c_str(), (int)text.size(), nullptr, 0, nullptr, nullptr);
+		std::string narrow(length, '\0');
+		WideCharToMultiByte(CP_ACP, 0, text.c_str(), (int)text.size(), &narrow[0], length, nullptr, nullptr);
+		return narrow;
+	}
+
+	// Estimated bytes for a texture and its mips, at 4 bytes a texel
+	size_t GetTextureSize(ID3D11ShaderResourceView* srv)
+	{
+		if (!srv) {
+			return 0;
+		}
+		ID3D11Resource* resource = nullptr;
+		srv->GetResource(&resource);
+		ID3D11Texture2D* texture = nullptr;
+		size_t size = 0;
+		if (resource && SUCCEEDED(resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture))) {
+			D3D11_TEXTURE2D_DESC desc;
+			texture->GetDesc(&desc);
+			size_t width = desc.Width;
+			size_t height = desc.Height;
+			for (UINT i = 0; i < desc.MipLevels; ++i) {
+				size += width * height * 4;
+				width = width > 1 ? width / 2 : 1;
+				height = height > 1 ? height / 2 : 1;
+			}
+			size *= desc.ArraySize;
+			texture->Release();
+		}
+		if (resource) {
+			resource->Release();
+		}
+		return size;
+	}
+}
+
 World::World()
 {
 	// Bullet Physics Setup. See https://github.com/bulletphysics/bullet3/blob/master/examples/HelloWorld/HelloWorld.cpp
@@ -26,9 +136,35 @@ World::World()
 	///the default constraint solver. For parallel processing you can use a different solver (see Extras/BulletMultiThreaded)
 	m_solver = new btSequentialImpulseConstraintSolver();
 
-	m_dynamicsWorld = new btDiscreteDynamicsWorld(m_dispatcher, m_overlappingPairCache, m_solver, m_collisionConfiguration);
+	m_dynamicsWorld = new SnapshotDynamicsWorld(m_dispatcher, m_overlappingPairCache, m_solver, m_collisionConfiguration);
 
 	m_dynamicsWorld->setGravity(m_gravity);
+	// Bounds of sleeping and static bodies don't change on their own, so 
+	// only refresh them for active bodies. Moved static bodies refresh their own.
+	m_dynamicsWorld->setForceUpdateAllAabbs(false);
+	m_collisionLayers.Attach(m_dynamicsWorld);
+
+	// Triggers keep their own list of overlapping pairs, and never generate contacts
+	m_overlappingPairCache->getOverlappingPairCache()->setInternalGhostPairCallback(&m_ghostPairCallback);
+	m_dispatcher->setNearCallback(&SkipGhostsNearCallback);
+
+	// Entity handle table
+	for (std::atomic<EntitySlot*>& page : m_slotPages) {
+		page.store(nullptr);
+	}
+	static_assert(1 + MAX_WORKER_THREADS + MAX_ENGINE_WORKERS < MAX_COMMAND_BUFFERS, "Unregistered threads need spare command buffers");
+	SetSpareCommandBuffers(1 + MAX_WORKER_THREADS + MAX_ENGINE_WORKERS, MAX_COMMAND_BUFFERS);
+	m_mainThread = std::this_thread::get_id();
+
+	// The job system's workers have their own range of command buffers, apart from game threads'
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	size_t workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	if (workerCount > MAX_ENGINE_WORKERS) {
+		workerCount = MAX_ENGINE_WORKERS;
+	}
+	m_jobSystem.Start(workerCount, [this](size_t workerIndex) {
+		UseCommandBuffer(1 + MAX_WORKER_THREADS + (int)workerIndex);
+	});
 
 	// FMOD sound setup
 	FMOD::System_Create(&m_soundSystem);
@@ -41,6 +177,11 @@ World* World::GetInstance()
 	return &world;
 }
 
+Entity* EntityHandle::Get() const
+{
+	return World::GetInstance()->Resolve(*this);
+}
+
 void World::RebuildLights()
 {
 	m_activeLightCount = 0;
@@ -54,56 +195,478 @@ void World::RebuildLights()
 
 void World::Flush()
 {
-	while (!m_spawnQueue.empty()) {
-		Entity* toAdd = m_spawnQueue.front();
-		toAdd->StartAllComponents();
-		m_entities.push_back(toAdd);
-		m_spawnQueue.pop();
+	// Structural changes are applied buffer by buffer, in index order,
+	// so the result doesn't depend on which thread recorded them first
+	for (CommandBuffer& buffer : m_commandBuffers) {
+		// Deferred commands may record more, so don't hold onto iterators
+		for (size_t i = 0; i < buffer.deferred.size(); ++i) {
+			std::function<void()> command = std::move(buffer.deferred[i]);
+			command();
+		}
+		buffer.deferred.clear();
 	}
 
-	while (!m_destroyQueue.empty()) {
-		Entity* toDestroy = m_destroyQueue.front();
+	// Starting components may queue more spawns, so keep going until none are left
+	bool spawned = true;
+	while (spawned) {
+		spawned = false;
+		for (CommandBuffer& buffer : m_commandBuffers) {
+			for (size_t i = 0; i < buffer.spawnBatches.size(); ++i) {
+				SpawnBatchNow(buffer.spawnQueue, buffer.spawnBatches[i]);
+				spawned = true;
+			}
+			buffer.spawnQueue.clear();
+			buffer.spawnBatches.clear();
+		}
+	}
 
-		// Remove destroyed entities from the collision map
-		for (auto it = m_collisionMap.cbegin(); it != m_collisionMap.cend(); ) {
-			auto& pair = *it;
-			Entity* e0 = static_cast<Entity*>(pair.first->getUserPointer());
-			if (toDestroy == e0) {
-				m_collisionMap.erase(it++);
-				continue;
+	for (CommandBuffer& buffer : m_commandBuffers) {
+		for (size_t i = 0; i < buffer.destroyQueue.size(); ++i) {
+			// Null if it was already destroyed earlier in the queue
+			Entity* toDestroy = Resolve(buffer.destroyQueue[i]);
+			if (toDestroy) {
+				DestroyNow(toDestroy);
 			}
-			else {
-				for (const btCollisionObject* coll : m_collisionMap[pair.first]) {
-					Entity* e1 = static_cast<Entity*>(coll->getUserPointer());
-					if (toDestroy == e1) {
-						m_collisionMap[pair.first].erase(coll);
-						break;
-					}
+		}
+		buffer.destroyQueue.clear();
+	}
+}
+
+void World::DestroyNow(Entity* toDestroy)
+{
+	// Children go down with their parent
+	Transform* transform = toDestroy->GetTransform();
+	while (!transform->GetChildren().empty()) {
+		DestroyNow(transform->GetChildren().back()->GetOwner());
+	}
+	transform->SetParent(nullptr, false);
+
+	// Forget any collisions this entity was part of
+	while (!toDestroy->m_collisionPairs.empty()) {
+		RemoveCollisionPair(toDestroy->m_collisionPairs.back());
+	}
+
+	// Take the entity's bounds out of the spatial tree
+	MeshComponent* meshComponent = toDestroy->GetMeshComponent();
+	if (meshComponent && meshComponent->GetProxyId() != DynamicBVH::NULL_NODE) {
+		m_spatialTree.DestroyProxy(meshComponent->GetProxyId());
+		meshComponent->SetProxyId(DynamicBVH::NULL_NODE);
+	}
+
+	// Rigidbodies need to be deleted separately
+	RigidBodyComponent* rb = toDestroy->GetRigidBody();
+	if (rb) {
+		btRigidBody* body = rb->GetBody();
+		if (body && body->getMotionState()) {
+			delete body->getMotionState();
+		}
+		m_dynamicsWorld->removeCollisionObject(body);
+		delete body;
+	}
+
+	// Swap the last entity into this one's place
+	if (toDestroy->m_inWorld) {
+		Entity* last = m_entities.back();
+		m_entities[toDestroy->m_denseIndex] = last;
+		last->m_denseIndex = toDestroy->m_denseIndex;
+		m_entities.pop_back();
+		if (!toDestroy->m_asleep) {
+			RemoveFromActive(toDestroy);
+		}
+		if (toDestroy->m_sleepPending) {
+			m_sleepRequests.erase(std::find(m_sleepRequests.begin(), m_sleepRequests.end(), toDestroy));
+		}
+		m_transformHierarchy.Remove(transform);
+		UnindexEntity(toDestroy);
+	}
+
+	FreeSlot(toDestroy->m_handle);
+	ObjectPool<Entity>::GetInstance().Destroy(toDestroy);
+}
+
+namespace
+{
+	// Like reserve, but keeps the vector's geometric growth when called repeatedly
+	template <class T>
+	void ReserveAtLeast(std::vector<T>& vector, size_t count)
+	{
+		if (count > vector.capacity()) {
+			vector.reserve(count > vector.capacity() * 2 ? count : vector.capacity() * 2);
+		}
+	}
+}
+
+void World::SpawnBatchNow(std::vector<Entity*>& spawnQueue, SpawnBatch batch)
+{
+	if (batch.count == 1) {
+		spawnQueue[batch.first]->StartAllComponents();
+	}
+	else {
+		// Component-major, so each component type's Start runs back to back.
+		// Within an Entity, components still start in order.
+		size_t end = batch.first + batch.count;
+		for (size_t componentIndex = 0; ; ++componentIndex) {
+			bool anyLeft = false;
+			for (size_t i = batch.first; i < end; ++i) {
+				Entity* entity = spawnQueue[i];
+				if (entity->m_hasStarted || componentIndex >= entity->m_components.size()) {
+					continue;
+				}
+				anyLeft = true;
+				Component* component = entity->m_components[componentIndex];
+				if (component->GetEnabled()) {
+					component->Start();
+				}
+			}
+			if (!anyLeft) {
+				break;
+			}
+		}
+	}
+
+	ReserveAtLeast(m_entities, m_entities.size() + batch.count);
+	ReserveAtLeast(m_activeEntities, m_activeEntities.size() + batch.count);
+	for (size_t i = batch.first; i < batch.first + batch.count; ++i) {
+		Entity* toAdd = spawnQueue[i];
+		toAdd->m_hasStarted = true;
+		toAdd->m_denseIndex = m_entities.size();
+		m_entities.push_back(toAdd);
+		toAdd->m_activeIndex = m_activeEntities.size();
+		m_activeEntities.push_back(toAdd);
+		m_transformHierarchy.Add(toAdd->GetTransform());
+		IndexEntity(toAdd);
+	}
+}
+
+EntityHandle World::AllocateSlot(Entity* entity)
+{
+	std::lock_guard<SpinLock> lock(m_slotLock);
+	EntityHandle handle;
+	if (!m_freeSlots.empty()) {
+		handle.index = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else {
+		handle.index = m_slotCount++;
+		uint32_t page = handle.index / SLOT_PAGE_SIZE;
+		if (!m_slotPages[page].load(std::memory_order_relaxed)) {
+			m_slotPages[page].store(new EntitySlot[SLOT_PAGE_SIZE], std::memory_order_release);
+		}
+	}
+	EntitySlot& slot = m_slotPages[handle.index / SLOT_PAGE_SIZE].load(std::memory_order_relaxed)[handle.index % SLOT_PAGE_SIZE];
+	slot.entity = entity;
+	handle.generation = slot.generation;
+	return handle;
+}
+
+void World::FreeSlot(EntityHandle handle)
+{
+	std::lock_guard<SpinLock> lock(m_slotLock);
+	EntitySlot& slot = m_slotPages[handle.index / SLOT_PAGE_SIZE].load(std::memory_order_relaxed)[handle.index % SLOT_PAGE_SIZE];
+	slot.entity = nullptr;
+	slot.generation++;
+	m_freeSlots.push_back(handle.index);
+}
+
+namespace
+{
+	// Index of the calling thread's command buffer, or -1 until it's first used
+	thread_local int t_commandBuffer = -1;
+	thread_local CommandBufferLease t_commandBufferLease;
+}
+
+World::CommandBuffer& World::GetCommandBuffer()
+{
+	if (t_commandBuffer < 0) {
+		if (std::this_thread::get_id() == m_mainThread) {
+			t_commandBuffer = 0;
+		}
+		else {
+			// Unregistered threads borrow a spare buffer until they exit
+			SpareCommandBuffers& spares = GetSpareCommandBuffers();
+			{
+				std::lock_guard<SpinLock> lock(spares.lock);
+				if (!spares.indices.empty()) {
+					t_commandBufferLease.index = spares.indices.back();
+					spares.indices.pop_back();
 				}
 			}
-			++it;
+			// Buffers aren't locked, so sharing one between threads would race
+			if (t_commandBufferLease.index < 0) {
+				assert(!"World: more live threads recorded commands than there are command buffers");
+				std::abort();
+			}
+			t_commandBuffer = t_commandBufferLease.index;
+		}
+	}
+	return m_commandBuffers[t_commandBuffer];
+}
+
+void World::RegisterWorkerThread(int workerIndex)
+{
+	// Any other index would share a buffer another thread writes to
+	if (workerIndex < 1 || workerIndex > MAX_WORKER_THREADS) {
+		assert(!"World: worker index out of range");
+		std::abort();
+	}
+	UseCommandBuffer(workerIndex);
+}
+
+void World::UseCommandBuffer(int index)
+{
+	t_commandBufferLease.Release();
+	t_commandBuffer = index;
+}
+
+void World::Defer(std::function<void()> command)
+{
+	GetCommandBuffer().deferred.push_back(std::move(command));
+}
+
+namespace
+{
+	// Removes an index from a small list of indices, order not preserved
+	template <class IndexList>
+	void EraseIndex(IndexList& indices, size_t index)
+	{
+		for (size_t i = 0; i < indices.size(); ++i) {
+			if (indices[i] == index) {
+				indices[i] = indices.back();
+				indices.pop_back();
+				return;
+			}
+		}
+	}
+
+	template <class IndexList>
+	void ReplaceIndex(IndexList& indices, size_t oldIndex, size_t newIndex)
+	{
+		for (size_t& index : indices) {
+			if (index == oldIndex) {
+				index = newIndex;
+				return;
+			}
+		}
+	}
+
+	// Calls a collision callback on each of an entity's enabled components
+	void DispatchCollision(Entity* entity, Entity* other, void (Component::*callback)(EntityHandle))
+	{
+		EntityHandle otherHandle = other->GetHandle();
+		for (Component* component : entity->GetAllComponents()) {
+			if (component->GetEnabled()) {
+				(component->*callback)(otherHandle);
+			}
+		}
+	}
+}
+
+size_t World::FindCollisionPair(Entity* entity, const btCollisionObject* body0, const btCollisionObject* body1)
+{
+	for (size_t index : entity->m_collisionPairs) {
+		const CollisionPair& pair = m_collisionPairs[index];
+		if ((pair.body0 == body0 && pair.body1 == body1) || (pair.body0 == body1 && pair.body1 == body0)) {
+			return index;
+		}
+	}
+	return m_collisionPairs.size();
+}
+
+size_t World::AddCollisionPair(const btCollisionObject* body0, const btCollisionObject* body1, Entity* entity0, Entity* entity1)
+{
+	size_t index = m_collisionPairs.size();
+	m_collisionPairs.push_back({ body0, body1, entity0, entity1, m_collisionFrame });
+	entity0->m_collisionPairs.push_back(index);
+	if (entity1 != entity0) {
+		entity1->m_collisionPairs.push_back(index);
+	}
+	return index;
+}
+
+void World::RemoveCollisionPair(size_t index)
+{
+	CollisionPair& pair = m_collisionPairs[index];
+	EraseIndex(pair.entity0->m_collisionPairs, index);
+	EraseIndex(pair.entity1->m_collisionPairs, index);
+
+	// Move the last pair into the hole and repoint its entities
+	size_t last = m_collisionPairs.size() - 1;
+	if (index != last) {
+		m_collisionPairs[index] = m_collisionPairs[last];
+		CollisionPair& moved = m_collisionPairs[index];
+		ReplaceIndex(moved.entity0->m_collisionPairs, last, index);
+		if (moved.entity1 != moved.entity0) {
+			ReplaceIndex(moved.entity1->m_collisionPairs, last, index);
+		}
+	}
+	m_collisionPairs.pop_back();
+}
+
+void World::UpdateTransforms()
+{
+	m_changedTransforms.clear();
+	m_transformHierarchy.Update(&m_jobSystem, &m_changedTransforms);
+}
+
+void World::RequestSleep(Entity* entity)
+{
+	entity->m_sleepPending = true;
+	m_sleepRequests.push_back(entity);
+}
+
+void World::WakeEntity(Entity* entity)
+{
+	// A pending request is skipped when it's applied
+	if (entity->m_sleepPending) {
+		entity->m_sleepPending = false;
+		m_sleepRequests.erase(std::find(m_sleepRequests.begin(), m_sleepRequests.end(), entity));
+		return;
+	}
+	entity->m_asleep = false;
+	entity->m_activeIndex = m_activeEntities.size();
+	m_activeEntities.push_back(entity);
+}
+
+void World::RemoveFromActive(Entity* entity)
+{
+	Entity* last = m_activeEntities.back();
+	m_activeEntities[entity->m_activeIndex] = last;
+	last->m_activeIndex = entity->m_activeIndex;
+	m_activeEntities.pop_back();
+}
+
+void World::ApplySleepRequests()
+{
+	for (Entity* entity : m_sleepRequests) {
+		entity->m_sleepPending = false;
+		entity->m_asleep = true;
+		RemoveFromActive(entity);
+	}
+	m_sleepRequests.clear();
+}
+
+void World::AddTrigger(TriggerComponent* trigger)
+{
+	trigger->m_triggerIndex = m_triggers.size();
+	m_triggers.push_back(trigger);
+}
+
+void World::RemoveTrigger(TriggerComponent* trigger)
+{
+	TriggerComponent* last = m_triggers.back();
+	m_triggers[trigger->m_triggerIndex] = last;
+	last->m_triggerIndex = trigger->m_triggerIndex;
+	m_triggers.pop_back();
+
+	// The physics world is already gone while the World is shutting down
+	if (m_dynamicsWorld) {
+		m_dynamicsWorld->removeCollisionObject(trigger->m_ghost);
+	}
+}
+
+namespace
+{
+	void DispatchTrigger(EntityHandle entity, EntityHandle other, void (Component::*callback)(EntityHandle))
+	{
+		Entity* target = entity.Get();
+		if (!target) {
+			return;
+		}
+		target->Wake();
+		for (Component* component : target->GetAllComponents()) {
+			if (component->GetEnabled()) {
+				(component->*callback)(other);
+			}
 		}
+	}
+}
 
+void World::UpdateTriggers()
+{
+	// Callbacks may start new triggers, so don't hold onto iterators
+	for (size_t t = 0; t < m_triggers.size(); ++t) {
+		TriggerComponent* trigger = m_triggers[t];
+		btPairCachingGhostObject* ghost = trigger->m_ghost;
+
+		// Collect what's in the ghost's pair cache, leaving out other triggers
+		std::vector<TriggerComponent::Overlap>& current = trigger->m_current;
+		current.clear();
+		btBroadphasePairArray& pairs = ghost->getOverlappingPairCache()->getOverlappingPairArray();
+		for (int i = 0; i < pairs.size(); ++i) {
+			btBroadphaseProxy* proxy = pairs[i].m_pProxy0->m_clientObject == ghost ? pairs[i].m_pProxy1 : pairs[i].m_pProxy0;
+			const btCollisionObject* object = static_cast<btCollisionObject*>(proxy->m_clientObject);
+			if (object->getInternalType() == btCollisionObject::CO_GHOST_OBJECT) {
+				continue;
+			}
+			Entity* entity = static_cast<Entity*>(object->getUserPointer());
+			current.push_back({ object, entity ? entity->GetHandle() : EntityHandle() });
+		}
+		std::sort(current.begin(), current.end());
+		if (current == trigger->m_overlaps) {
+			continue;
+		}
 
-		// Rigidbodies need to be deleted separately
-		RigidBodyComponent* rb = toDestroy->GetComponent<RigidBodyComponent>();
-		if (rb) {
-			btRigidBody* body = rb->GetBody();
-			if (body && body->getMotionState()) {
-				delete body->getMotionState();
+		// Both lists are sorted, so walk them together to find what changed.
+		// Take a copy, since callbacks can change the trigger's lists.
+		std::vector<TriggerComponent::Overlap> previous;
+		previous.swap(trigger->m_overlaps);
+		trigger->m_overlaps = current;
+		EntityHandle self = trigger->GetOwner()->GetHandle();
+
+		size_t p = 0;
+		size_t c = 0;
+		while (p < previous.size() || c < current.size()) {
+			if (c == current.size() || (p < previous.size() && previous[p] < current[c])) {
+				DispatchTrigger(self, previous[p].entity, &Component::OnTriggerExit);
+				DispatchTrigger(previous[p].entity, self, &Component::OnTriggerExit);
+				p++;
+			}
+			else if (p == previous.size() || current[c] < previous[p]) {
+				DispatchTrigger(self, current[c].entity, &Component::OnTriggerEnter);
+				DispatchTrigger(current[c].entity, self, &Component::OnTriggerEnter);
+				c++;
+			}
+			else {
+				p++;
+				c++;
 			}
-			m_dynamicsWorld->removeCollisionObject(body);
-			delete body;
 		}
+	}
+}
 
-		// Somehow, the thing we're trying to destroy may not actually be in the entities list. 
-		// Guard against this condition
-		auto destroyLoc = std::find(m_entities.begin(), m_entities.end(), toDestroy);
-		if (destroyLoc != m_entities.end()) {
-			m_entities.erase(destroyLoc);
-			delete toDestroy;
+void World::UpdateSpatialTree()
+{
+	// Entities that didn't move keep their proxies as they are
+	UpdateTransforms();
+	for (Transform* transform : m_changedTransforms) {
+		UpdateSpatialProxy(transform->GetOwner());
+	}
+}
+
+void World::UpdateSpatialProxy(Entity* entity)
+{
+	MeshComponent* meshComponent = entity->GetMeshComponent();
+	if (!meshComponent) {
+		return;
+	}
+
+	// UI and particles use the mesh component differently, so they aren't spatial
+	int proxyId = meshComponent->GetProxyId();
+	if (!meshComponent->m_mesh || entity->GetUITransform() || entity->GetEmitter()) {
+		if (proxyId != DynamicBVH::NULL_NODE) {
+			m_spatialTree.DestroyProxy(proxyId);
+			meshComponent->SetProxyId(DynamicBVH::NULL_NODE);
 		}
-		m_destroyQueue.pop();
+		return;
+	}
+
+	Transform* transform = entity->GetTransform();
+	bool boundsChanged = meshComponent->UpdateWorldBounds(transform->GetWorldMatrix(), transform->GetWorldVersion());
+	if (proxyId == DynamicBVH::NULL_NODE) {
+		meshComponent->SetProxyId(m_spatialTree.CreateProxy(meshComponent->GetWorldBox(), entity));
+	}
+	else if (boundsChanged) {
+		m_spatialTree.MoveProxy(proxyId, meshComponent->GetWorldBox());
 	}
 }
 
@@ -113,36 +676,707 @@ void World::SetGravity(btVector3 gravity)
 	m_dynamicsWorld->setGravity(gravity);
 }
 
-Entity* World::Instantiate(const std::string& name)
+namespace
 {
-	Entity* entity = new Entity(name);
-	m_spawnQueue.push(entity); // Hold off on adding to the internal vector until all iterations over it are finished
-	return entity;
+	const uint32_t SNAPSHOT_MAGIC = 0x504E5357; // "WSNP"
+	const uint32_t SNAPSHOT_VERSION = 1;
+
+	btCollisionObject* GetBody(Entity* entity)
+	{
+		RigidBodyComponent* rb = entity->GetRigidBody();
+		return rb ? rb->GetBody() : nullptr;
+	}
 }
 
-Entity* World::Find(const std::string& name)
+void World::CaptureSnapshot(WorldSnapshot& snapshot)
 {
+	snapshot.m_data.clear();
+	snapshot.m_frame = m_collisionFrame;
+	SnapshotWriter writer(snapshot.m_data);
+	writer.Write(SNAPSHOT_MAGIC);
+	writer.Write(SNAPSHOT_VERSION);
+	writer.Write(m_collisionFrame);
+	writer.Write(m_dynamicsWorld->GetLocalTime());
+	writer.Write((uint32_t)m_solver->getRandSeed());
+
+	writer.Write((uint32_t)m_entities.size());
 	for (Entity* entity : m_entities) {
-		if (entity->GetName() == name) {
-			return entity;
+		Transform* parent = entity->GetTransform()->GetParent();
+		writer.Write(entity->m_handle);
+		writer.Write(parent ? parent->GetOwner()->m_handle : EntityHandle());
+		writer.Write((uint32_t)entity->m_components.size());
+		for (Component* component : entity->m_components) {
+			// Sized, so restoring can check each component read back all it wrote
+			size_t sizeOffset = writer.GetSize();
+			writer.Write((uint32_t)0);
+			component->SaveState(writer);
+			uint32_t size = (uint32_t)(writer.GetSize() - sizeOffset - sizeof(uint32_t));
+			std::memcpy(snapshot.m_data.data() + sizeOffset, &size, sizeof(size));
 		}
 	}
-	return nullptr;
+
+	// Entities are referred to by their position in the list above
+	writer.Write((uint32_t)m_activeEntities.size());
+	for (Entity* entity : m_activeEntities) {
+		writer.Write((uint32_t)entity->m_denseIndex);
+	}
+	writer.Write((uint32_t)m_collisionPairs.size());
+	for (const CollisionPair& pair : m_collisionPairs) {
+		writer.Write((uint32_t)pair.entity0->m_denseIndex);
+		writer.Write((uint32_t)pair.entity1->m_denseIndex);
+		writer.Write(pair.lastFrame);
+	}
 }
 
-Entity* World::FindWithTag(const std::string& tag)
+bool World::RestoreSnapshot(const WorldSnapshot& snapshot)
 {
+	SnapshotReader reader(snapshot.m_data.data(), snapshot.m_data.size());
+	uint32_t magic, version, seed, entityCount;
+	unsigned int frame;
+	btScalar localTime;
+	if (!reader.Read(magic) || !reader.Read(version) || magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION ||
+		!reader.Read(frame) || !reader.Read(localTime) || !reader.Read(seed) ||
+		!reader.Read(entityCount) || entityCount != m_entities.size()) {
+		return false;
+	}
+
+	// Check the whole snapshot before changing anything. Only component
+	// state can't be checked without loading it.
+	SnapshotReader entityReader = reader;
+	m_snapshotEntities.clear();
+	m_snapshotParents.clear();
+	std::vector<bool> listed(entityCount, false);
+	for (uint32_t i = 0; i < entityCount; ++i) {
+		EntityHandle handle, parent;
+		uint32_t componentCount;
+		if (!reader.Read(handle) || !reader.Read(parent) || !reader.Read(componentCount)) {
+			return false;
+		}
+		// Each entity exactly once, so together they cover the whole World
+		Entity* entity = Resolve(handle);
+		if (!entity || entity->m_components.size() != componentCount || listed[entity->m_denseIndex]) {
+			return false;
+		}
+		listed[entity->m_denseIndex] = true;
+		Entity* parentEntity = Resolve(parent);
+		if (parent.index != EntityHandle::INVALID_INDEX && !parentEntity) {
+			return false;
+		}
+		for (uint32_t c = 0; c < componentCount; ++c) {
+			uint32_t size = 0;
+			reader.Read(size);
+			reader.ReadBlock(size);
+		}
+		m_snapshotEntities.push_back(entity);
+		m_snapshotParents.push_back(parentEntity);
+	}
+
+	// The awake list and collision pairs refer to entities by their place in the list
+	uint32_t activeCount = 0;
+	reader.Read(activeCount);
+	std::vector<bool> active(entityCount, false);
+	for (uint32_t i = 0; i < activeCount && !reader.Failed(); ++i) {
+		uint32_t index = 0;
+		if (!reader.Read(index) || index >= entityCount || active[index]) {
+			return false;
+		}
+		active[index] = true;
+	}
+	uint32_t pairCount = 0;
+	reader.Read(pairCount);
+	for (uint32_t i = 0; i < pairCount && !reader.Failed(); ++i) {
+		uint32_t index0 = 0, index1 = 0;
+		unsigned int lastFrame = 0;
+		if (!reader.Read(index0) || !reader.Read(index1) || !reader.Read(lastFrame) || index0 >= entityCount || index1 >= entityCount ||
+			!GetBody(m_snapshotEntities[index0]) || !GetBody(m_snapshotEntities[index1])) {
+			return false;
+		}
+	}
+	if (reader.Failed() || !reader.AtEnd()) {
+		return false;
+	}
+
+	// Put the entity list in snapshot order, so anything that walks it runs in the same order as before
+	for (size_t i = 0; i < m_snapshotEntities.size(); ++i) {
+		m_entities[i] = m_snapshotEntities[i];
+		m_entities[i]->m_denseIndex = i;
+	}
+
+	RemoveCollisionObjects();
+	m_solver->reset();
+	m_solver->setRandSeed(seed);
+	m_dynamicsWorld->SetLocalTime(localTime);
+
+	// Detach everything that's changing parent first, so a hierarchy that
+	// was rearranged since the capture can't briefly form a cycle
+	for (size_t i = 0; i < m_entities.size(); ++i) {
+		Transform* transform = m_entities[i]->GetTransform();
+		Entity* parentEntity = m_snapshotParents[i];
+		if (transform->GetParent() != (parentEntity ? parentEntity->GetTransform() : nullptr)) {
+			transform->SetParent(nullptr, false);
+		}
+	}
+
+	bool complete = true;
 	for (Entity* entity : m_entities) {
-		if (entity->HasTag(tag)) {
-			return entity;
+		EntityHandle handle, parent;
+		uint32_t componentCount;
+		entityReader.Read(handle);
+		entityReader.Read(parent);
+		entityReader.Read(componentCount);
+		for (Component* component : entity->m_components) {
+			uint32_t size = 0;
+			entityReader.Read(size);
+			SnapshotReader block = entityReader.ReadBlock(size);
+			component->LoadState(block);
+			if (block.Failed() || !block.AtEnd()) {
+				complete = false;
+			}
+		}
+	}
+
+	// With the changing entities detached, this only fails if the snapshot itself has a cycle
+	for (size_t i = 0; i < m_entities.size(); ++i) {
+		Entity* parentEntity = m_snapshotParents[i];
+		if (!m_entities[i]->GetTransform()->SetParent(parentEntity ? parentEntity->GetTransform() : nullptr, false)) {
+			complete = false;
+		}
+	}
+
+	// Triggers are moved to their restored Transforms before going back in the broadphase
+	UpdateTransforms();
+	for (TriggerComponent* trigger : m_triggers) {
+		trigger->SyncTransform();
+	}
+	ReaddCollisionObjects();
+
+	// Rebuild the awake list in its old order. Restoring transforms woke everything.
+	for (Entity* entity : m_entities) {
+		entity->m_asleep = true;
+		entity->m_sleepPending = false;
+	}
+	m_sleepRequests.clear();
+	m_activeEntities.clear();
+	entityReader.Read(activeCount);
+	for (uint32_t i = 0; i < activeCount; ++i) {
+		uint32_t index = 0;
+		entityReader.Read(index);
+		Entity* entity = m_entities[index];
+		entity->m_asleep = false;
+		entity->m_activeIndex = m_activeEntities.size();
+		m_activeEntities.push_back(entity);
+	}
+
+	// Collision pairs, so begin and end events carry on as if nothing happened
+	for (Entity* entity : m_entities) {
+		entity->m_collisionPairs.clear();
+	}
+	m_collisionPairs.clear();
+	m_collisionFrame = frame;
+	entityReader.Read(pairCount);
+	for (uint32_t i = 0; i < pairCount; ++i) {
+		uint32_t index0 = 0, index1 = 0;
+		unsigned int lastFrame = 0;
+		entityReader.Read(index0);
+		entityReader.Read(index1);
+		entityReader.Read(lastFrame);
+		Entity* entity0 = m_entities[index0];
+		Entity* entity1 = m_entities[index1];
+		size_t pairIndex = AddCollisionPair(GetBody(entity0), GetBody(entity1), entity0, entity1);
+		m_collisionPairs[pairIndex].lastFrame = lastFrame;
+	}
+
+	// Refit the spatial tree so queries see the restored bounds
+	UpdateSpatialTree();
+	return complete;
+}
+
+void World::RemoveCollisionObjects()
+{
+	m_removedObjects.clear();
+	btCollisionObjectArray& objects = m_dynamicsWorld->getCollisionObjectArray();
+	for (int i = 0; i < objects.size(); ++i) {
+		btBroadphaseProxy* proxy = objects[i]->getBroadphaseHandle();
+		m_removedObjects.push_back({ objects[i], proxy->m_collisionFilterGroup, proxy->m_collisionFilterMask, 0 });
+	}
+	for (int i = objects.size() - 1; i >= 0; --i) {
+		m_dynamicsWorld->removeCollisionObject(objects[i]);
+	}
+
+	// With every proxy gone, the broadphase trees go back to their starting state
+	m_overlappingPairCache->resetPool(m_dispatcher);
+}
+
+void World::ReaddCollisionObjects()
+{
+	// Bodies in entity order, each Entity's rigid body before its triggers.
+	// Objects that don't belong to an Entity go last.
+	for (RemovedObject& removed : m_removedObjects) {
+		Entity* entity = static_cast<Entity*>(removed.object->getUserPointer());
+		bool isGhost = removed.object->getInternalType() == btCollisionObject::CO_GHOST_OBJECT;
+		removed.order = entity ? entity->m_denseIndex * 2 + (isGhost ? 1 : 0) : SIZE_MAX;
+	}
+	std::stable_sort(m_removedObjects.begin(), m_removedObjects.end(), [](const RemovedObject& a, const RemovedObject& b) {
+		return a.order < b.order;
+	});
+
+	for (const RemovedObject& removed : m_removedObjects) {
+		btRigidBody* body = btRigidBody::upcast(removed.object);
+		if (body) {
+			m_dynamicsWorld->addRigidBody(body, removed.group, removed.mask);
+		}
+		else {
+			m_dynamicsWorld->addCollisionObject(removed.object, removed.group, removed.mask);
+		}
+	}
+	m_removedObjects.clear();
+}
+
+EntityHandle World::Instantiate(const std::string& name)
+{
+	Entity* entity = ObjectPool<Entity>::GetInstance().Create(name);
+	entity->m_handle = AllocateSlot(entity);
+	// Hold off on adding to the internal vector until all iterations over it are finished
+	CommandBuffer& buffer = GetCommandBuffer();
+	buffer.spawnBatches.push_back({ buffer.spawnQueue.size(), 1 });
+	buffer.spawnQueue.push_back(entity);
+	return entity->m_handle;
+}
+
+void World::InstantiateBatch(const Prefab& prefab, size_t count, std::function<void(Entity*, size_t)> init)
+{
+	prefab.Reserve(count);
+	InstantiateBatch(count, [&](Entity* entity, size_t index) {
+		entity->m_name = prefab.GetName();
+		prefab.Apply(entity);
+		if (init) {
+			init(entity, index);
+		}
+	});
+}
+
+void World::InstantiateBatch(size_t count, std::function<void(Entity*, size_t)> init)
+{
+	TryInstantiateBatch(count, [&](Entity* entity, size_t index) {
+		init(entity, index);
+		return true;
+	});
+}
+
+bool World::TryInstantiateBatch(size_t count, std::function<bool(Entity*, size_t)> init)
+{
+	if (count == 0) {
+		return true;
+	}
+
+	// Allocate everything the batch needs up front
+	ObjectPool<Entity>& entityPool = ObjectPool<Entity>::GetInstance();
+	entityPool.Reserve(entityPool.GetStats().live + count);
+	CommandBuffer& buffer = GetCommandBuffer();
+	ReserveAtLeast(buffer.spawnQueue, buffer.spawnQueue.size() + count);
+
+	size_t first = buffer.spawnQueue.size();
+	const std::string noName;
+	for (size_t i = 0; i < count; ++i) {
+		Entity* entity = entityPool.Create(noName);
+		entity->m_handle = AllocateSlot(entity);
+		buffer.spawnQueue.push_back(entity);
+		if (!init(entity, i)) {
+			// Nothing has started or seen these entities, so they can go straight back
+			for (size_t j = first; j < buffer.spawnQueue.size(); ++j) {
+				Entity* discarded = buffer.spawnQueue[j];
+				FreeSlot(discarded->m_handle);
+				entityPool.Destroy(discarded);
+			}
+			buffer.spawnQueue.resize(first);
+			return false;
+		}
+	}
+	buffer.spawnBatches.push_back({ first, count });
+	return true;
+}
+
+Prefab* World::CreatePrefab(const std::string& name)
+{
+	Prefab* prefab = new Prefab(name);
+	m_prefabs[name] = prefab;
+	return prefab;
+}
+
+Prefab* World::GetPrefab(const std::string& name)
+{
+	return m_prefabs[name];
+}
+
+void World::IndexEntity(Entity* entity)
+{
+	std::vector<Entity*>& named = m_nameIndex[entity->m_name];
+	entity->m_nameSlot = named.size();
+	named.push_back(entity);
+	for (size_t i = 0; i < entity->m_tags.size(); ++i) {
+		OnEntityTagAdded(entity, i);
+	}
+	entity->m_inWorld = true;
+}
+
+void World::UnindexEntity(Entity* entity)
+{
+	RemoveFromNameIndex(entity);
+	for (size_t i = 0; i < entity->m_tags.size(); ++i) {
+		OnEntityTagRemoved(entity, i);
+	}
+	entity->m_inWorld = false;
+}
+
+void World::RemoveFromNameIndex(Entity* entity)
+{
+	// Swap the last entity with this name into this one's place
+	std::vector<Entity*>& named = m_nameIndex[entity->m_name];
+	Entity* last = named.back();
+	named[entity->m_nameSlot] = last;
+	last->m_nameSlot = entity->m_nameSlot;
+	named.pop_back();
+}
+
+void World::OnEntityRenamed(Entity* entity, const std::string& newName)
+{
+	RemoveFromNameIndex(entity);
+	std::vector<Entity*>& named = m_nameIndex[newName];
+	entity->m_nameSlot = named.size();
+	named.push_back(entity);
+}
+
+void World::OnEntityTagAdded(Entity* entity, size_t tagEntry)
+{
+	Entity::TagEntry& entry = entity->m_tags[tagEntry];
+	if (entry.id >= m_tagIndex.size()) {
+		m_tagIndex.resize(entry.id + 1);
+	}
+	std::vector<Entity*>& tagged = m_tagIndex[entry.id];
+	entry.slot = tagged.size();
+	tagged.push_back(entity);
+}
+
+void World::OnEntityTagRemoved(Entity* entity, size_t tagEntry)
+{
+	// Swap the last entity with this tag into this one's place
+	const Entity::TagEntry& entry = entity->m_tags[tagEntry];
+	std::vector<Entity*>& tagged = m_tagIndex[entry.id];
+	Entity* last = tagged.back();
+	tagged[entry.slot] = last;
+	last->m_tags[last->FindTagEntry(entry.id)].slot = entry.slot;
+	tagged.pop_back();
+}
+
+uint32_t World::InternTag(const std::string& tag)
+{
+	std::lock_guard<SpinLock> lock(m_tagLock);
+	auto id = m_tagIds.find(tag);
+	if (id != m_tagIds.end()) {
+		return id->second;
+	}
+	// The tag's entity list is made on the main thread when first needed
+	uint32_t tagId = (uint32_t)m_tagIds.size();
+	m_tagIds[tag] = tagId;
+	m_tagNames.push_back(tag);
+	return tagId;
+}
+
+std::string World::GetTagName(uint32_t tagId)
+{
+	std::lock_guard<SpinLock> lock(m_tagLock);
+	return m_tagNames[tagId];
+}
+
+bool World::FindTagId(const std::string& tag, uint32_t& tagId)
+{
+	std::lock_guard<SpinLock> lock(m_tagLock);
+	auto id = m_tagIds.find(tag);
+	if (id == m_tagIds.end()) {
+		return false;
+	}
+	tagId = id->second;
+	return true;
+}
+
+EntityHandle World::Find(const std::string& name)
+{
+	auto bucket = m_nameIndex.find(name);
+	if (bucket == m_nameIndex.end() || bucket->second.empty()) {
+		return EntityHandle();
+	}
+	return bucket->second.front()->m_handle;
+}
+
+EntityHandle World::FindWithTag(const std::string& tag)
+{
+	const std::vector<Entity*>& tagged = FindAllWithTag(tag);
+	return tagged.empty() ? EntityHandle() : tagged.front()->m_handle;
+}
+
+const std::vector<Entity*>& World::FindAllWithTag(const std::string& tag)
+{
+	uint32_t tagId;
+	return FindTagId(tag, tagId) && tagId < m_tagIndex.size() ? m_tagIndex[tagId] : m_noEntities;
+}
+
+void World::ReserveEntities(size_t count)
+{
+	ObjectPool<Entity>::GetInstance().Reserve(count);
+}
+
+AllocationStats World::GetAllocationStats()
+{
+	AllocationStats stats;
+	ObjectPoolBase* entityPool = &ObjectPool<Entity>::GetInstance();
+	stats.entities = entityPool->GetStats();
+	for (ObjectPoolBase* pool : ObjectPoolBase::GetPools()) {
+		if (pool != entityPool) {
+			const PoolStats& poolStats = pool->GetStats();
+			stats.components.slabAllocations += poolStats.slabAllocations;
+			stats.components.capacity += poolStats.capacity;
+			stats.components.live += poolStats.live;
+			stats.components.allocations += poolStats.allocations;
 		}
 	}
-	return nullptr;
+	stats.heapSpills = SmallVectorHeapSpills().load();
+	return stats;
 }
 
 void World::Destroy(Entity* entity)
 {
-	m_destroyQueue.push(entity);
+	GetCommandBuffer().destroyQueue.push_back(entity->m_handle);
+}
+
+void World::Destroy(EntityHandle handle)
+{
+	GetCommandBuffer().destroyQueue.push_back(handle);
+}
+
+void World::QueryBox(const DirectX::BoundingBox& box, std::vector<Entity*>& results)
+{
+	m_spatialTree.QueryBox(box, results);
+}
+
+void World::QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<Entity*>& results)
+{
+	m_spatialTree.QuerySphere(sphere, results);
+}
+
+void World::QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<Entity*>& results)
+{
+	m_spatialTree.QueryFrustum(planes, results);
+}
+
+void World::QueryRay(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, std::vector<BoundsHit>& results)
+{
+	m_spatialTree.QueryRay(origin, direction, maxDistance, results);
+}
+
+namespace
+{
+	// Physics queries look past trigger volumes
+	bool IsTrigger(const btCollisionObject* object)
+	{
+		return object->getInternalType() == btCollisionObject::CO_GHOST_OBJECT;
+	}
+
+	struct ClosestSweepCallback : public btCollisionWorld::ClosestConvexResultCallback
+	{
+		ClosestSweepCallback(const btVector3& from, const btVector3& to) : ClosestConvexResultCallback(from, to) { }
+
+		virtual bool needsCollision(btBroadphaseProxy* proxy) const override
+		{
+			return !IsTrigger(static_cast<btCollisionObject*>(proxy->m_clientObject)) && ClosestConvexResultCallback::needsCollision(proxy);
+		}
+	};
+
+	// Tests a ray against each collider whose broadphase box it passes through.
+	// Unlike btCollisionWorld::rayTest, which shares one traversal stack
+	// per broadphase, this can run on several threads at once.
+	struct RayLeafTester : public btDbvt::ICollide
+	{
+		btTransform from;
+		btTransform to;
+		btCollisionWorld::ClosestRayResultCallback& result;
+
+		RayLeafTester(const btVector3& rayFrom, const btVector3& rayTo, btCollisionWorld::ClosestRayResultCallback& result) : result(result)
+		{
+			from.setIdentity();
+			from.setOrigin(rayFrom);
+			to.setIdentity();
+			to.setOrigin(rayTo);
+		}
+
+		virtual void Process(const btDbvtNode* leaf) override
+		{
+			btBroadphaseProxy* proxy = static_cast<btBroadphaseProxy*>(leaf->data);
+			btCollisionObject* object = static_cast<btCollisionObject*>(proxy->m_clientObject);
+			if (!IsTrigger(object) && result.needsCollision(object->getBroadphaseHandle())) {
+				btCollisionWorld::rayTestSingle(from, to, object, object->getCollisionShape(), object->getWorldTransform(), result);
+			}
+		}
+	};
+
+	// Each thread keeps its own traversal stack between queries
+	thread_local btAlignedObjectArray<const btDbvtNode*> t_rayStack;
+
+	// Collects the entities a contact test touches
+	struct OverlapCollector : public btCollisionWorld::ContactResultCallback
+	{
+		const btCollisionObject* query;
+		std::vector<Entity*> entities;
+
+		virtual btScalar addSingleResult(btManifoldPoint& cp, const btCollisionObjectWrapper* colObj0Wrap, int partId0, int index0, 
+			const btCollisionObjectWrapper* colObj1Wrap, int partId1, int index1) override
+		{
+			if (cp.getDistance() > 0) {
+				return 0;
+			}
+			const btCollisionObject* other = colObj0Wrap->getCollisionObject() == query ? colObj1Wrap->getCollisionObject() : colObj0Wrap->getCollisionObject();
+			if (IsTrigger(other)) {
+				return 0;
+			}
+			Entity* entity = static_cast<Entity*>(other->getUserPointer());
+			if (entity && std::find(entities.begin(), entities.end(), entity) == entities.end()) {
+				entities.push_back(entity);
+			}
+			return 0;
+		}
+	};
+
+	// Queries belong to every layer, so a body's own mask can't hide it,
+	// and hit the bodies whose layer is in the query's mask
+	template<typename Callback>
+	void SetQueryFilter(Callback& callback, uint32_t layerMask)
+	{
+		callback.m_collisionFilterGroup = (int)0xFFFFFFFF;
+		callback.m_collisionFilterMask = (int)layerMask;
+	}
+
+	btTransform MakeBtTransform(DirectX::XMFLOAT3 position, DirectX::XMFLOAT4 rotation)
+	{
+		return btTransform(btQuaternion(rotation.x, rotation.y, rotation.z, rotation.w), btVector3(position.x, position.y, position.z));
+	}
+
+	EntityHandle HandleOf(const btCollisionObject* object)
+	{
+		Entity* entity = object ? static_cast<Entity*>(object->getUserPointer()) : nullptr;
+		return entity ? entity->GetHandle() : EntityHandle();
+	}
+}
+
+RaycastHit World::CastRay(const RaycastQuery& query)
+{
+	btVector3 from(query.origin.x, query.origin.y, query.origin.z);
+	btVector3 direction(query.direction.x, query.direction.y, query.direction.z);
+	btVector3 to = from + direction * query.maxDistance;
+
+	btCollisionWorld::ClosestRayResultCallback result(from, to);
+	SetQueryFilter(result, query.layerMask);
+	RayLeafTester tester(from, to, result);
+
+	// Same setup btCollisionWorld::rayTest does for the broadphase
+	btVector3 directionInverse;
+	unsigned int signs[3];
+	for (int i = 0; i < 3; ++i) {
+		directionInverse[i] = direction[i] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / direction[i];
+		signs[i] = directionInverse[i] < 0.0;
+	}
+	btVector3 zero(0, 0, 0);
+	for (btDbvt& tree : m_overlappingPairCache->m_sets) {
+		tree.rayTestInternal(tree.m_root, from, to, directionInverse, signs, query.maxDistance, zero, zero, t_rayStack, tester);
+	}
+
+	RaycastHit hit;
+	if (result.hasHit()) {
+		hit.hit = true;
+		hit.entity = HandleOf(result.m_collisionObject);
+		hit.point = XMFLOAT3(result.m_hitPointWorld.x(), result.m_hitPointWorld.y(), result.m_hitPointWorld.z());
+		hit.normal = XMFLOAT3(result.m_hitNormalWorld.x(), result.m_hitNormalWorld.y(), result.m_hitNormalWorld.z());
+		hit.distance = result.m_closestHitFraction * query.maxDistance;
+	}
+	return hit;
+}
+
+RaycastHit World::Raycast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, uint32_t layerMask)
+{
+	RaycastQuery query;
+	query.origin = origin;
+	query.direction = direction;
+	query.maxDistance = maxDistance;
+	query.layerMask = layerMask;
+	return CastRay(query);
+}
+
+void World::RaycastBatch(const std::vector<RaycastQuery>& queries, std::vector<RaycastHit>& results)
+{
+	results.resize(queries.size());
+	m_jobSystem.ParallelFor(queries.size(), 64, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			results[i] = CastRay(queries[i]);
+		}
+	});
+}
+
+RaycastHit World::Sweep(const btConvexShape* shape, DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, DirectX::XMFLOAT4 rotation, uint32_t layerMask)
+{
+	XMFLOAT3 end(origin.x + direction.x * maxDistance, origin.y + direction.y * maxDistance, origin.z + direction.z * maxDistance);
+	btTransform from = MakeBtTransform(origin, rotation);
+	btTransform to = MakeBtTransform(end, rotation);
+
+	ClosestSweepCallback result(from.getOrigin(), to.getOrigin());
+	SetQueryFilter(result, layerMask);
+	m_dynamicsWorld->convexSweepTest(shape, from, to, result);
+
+	RaycastHit hit;
+	if (result.hasHit()) {
+		hit.hit = true;
+		hit.entity = HandleOf(result.m_hitCollisionObject);
+		hit.point = XMFLOAT3(result.m_hitPointWorld.x(), result.m_hitPointWorld.y(), result.m_hitPointWorld.z());
+		hit.normal = XMFLOAT3(result.m_hitNormalWorld.x(), result.m_hitNormalWorld.y(), result.m_hitNormalWorld.z());
+		hit.distance = result.m_closestHitFraction * maxDistance;
+	}
+	return hit;
+}
+
+RaycastHit World::SweepSphere(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, float radius, uint32_t layerMask)
+{
+	btSphereShape sphere(radius);
+	return Sweep(&sphere, origin, direction, maxDistance, XMFLOAT4(0, 0, 0, 1), layerMask);
+}
+
+RaycastHit World::SweepBox(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, DirectX::XMFLOAT3 halfExtents, DirectX::XMFLOAT4 rotation, uint32_t layerMask)
+{
+	btBoxShape box(btVector3(halfExtents.x, halfExtents.y, halfExtents.z));
+	return Sweep(&box, origin, direction, maxDistance, rotation, layerMask);
+}
+
+void World::Overlap(btCollisionShape* shape, DirectX::XMFLOAT3 center, DirectX::XMFLOAT4 rotation, uint32_t layerMask, std::vector<EntityHandle>& results)
+{
+	btCollisionObject object;
+	object.setCollisionShape(shape);
+	object.setWorldTransform(MakeBtTransform(center, rotation));
+
+	OverlapCollector collector;
+	collector.query = &object;
+	SetQueryFilter(collector, layerMask);
+	m_dynamicsWorld->contactTest(&object, collector);
+	for (Entity* entity : collector.entities) {
+		results.push_back(entity->GetHandle());
+	}
+}
+
+void World::OverlapSphere(DirectX::XMFLOAT3 center, float radius, std::vector<EntityHandle>& results, uint32_t layerMask)
+{
+	btSphereShape sphere(radius);
+	Overlap(&sphere, center, XMFLOAT4(0, 0, 0, 1), layerMask, results);
+}
+
+void World::OverlapBox(DirectX::XMFLOAT3 center, DirectX::XMFLOAT3 halfExtents, DirectX::XMFLOAT4 rotation, std::vector<EntityHandle>& results, uint32_t layerMask)
+{
+	btBoxShape box(btVector3(halfExtents.x, halfExtents.y, halfExtents.z));
+	Overlap(&box, center, rotation, layerMask, results);
 }
 
 void World::DestroyAllEntities()
@@ -153,23 +1387,130 @@ void World::DestroyAllEntities()
 	m_mainCamera = nullptr;
 }
 
-Mesh* World::CreateMesh(const std::string& name, Vertex* vertices, int numVertices, unsigned int* indices, int numIndices, ID3D11Device* device)
+MeshHandle World::CreateMesh(const std::string& name, Vertex* vertices, int numVertices, unsigned int* indices, int numIndices, ID3D11Device* device)
+{
+	return AddMesh(name, new Mesh(vertices, numVertices, indices, numIndices, device));
+}
+
+MeshHandle World::CreateMesh(const std::string& name, const char* file, ID3D11Device* device)
 {
-	Mesh* mesh = new Mesh(vertices, numVertices, indices, numIndices, device);
-	m_meshes[name] = mesh;
-	return mesh;
+	return AddMesh(name, new Mesh(file, device), file, device);
 }
 
-Mesh* World::CreateMesh(const std::string& name, const char* file, ID3D11Device* device)
+MeshHandle World::GetMesh(const std::string& name)
 {
-	Mesh* mesh = new Mesh(file, device);
-	m_meshes[name] = mesh;
-	return mesh;
+	return m_meshes.Get(name);
+}
+
+MeshHandle World::AddMesh(const std::string& name, Mesh* mesh, const char* file, ID3D11Device* device)
+{
+	uint16_t sortId = m_nextMeshSortId++;
+	mesh->SetSortId(sortId);
+	mesh->SetName(name);
+
+	// Reloaded meshes keep their sort id, so they still draw with their batch
+	std::function<Mesh*(size_t&)> load;
+	if (file && device) {
+		std::string path = file;
+		load = [name, path, device, sortId](size_t& size) {
+			Mesh* reloaded = new Mesh(path.c_str(), device);
+			reloaded->SetSortId(sortId);
+			reloaded->SetName(name);
+			size = GetMeshSize(reloaded);
+			return reloaded;
+		};
+	}
+
+	// Hot reloads are read on the watching thread, and swapped into the same handles
+	auto watch = m_meshWatches.find(name);
+	if (watch != m_meshWatches.end()) {
+		m_fileWatcher.Unwatch(watch->second);
+		m_meshWatches.erase(watch);
+	}
+	if (file && device) {
+		m_meshWatches[name] = m_fileWatcher.Watch(file, [this, name, device, sortId](const std::string& path) -> FileWatcher::ApplyFunction {
+			if (!std::ifstream(path)) {
+				return nullptr;
+			}
+			// Deleted if the watch goes away before it's swapped in
+			auto reloaded = std::make_shared<std::unique_ptr<Mesh>>(new Mesh(path.c_str(), device));
+			return [this, name, sortId, reloaded]() { SwapMesh(name, reloaded->release(), sortId); };
+		});
+	}
+	return m_meshes.Add(name, mesh, GetMeshSize(mesh), load);
 }
 
-Mesh* World::GetMesh(const std::string& name)
+void World::SwapMesh(const std::string& name, Mesh* mesh, uint16_t sortId)
 {
-	return m_meshes[name];
+	mesh->SetSortId(sortId);
+	mesh->SetName(name);
+
+	// Triangle mesh shapes read the old Mesh's vertices, so it's kept until its handles are gone.
+	// Bodies keep their old shapes; new ones are made from the new Mesh.
+	Mesh* old = m_meshes.Peek(name);
+	bool keepOld = old && m_shapeCache.UsesMesh(old);
+	if (!m_meshes.Swap(name, mesh, GetMeshSize(mesh), keepOld)) {
+		delete mesh;
+	}
+}
+
+void World::DestroyMesh(const std::string& name)
+{
+	auto watch = m_meshWatches.find(name);
+	if (watch != m_meshWatches.end()) {
+		m_fileWatcher.Unwatch(watch->second);
+		m_meshWatches.erase(watch);
+	}
+	m_meshes.Remove(name);
+}
+
+void World::DestroyMaterial(const std::string& name)
+{
+	m_materials.Remove(name);
+}
+
+void World::DestroyTexture(const std::string& name)
+{
+	m_textures.Remove(name);
+}
+
+void World::CollectResources()
+{
+	m_textures.FreeReplaced();
+	m_meshes.FreeReplaced();
+	m_materials.FreeReplaced();
+
+	// Evict the least recently used resource across the caches until they fit
+	while (m_textures.GetSize() + m_meshes.GetSize() + m_materials.GetSize() > m_resourceBudget) {
+		ResourceCache<ID3D11ShaderResourceView>::Entry* texture = m_textures.FindEvictable();
+		ResourceCache<Mesh>::Entry* mesh = m_meshes.FindEvictable();
+		ResourceCache<Material>::Entry* material = m_materials.FindEvictable();
+		uint64_t textureUsed = texture ? texture->lastUsed.load() : UINT64_MAX;
+		uint64_t meshUsed = mesh ? mesh->lastUsed.load() : UINT64_MAX;
+		uint64_t materialUsed = material ? material->lastUsed.load() : UINT64_MAX;
+
+		if (texture && textureUsed <= meshUsed && textureUsed <= materialUsed) {
+			m_textures.Evict(texture);
+		}
+		else if (mesh && meshUsed <= materialUsed) {
+			m_meshes.Evict(mesh);
+		}
+		else if (material) {
+			m_materials.Evict(material);
+		}
+		else {
+			// Everything left is in use or can't be loaded again
+			break;
+		}
+	}
+}
+
+size_t World::GetResourceReport(std::vector<ResourceReportEntry>& report)
+{
+	m_textures.Report(report);
+	m_meshes.Report(report);
+	m_materials.Report(report);
+	return m_textures.GetSize() + m_meshes.GetSize() + m_materials.GetSize();
 }
 
 SimpleVertexShader* World::CreateVertexShader(const std::string& name, ID3D11Device* device, ID3D11DeviceContext* context, LPCWSTR shaderFile)
@@ -177,6 +1518,7 @@ SimpleVertexShader* World::CreateVertexShader(const std::string& name, ID3D11Dev
 	SimpleVertexShader* vs = new SimpleVertexShader(device, context);
 	vs->LoadShaderFile(shaderFile);
 	m_vertexShaders[name] = vs;
+	WatchShader(vs, shaderFile);
 	return vs;
 }
 
@@ -190,6 +1532,7 @@ SimplePixelShader* World::CreatePixelShader(const std::string& name, ID3D11Devic
 	SimplePixelShader* ps = new SimplePixelShader(device, context);
 	ps->LoadShaderFile(shaderFile);
 	m_pixelShaders[name] = ps;
+	WatchShader(ps, shaderFile);
 	return ps;
 }
 
@@ -198,31 +1541,77 @@ SimplePixelShader* World::GetPixelShader(const std::string& name)
 	return m_pixelShaders[name];
 }
 
-Material* World::CreateMaterial(
+void World::WatchShader(ISimpleShader* shader, LPCWSTR shaderFile)
+{
+	// Shaders are reloaded in place, so materials keep their pointers.
+	// A file that doesn't compile into a shader leaves it invalid, so it isn't drawn until it's fixed.
+	std::wstring file = shaderFile;
+	m_fileWatcher.Watch(ToNarrow(file), [shader, file](const std::string& path) -> FileWatcher::ApplyFunction {
+		ID3DBlob* blob = nullptr;
+		if (FAILED(D3DReadFileToBlob(file.c_str(), &blob))) {
+			return nullptr;
+		}
+		std::shared_ptr<ID3DBlob> code(blob, [](ID3DBlob* b) { b->Release(); });
+		return [shader, code]() {
+			code->AddRef();
+			shader->LoadShaderBlob(code.get());
+		};
+	});
+}
+
+void World::SetHotReload(bool enabled)
+{
+	if (enabled) {
+		m_fileWatcher.Start();
+	}
+	else {
+		m_fileWatcher.Stop();
+	}
+}
+
+MaterialHandle World::CreateMaterial(
 	const std::string& name, SimpleVertexShader* vertexShader, SimplePixelShader* pixelShader,
 	ID3D11ShaderResourceView* diffuseSRV, ID3D11ShaderResourceView* normalSRV, ID3D11ShaderResourceView* reflectionSRV,
 	ID3D11SamplerState* samplerState, ID3D11BlendState* blendState, ID3D11DepthStencilState* depthStencilState)
 {
 	Material* material = new Material(vertexShader, pixelShader, diffuseSRV, normalSRV, reflectionSRV, samplerState, blendState, depthStencilState);
-	m_materials[name] = material;
-	return material;
+
+	// Materials sharing a shader pair share a shader sort id so they get drawn together
+	auto shaderPair = std::make_pair(vertexShader, pixelShader);
+	if (m_shaderSortIds.count(shaderPair) == 0) {
+		uint16_t shaderSortId = (uint16_t)m_shaderSortIds.size();
+		m_shaderSortIds[shaderPair] = shaderSortId;
+	}
+	material->SetSortIds(m_nextMaterialSortId++, m_shaderSortIds[shaderPair]);
+	material->SetName(name);
+	material->SetTextureHandles(m_textures.Find(diffuseSRV), m_textures.Find(normalSRV));
+
+	// Materials are cheap and hold their textures, so they're never evicted
+	return m_materials.Add(name, material, sizeof(Material));
 }
 
-Material* World::GetMaterial(const std::string& name)
+MaterialHandle World::GetMaterial(const std::string& name)
 {
-	return m_materials[name];
+	return m_materials.Get(name);
 }
 
-ID3D11ShaderResourceView* World::CreateTexture(const std::string& name, ID3D11Device* device, ID3D11DeviceContext* context, const wchar_t* fileName)
+TextureHandle World::CreateTexture(const std::string& name, ID3D11Device* device, ID3D11DeviceContext* context, const wchar_t* fileName)
 {
-	m_SRVs[name] = nullptr;
-	CreateWICTextureFromFile(device, context, fileName, 0, &m_SRVs[name]);
-	return m_SRVs[name];
+	std::wstring file = fileName;
+	auto load = [device, context, file](size_t& size) {
+		ID3D11ShaderResourceView* srv = nullptr;
+		CreateWICTextureFromFile(device, context, file.c_str(), 0, &srv);
+		size = GetTextureSize(srv);
+		return srv;
+	};
+	size_t size = 0;
+	ID3D11ShaderResourceView* srv = load(size);
+	return m_textures.Add(name, srv, size, load);
 }
 
-ID3D11ShaderResourceView* World::GetTexture(const std::string& name)
+TextureHandle World::GetTexture(const std::string& name)
 {
-	return m_SRVs[name];
+	return m_textures.Get(name);
 }
 
 ID3D11ShaderResourceView* World::CreateCubeTexture(const std::string& name, ID3D11Device* device, ID3D11DeviceContext* context, const wchar_t* fileName)
@@ -321,6 +1710,16 @@ FMOD::Sound* World::GetSound(const std::string& name)
 	return m_sounds[name];
 }
 
+std::string World::GetSoundName(FMOD::Sound* sound)
+{
+	for (auto& pair : m_sounds) {
+		if (pair.second == sound) {
+			return pair.first;
+		}
+	}
+	return std::string();
+}
+
 void World::OnMouseDown(WPARAM buttonState, int x, int y)
 {
 	for (Entity* entity : m_entities) {
@@ -379,123 +1778,78 @@ void World::OnResize(int width, int height)
 
 void World::Tick(float deltaTime)
 {
+	// Swap in assets that were hot reloaded since the last tick
+	m_fileWatcher.DispatchChanges();
+
+	// Stream level cells around the camera. Cells are spawned and destroyed in this tick's Flush.
+	if (m_mainCamera) {
+		m_levelStreamer.Update(m_mainCamera->GetOwner()->GetTransform()->GetWorldPosition());
+	}
+
 	// Simulate physics
+	m_collisionLayers.ResetStats();
 	m_dynamicsWorld->stepSimulation(deltaTime, 10);
 
-	// This represents collisions that occurred only during this frame
-	// Used to determine when collisions ended
-	std::map<const btCollisionObject*, std::set<const btCollisionObject*>> collisionSnapshot;
-
 	// Dispatch collision events
-	int numManifolds = m_dynamicsWorld->getDispatcher()->getNumManifolds();
+	m_collisionFrame++;
+	btDispatcher* dispatcher = m_dynamicsWorld->getDispatcher();
+	int numManifolds = dispatcher->getNumManifolds();
 	for (int i = 0; i < numManifolds; ++i) {
-		btPersistentManifold* contactManifold = m_dynamicsWorld->getDispatcher()->getManifoldByIndexInternal(i);
+		btPersistentManifold* contactManifold = dispatcher->getManifoldByIndexInternal(i);
 		const btCollisionObject* body0 = contactManifold->getBody0();
 		const btCollisionObject* body1 = contactManifold->getBody1();
 		Entity* e0 = static_cast<Entity*>(body0->getUserPointer());
 		Entity* e1 = static_cast<Entity*>(body1->getUserPointer());
 
 		// Check if this is a new collision
-		if (m_collisionMap.count(body0) == 0) {
-			m_collisionMap[body0] = std::set<const btCollisionObject*>();
-			for (Component* component : e0->GetAllComponents()) {
-				if (component->GetEnabled()) {
-					component->OnCollisionBegin(e1);
-				}
-			}
-			for (Component* component : e1->GetAllComponents()) {
-				if (component->GetEnabled()) {
-					component->OnCollisionBegin(e0);
-				}
-			}
-		}
-		else if (m_collisionMap[body0].count(body1) == 0) {
-			m_collisionMap[body0].insert(body1);
-			for (Component* component : e0->GetAllComponents()) {
-				if (component->GetEnabled()) {
-					component->OnCollisionBegin(e1);
-				}
-			}
-			for (Component* component : e1->GetAllComponents()) {
-				if (component->GetEnabled()) {
-					component->OnCollisionBegin(e0);
-				}
-			}
+		size_t pairIndex = FindCollisionPair(e0, body0, body1);
+		if (pairIndex == m_collisionPairs.size()) {
+			AddCollisionPair(body0, body1, e0, e1);
+			e0->Wake();
+			e1->Wake();
+			DispatchCollision(e0, e1, &Component::OnCollisionBegin);
+			DispatchCollision(e1, e0, &Component::OnCollisionBegin);
 		}
-		// Recurring collision callback
-		else {
-			// Collision callback triggered each frame of the collision
-			for (Component* component : e0->GetAllComponents()) {
-				if (component->GetEnabled()) {
-					component->OnCollisionStay(e1);
-				}
-			}
-			for (Component* component : e1->GetAllComponents()) {
-				if (component->GetEnabled()) {
-					component->OnCollisionStay(e0);
-				}
-			}
+		// Collision callback triggered each frame of the collision
+		else if (m_collisionPairs[pairIndex].lastFrame != m_collisionFrame) {
+			m_collisionPairs[pairIndex].lastFrame = m_collisionFrame;
+			DispatchCollision(e0, e1, &Component::OnCollisionStay);
+			DispatchCollision(e1, e0, &Component::OnCollisionStay);
 		}
-		// Update the snapshot
-		if (collisionSnapshot.count(body0) == 0) {
-			collisionSnapshot[body0] = std::set<const btCollisionObject*>();
-		}
-		collisionSnapshot[body0].insert(body1);
-	}
-	// Take the difference collisionMap - snapshot
-	// That value represents what's not being collided with anymore 
-	for (const auto& pair : m_collisionMap) {
-		Entity* e0 = static_cast<Entity*>(pair.first->getUserPointer());
-		// If the snapshot doesn't contain the key, all of the things we've 
-		// reported are colliding with it must not be colliding anymore
-		if (collisionSnapshot.count(pair.first) == 0) {
-			for (const btCollisionObject* coll : m_collisionMap[pair.first]) {
-				Entity* e1 = static_cast<Entity*>(coll->getUserPointer());
-				for (Component* component : e0->GetAllComponents()) {
-					if (component->GetEnabled()) {
-						component->OnCollisionEnd(e1);
-					}
-				}
-				for (Component* component : e1->GetAllComponents()) {
-					if (component->GetEnabled()) {
-						component->OnCollisionEnd(e0);
-					}
-				}
-			}
-		}
-		// Otherwise, check in the collision set for this key to see if there are any collisions
-		// that the snapshot doesn't have. Again, these are collisions that just ended.
-		else {
-			for (const btCollisionObject* coll : m_collisionMap[pair.first]) {
-				if (collisionSnapshot[pair.first].count(coll) == 0) {
-					Entity* e1 = static_cast<Entity*>(coll->getUserPointer());
-					for (Component* component : e0->GetAllComponents()) {
-						if (component->GetEnabled()) {
-							component->OnCollisionEnd(e1);
-						}
-					}
-					for (Component* component : e1->GetAllComponents()) {
-						if (component->GetEnabled()) {
-							component->OnCollisionEnd(e0);
-						}
-					}
-				}
-			}
+	}
+
+	// Pairs that weren't seen this frame aren't colliding anymore.
+	// Walk backwards so pairs swapped into removed slots were already checked.
+	for (size_t i = m_collisionPairs.size(); i-- > 0; ) {
+		if (m_collisionPairs[i].lastFrame != m_collisionFrame) {
+			CollisionPair ended = m_collisionPairs[i];
+			RemoveCollisionPair(i);
+			DispatchCollision(ended.entity0, ended.entity1, &Component::OnCollisionEnd);
+			DispatchCollision(ended.entity1, ended.entity0, &Component::OnCollisionEnd);
 		}
 	}
-	// We need the map to look exactly like the snapshot now
-	m_collisionMap = collisionSnapshot;
 
-	for (Entity* entity : m_entities) {
-		for (Component* component : entity->GetAllComponents()) {
+	UpdateTriggers();
+
+	// Sleeping entities are skipped. Entities woken during the loop are
+	// added to the end, so they're still ticked this frame.
+	for (size_t i = 0; i < m_activeEntities.size(); ++i) {
+		for (Component* component : m_activeEntities[i]->GetAllComponents()) {
 			if (component->GetEnabled()) {
 				component->Tick(deltaTime);
 			}
 		}
 	}
+	ApplySleepRequests();
 
 	// Spawn and destroy entities **after** iterating through them
 	Flush();
+
+	// Keep the spatial tree current for queries made before the next tick
+	UpdateSpatialTree();
+
+	// Free resources whose last handles went away this tick
+	CollectResources();
 }
 
 void World::DrawEntities(ID3D11DeviceContext* context, DirectX::SpriteBatch* spriteBatch, int screenWidth, int screenHeight)
@@ -509,11 +1863,22 @@ void World::DrawEntities(ID3D11DeviceContext* context, DirectX::SpriteBatch* spr
 	std::queue<Entity*> uiEntities;
 	std::queue<Entity*> particleEntities;
 
+	XMFLOAT3 cameraPos = m_mainCamera->GetOwner()->GetTransform()->GetWorldPosition();
+	XMFLOAT3 cameraForward = m_mainCamera->GetOwner()->GetTransform()->GetForward();
+	XMVECTOR cameraPosVec = XMLoadFloat3(&cameraPos);
+	XMVECTOR cameraForwardVec = XMLoadFloat3(&cameraForward);
+	float farClip = m_mainCamera->GetFarClip();
+
+	m_renderQueue.Clear();
+	m_frustumCuller.Begin(m_mainCamera->GetViewMatrix(), m_mainCamera->GetProjectionMatrix());
+
 	UINT stride = sizeof(Vertex);
 	UINT offset = 0;
-	//GetVertexShader("vs")
+
+	// World matrices are finished before anything reads them for culling or drawing
+	UpdateTransforms();
 	for (Entity* entity : m_entities) {
-		entity->GetTransform()->RecalculateWorldMatrix();
+		UpdateSpatialProxy(entity);
 
 		// Delay rendering UI elements so they can be batched together
 		if (entity->GetUITransform()) {
@@ -523,18 +1888,41 @@ void World::DrawEntities(ID3D11DeviceContext* context, DirectX::SpriteBatch* spr
 		else if (entity->GetEmitter()) {
 			particleEntities.push(entity);
 		}
-		// Render traditional 3D entities
-		else if (entity->GetMesh() && entity->GetMaterial()) {
-			entity->PrepareMaterial(
-				m_mainCamera->GetViewMatrix(), m_mainCamera->GetProjectionMatrix(),
-				m_mainCamera->GetOwner()->GetTransform()->GetPosition(),
-				m_lights, m_activeLightCount);
-			ID3D11Buffer* entityVB = entity->GetMesh()->GetVertexBuffer();
-			context->IASetVertexBuffers(0, 1, &entityVB, &stride, &offset);
-			context->IASetIndexBuffer(entity->GetMesh()->GetIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
-			context->DrawIndexed(entity->GetMesh()->GetIndexCount(), 0, 0);
+	}
+
+	// The tree rejects whole subtrees outside the frustum, 
+	// then the remaining boxes are culled exactly, 8 at a time
+	m_cullCandidates.clear();
+	m_spatialTree.QueryFrustum(m_frustumCuller.GetPlanes(), m_cullCandidates);
+	for (Entity* entity : m_cullCandidates) {
+		if (entity->GetMaterial()) {
+			m_frustumCuller.Add(entity, entity->GetMeshComponent()->GetWorldBox());
 		}
 	}
+	m_visibleEntities.clear();
+	m_frustumCuller.Cull(m_visibleEntities);
+
+	// Queue visible entities so they can be sorted by state
+	for (Entity* entity : m_visibleEntities) {
+		Material* material = entity->GetMaterial();
+
+		// World matrices are stored transposed, so the translation is in the last column
+		XMFLOAT4X4 world = entity->GetTransform()->GetWorldMatrix();
+		XMVECTOR toEntity = XMVectorSet(world._14, world._24, world._34, 0) - cameraPosVec;
+		float depth = XMVectorGetX(XMVector3Dot(toEntity, cameraForwardVec)) / farClip;
+
+		// Transparent entities are drawn back to front
+		RenderPass pass = material->GetBlendState() ? RenderPass::Transparent : RenderPass::Opaque;
+		if (pass == RenderPass::Transparent) {
+			depth = 1.0f - depth;
+		}
+
+		m_renderQueue.Submit(entity, RenderQueue::MakeSortKey(
+			pass, material->GetShaderSortId(), material->GetSortId(), entity->GetMesh()->GetSortId(), depth));
+	}
+
+	m_renderQueue.Execute(context, m_mainCamera->GetViewMatrix(), m_mainCamera->GetProjectionMatrix(),
+		cameraPos, m_lights, m_activeLightCount);
 
 	//skyStuff
 
@@ -683,6 +2071,10 @@ void World::DrawEntities(ID3D11DeviceContext* context, DirectX::SpriteBatch* spr
 
 World::~World()
 {
+	m_jobSystem.Stop();
+	m_levelStreamer.Stop();
+	m_fileWatcher.Stop();
+
 	// Delete Bullet resources
 	for (int i = m_dynamicsWorld->getNumCollisionObjects() - 1; i >= 0; --i) {
 		btCollisionObject* obj = m_dynamicsWorld->getCollisionObjectArray()[i];
@@ -691,9 +2083,13 @@ World::~World()
 			delete body->getMotionState();
 		}
 		m_dynamicsWorld->removeCollisionObject(obj);
-		delete obj;
+		// Trigger ghosts are deleted by their TriggerComponent
+		if (!btGhostObject::upcast(obj)) {
+			delete obj;
+		}
 	}
 	delete m_dynamicsWorld;
+	m_dynamicsWorld = nullptr;
 	delete m_solver;
 	delete m_overlappingPairCache;
 	delete m_dispatcher;
@@ -703,27 +2099,19 @@ World::~World()
 
 	// Delete the entities
 	for (Entity* entity : m_entities) {
-		delete entity;
-	}
-	// Delete resources
-	for (const auto& pair : m_meshes) {
-		delete pair.second;
+		ObjectPool<Entity>::GetInstance().Destroy(entity);
 	}
+	// Delete resources. Meshes, textures and materials are freed by their
+	// caches, after the shape cache gives back its handles.
 	for (const auto& pair : m_vertexShaders) {
 		delete pair.second;
 	}
 	for (const auto& pair : m_pixelShaders) {
 		delete pair.second;
 	}
-	for (const auto& pair : m_materials) {
-		delete pair.second;
-	}
 	for (const auto& pair : m_fonts) {
 		delete pair.second;
 	}
-	for (const auto& pair : m_SRVs) {
-		pair.second->Release();
-	}
 	for (const auto& pair : m_cubeSRVs) {
 		pair.second->Release();
 	}
@@ -745,5 +2133,11 @@ World::~World()
 	for (const auto& pair : m_sounds) {
 		pair.second->release();
 	}
+	for (const auto& pair : m_prefabs) {
+		delete pair.second;
+	}
+	for (std::atomic<EntitySlot*>& page : m_slotPages) {
+		delete[] page.load();
+	}
 	m_soundSystem->release();
 }
\ No newline at end of file
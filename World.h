@@ -5,19 +5,41 @@
 #include <Windows.h>
 #include <d3d11.h>
 #include <map>
+#include <unordered_map>
 #include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/BulletCollision/CollisionDispatch/btGhostObject.h>
 #include "LightComponent.h"
 #include "Mesh.h"
 #include "SimpleShader.h"
 #include "Material.h"
+#include "RenderQueue.h"
+#include "FrustumCuller.h"
+#include "DynamicBVH.h"
+#include "TransformHierarchy.h"
+#include "JobSystem.h"
+#include "CollisionShapeCache.h"
+#include "PhysicsQuery.h"
+#include "CollisionLayers.h"
+#include "WorldSnapshot.h"
+#include "LevelStreamer.h"
+#include "ResourceCache.h"
+#include "FileWatcher.h"
+#include "EntityHandle.h"
+#include "ObjectPool.h"
+#include "SpinLock.h"
 #include <set>
 #include <queue>
+#include <functional>
+#include <atomic>
+#include <thread>
 #include <SpriteBatch.h>
 #include <SpriteFont.h>
 #include <CommonStates.h>
 #include <fmod/fmod.hpp>
 class CameraComponent;
 class Entity;
+class Prefab;
+class TriggerComponent;
 
 // --------------------------------------------------------
 // The World class is in charge of managing Entities and resources.
@@ -27,13 +49,84 @@ class Entity;
 // --------------------------------------------------------
 class World
 {
+	friend class Entity;
 private:
+	// --------------------------------------------------------
+	// An entry in the handle table. The generation is bumped 
+	// each time the slot's Entity is destroyed.
+	// --------------------------------------------------------
+	struct EntitySlot
+	{
+		Entity* entity = nullptr;
+		uint32_t generation = 0;
+	};
+
+	// --------------------------------------------------------
+	// Two bodies that were touching as of lastFrame
+	// --------------------------------------------------------
+	struct CollisionPair
+	{
+		const btCollisionObject* body0;
+		const btCollisionObject* body1;
+		Entity* entity0;
+		Entity* entity1;
+		unsigned int lastFrame;
+	};
+
+	// The handle table is allocated in fixed pages that never move, 
+	// so handles can be resolved while other threads add slots
+	static const uint32_t SLOT_PAGE_SIZE = 1024;
+	static const uint32_t MAX_SLOT_PAGES = 4096;
+
+	// Spawned entities, densely packed. Order changes as entities are destroyed.
 	std::vector<Entity*> m_entities;
-	std::map<std::string, Mesh*> m_meshes;
+
+	// Spawned entities that aren't asleep, which are the only ones ticked.
+	// Sleep requests are applied once ticking is finished.
+	std::vector<Entity*> m_activeEntities;
+	std::vector<Entity*> m_sleepRequests;
+
+	// Transforms whose world matrix changed in the last UpdateTransforms
+	std::vector<Transform*> m_changedTransforms;
+
+	// --------------------------------------------------------
+	// A collision object taken out of the physics world while
+	// restoring a snapshot, and the filter to add it back with
+	// --------------------------------------------------------
+	struct RemovedObject
+	{
+		btCollisionObject* object;
+		int group;
+		int mask;
+		size_t order;
+	};
+	std::vector<Entity*> m_snapshotEntities;
+	std::vector<Entity*> m_snapshotParents;
+	std::vector<RemovedObject> m_removedObjects;
+	std::atomic<EntitySlot*> m_slotPages[MAX_SLOT_PAGES];
+	uint32_t m_slotCount = 0;
+	std::vector<uint32_t> m_freeSlots;
+	SpinLock m_slotLock;
+
+	// Entities by name and by tag, in no particular order
+	// Lists are kept when they empty out, so respawning doesn't reallocate them.
+	std::unordered_map<std::string, std::vector<Entity*>> m_nameIndex;
+	std::unordered_map<std::string, uint32_t> m_tagIds;
+	std::vector<std::string> m_tagNames; // Indexed by tag id
+	std::vector<std::vector<Entity*>> m_tagIndex; // Indexed by tag id
+	const std::vector<Entity*> m_noEntities;
+	SpinLock m_tagLock;
+
+	// Counted resources, which outlive everything holding handles to them.
+	// Textures come first so they're freed after the materials using them.
+	std::atomic<uint64_t> m_resourceClock{ 0 };
+	ResourceCache<ID3D11ShaderResourceView> m_textures{ "Texture", &m_resourceClock };
+	ResourceCache<Mesh> m_meshes{ "Mesh", &m_resourceClock };
+	ResourceCache<Material> m_materials{ "Material", &m_resourceClock };
+	size_t m_resourceBudget = SIZE_MAX;
+
 	std::map<std::string, SimpleVertexShader*> m_vertexShaders;
 	std::map<std::string, SimplePixelShader*> m_pixelShaders;
-	std::map<std::string, Material*> m_materials;
-	std::map<std::string, ID3D11ShaderResourceView*> m_SRVs;
 	std::map<std::string, ID3D11ShaderResourceView*>m_cubeSRVs;
 	std::map<std::string, ID3D11SamplerState*> m_samplerStates;
 	std::map<std::string, ID3D11RasterizerState*> m_rastStates;
@@ -42,8 +135,44 @@ private:
 	std::map<std::string, DirectX::SpriteBatch*> m_spriteBatches;
 	std::map<std::string, DirectX::SpriteFont*> m_fonts;
 	std::map<std::string, FMOD::Sound*> m_sounds;
-	std::queue<Entity*> m_spawnQueue;
-	std::queue<Entity*> m_destroyQueue;
+	std::map<std::string, Prefab*> m_prefabs;
+
+	// --------------------------------------------------------
+	// A run of a command buffer's spawn queue instantiated together. 
+	// Batches have their components started together in Flush.
+	// --------------------------------------------------------
+	struct SpawnBatch
+	{
+		size_t first;
+		size_t count;
+	};
+
+	// --------------------------------------------------------
+	// Structural changes recorded by one thread, applied in Flush.
+	// Only the owning thread writes to a buffer.
+	// --------------------------------------------------------
+	struct CommandBuffer
+	{
+		std::vector<Entity*> spawnQueue;
+		std::vector<SpawnBatch> spawnBatches;
+		std::vector<EntityHandle> destroyQueue;
+		std::vector<std::function<void()>> deferred;
+	};
+
+	// Buffer 0 belongs to the main thread, buffers 1 to MAX_WORKER_THREADS
+	// to registered workers, the next MAX_ENGINE_WORKERS to the job system's
+	// workers, and the rest are lent to other threads until they exit.
+	// More live unregistered threads than spare buffers is fatal.
+	static const int MAX_ENGINE_WORKERS = 32;
+	static const int MAX_COMMAND_BUFFERS = 96;
+	CommandBuffer m_commandBuffers[MAX_COMMAND_BUFFERS];
+
+	// --------------------------------------------------------
+	// Gives the calling thread a buffer without checking the index,
+	// handing back any buffer it borrowed
+	// --------------------------------------------------------
+	void UseCommandBuffer(int index);
+	std::thread::id m_mainThread;
 	LightComponent::Light m_lights[MAX_LIGHTS];
 	int m_activeLightCount = 0;
 	ID3D11Device* m_device = nullptr;
@@ -52,14 +181,49 @@ private:
 	// Bullet
 	btDefaultCollisionConfiguration* m_collisionConfiguration;
 	btCollisionDispatcher* m_dispatcher;
-	btBroadphaseInterface* m_overlappingPairCache;
+	btDbvtBroadphase* m_overlappingPairCache;
 	btSequentialImpulseConstraintSolver* m_solver;
-	btDiscreteDynamicsWorld* m_dynamicsWorld;
+	SnapshotDynamicsWorld* m_dynamicsWorld;
 	btVector3 m_gravity = btVector3(0, -9.81f, 0);
-	std::map<const btCollisionObject*, std::set<const btCollisionObject*>> m_collisionMap;
+	std::vector<CollisionPair> m_collisionPairs;
+	CollisionShapeCache m_shapeCache;
+	CollisionLayers m_collisionLayers;
+	btGhostPairCallback m_ghostPairCallback;
+	std::vector<TriggerComponent*> m_triggers;
+	unsigned int m_collisionFrame = 0;
 
 	DirectX::CommonStates* m_states;
 
+	// Transforms of every spawned Entity, parents ahead of children
+	TransformHierarchy m_transformHierarchy;
+
+	// Worker threads for engine systems, registered as workers 1 and up
+	JobSystem m_jobSystem;
+
+	LevelStreamer m_levelStreamer;
+
+	// Asset files being watched for hot reloading
+	FileWatcher m_fileWatcher;
+	std::map<std::string, FileWatcher::WatchId> m_meshWatches;
+
+	// --------------------------------------------------------
+	// Swaps a hot reloaded Mesh into its name's handles
+	// --------------------------------------------------------
+	void SwapMesh(const std::string& name, Mesh* mesh, uint16_t sortId);
+	void WatchShader(ISimpleShader* shader, LPCWSTR shaderFile);
+
+	// Bounds of every Entity with a mesh, for scene queries and culling
+	DynamicBVH m_spatialTree;
+
+	// Rendering
+	RenderQueue m_renderQueue;
+	FrustumCuller m_frustumCuller;
+	std::vector<Entity*> m_cullCandidates;
+	std::vector<Entity*> m_visibleEntities;
+	uint16_t m_nextMeshSortId = 0;
+	uint16_t m_nextMaterialSortId = 0;
+	std::map<std::pair<SimpleVertexShader*, SimplePixelShader*>, uint16_t> m_shaderSortIds;
+
 	World();
 	// --------------------------------------------------------
 	// Rebuilds the array of light structs that will be sent to the GPU.
@@ -71,6 +235,128 @@ private:
 	// in the destroy queue
 	// --------------------------------------------------------
 	void Flush();
+
+	// --------------------------------------------------------
+	// Starts a batch's components one component index at a time,
+	// then adds the batch to the entity list
+	// --------------------------------------------------------
+	void SpawnBatchNow(std::vector<Entity*>& spawnQueue, SpawnBatch batch);
+
+	// --------------------------------------------------------
+	// Removes an Entity, and the Entities attached to it, 
+	// from every system and frees them
+	// --------------------------------------------------------
+	void DestroyNow(Entity* toDestroy);
+
+	// --------------------------------------------------------
+	// Returns the calling thread's command buffer
+	// --------------------------------------------------------
+	CommandBuffer& GetCommandBuffer();
+
+	// --------------------------------------------------------
+	// Brings every spawned Transform's world matrix up to date,
+	// batched and split across the job system. Only transforms that
+	// changed, and their children, are recalculated.
+	// --------------------------------------------------------
+	void UpdateTransforms();
+
+	// --------------------------------------------------------
+	// Recalculates dirty transforms and refits the spatial tree
+	// with the bounds of the Entities that moved
+	// --------------------------------------------------------
+	void UpdateSpatialTree();
+
+	// --------------------------------------------------------
+	// Adds, moves or removes an Entity's proxy in the spatial tree.
+	// The Entity's world matrix should already be up to date.
+	// --------------------------------------------------------
+	void UpdateSpatialProxy(Entity* entity);
+
+	// --------------------------------------------------------
+	// Sends enter and exit events for triggers whose overlaps changed
+	// --------------------------------------------------------
+	void UpdateTriggers();
+
+	// --------------------------------------------------------
+	// Moves entities between the active list and sleep. Called by Entity.
+	// --------------------------------------------------------
+	void RequestSleep(Entity* entity);
+	void WakeEntity(Entity* entity);
+	void RemoveFromActive(Entity* entity);
+
+	// --------------------------------------------------------
+	// Puts entities that asked to sleep this frame to sleep
+	// --------------------------------------------------------
+	void ApplySleepRequests();
+
+	// --------------------------------------------------------
+	// Takes every collision object out of the physics world and
+	// resets Bullet's caches, so restored snapshots always start
+	// from the same broadphase and contact state
+	// --------------------------------------------------------
+	void RemoveCollisionObjects();
+
+	// --------------------------------------------------------
+	// Adds objects removed by RemoveCollisionObjects back,
+	// in the order of the entity list
+	// --------------------------------------------------------
+	void ReaddCollisionObjects();
+
+	// --------------------------------------------------------
+	// Physics query helpers
+	// --------------------------------------------------------
+	RaycastHit CastRay(const RaycastQuery& query);
+	RaycastHit Sweep(const btConvexShape* shape, DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, DirectX::XMFLOAT4 rotation, uint32_t layerMask);
+	void Overlap(btCollisionShape* shape, DirectX::XMFLOAT3 center, DirectX::XMFLOAT4 rotation, uint32_t layerMask, std::vector<EntityHandle>& results);
+
+	// --------------------------------------------------------
+	// Adds or removes an Entity from the name and tag indices
+	// --------------------------------------------------------
+	void IndexEntity(Entity* entity);
+	void UnindexEntity(Entity* entity);
+	void RemoveFromNameIndex(Entity* entity);
+
+	// --------------------------------------------------------
+	// Called by spawned Entities so the indices stay current
+	// --------------------------------------------------------
+	void OnEntityRenamed(Entity* entity, const std::string& newName);
+	// @param size_t tagEntry index of the tag in the Entity's tag list
+	void OnEntityTagAdded(Entity* entity, size_t tagEntry);
+	void OnEntityTagRemoved(Entity* entity, size_t tagEntry);
+
+	// --------------------------------------------------------
+	// Returns the id for a tag, assigning one if it's new
+	// --------------------------------------------------------
+	uint32_t InternTag(const std::string& tag);
+
+	// --------------------------------------------------------
+	// Looks up a tag's id without assigning one
+	// @returns bool whether the tag has an id
+	// --------------------------------------------------------
+	bool FindTagId(const std::string& tag, uint32_t& tagId);
+
+	// --------------------------------------------------------
+	// Returns the tag an id was assigned to
+	// --------------------------------------------------------
+	std::string GetTagName(uint32_t tagId);
+
+	// --------------------------------------------------------
+	// Reserves a handle table slot for a new Entity
+	// --------------------------------------------------------
+	EntityHandle AllocateSlot(Entity* entity);
+
+	// --------------------------------------------------------
+	// Invalidates every handle to the slot and makes it reusable
+	// --------------------------------------------------------
+	void FreeSlot(EntityHandle handle);
+
+	// --------------------------------------------------------
+	// Collision pair book-keeping. Each Entity keeps the indices of
+	// its own pairs, so lookups and removal only visit that Entity's contacts.
+	// --------------------------------------------------------
+	size_t FindCollisionPair(Entity* entity, const btCollisionObject* body0, const btCollisionObject* body1);
+	size_t AddCollisionPair(const btCollisionObject* body0, const btCollisionObject* body1, Entity* entity0, Entity* entity1);
+	void RemoveCollisionPair(size_t index);
 public:
 	CameraComponent* m_mainCamera = nullptr;
 
@@ -85,8 +371,53 @@ public:
 	// --------------------------------------------------------
 	btDiscreteDynamicsWorld* GetPhysicsWorld() { return m_dynamicsWorld; }
 
+	// --------------------------------------------------------
+	// Returns the collision shapes shared between rigid bodies
+	// --------------------------------------------------------
+	CollisionShapeCache* GetShapeCache() { return &m_shapeCache; }
+
+	// --------------------------------------------------------
+	// Returns the named collision layers and which of them collide.
+	// Its stats cover the last physics step.
+	// --------------------------------------------------------
+	CollisionLayers* GetCollisionLayers() { return &m_collisionLayers; }
+
+	// --------------------------------------------------------
+	// Adds or removes a started TriggerComponent's ghost object.
+	// Called by TriggerComponent.
+	// --------------------------------------------------------
+	void AddTrigger(TriggerComponent* trigger);
+	void RemoveTrigger(TriggerComponent* trigger);
+
 	void SetGravity(btVector3 gravity);
 
+	// --------------------------------------------------------
+	// Captures the simulation state at the end of the last Tick:
+	// rigid bodies, transforms and parents, collision pairs, trigger
+	// overlaps, sleeping entities, Bullet's leftover step time and
+	// solver seed, and whatever components write in SaveState.
+	// Reuses the snapshot's memory, so keep snapshots around.
+	// --------------------------------------------------------
+	void CaptureSnapshot(WorldSnapshot& snapshot);
+
+	// --------------------------------------------------------
+	// Rolls the simulation back to a snapshot. The same entities must
+	// exist as when it was captured; spawning and destroying aren't
+	// rolled back. Bullet's contact cache is rebuilt from scratch, so
+	// replaying the same ticks from the same snapshot always gives
+	// byte-identical snapshots.
+	// @returns bool false if the snapshot doesn't match the World's
+	// entities, in which case nothing was changed, or if a component
+	// couldn't read back its state or a parent would make a cycle, in
+	// which case everything else was still restored
+	// --------------------------------------------------------
+	bool RestoreSnapshot(const WorldSnapshot& snapshot);
+
+	// --------------------------------------------------------
+	// Number of ticks simulated, which snapshots are labelled with
+	// --------------------------------------------------------
+	unsigned int GetFrame() { return m_collisionFrame; }
+
 	void SetDevice(ID3D11Device* device)
 	{
 		m_device = device;
@@ -100,27 +431,158 @@ public:
 	// Create an Entity in the world. 
 	// Note: you'll have to manually call Start on all of the components
 	// After Instantiating an Entity.
+	// Instantiate, InstantiateBatch and Destroy may be called from any thread.
+	// The changes are applied on the main thread in the next Flush.
 	// @param const std::string& name name of the entity
-	// @returns Entity* the created Entity pointer
+	// @returns EntityHandle handle to the created Entity
+	// --------------------------------------------------------
+	EntityHandle Instantiate(const std::string& name);
+
+	// --------------------------------------------------------
+	// Spawns many copies of a prefab at once. Pools are grown up front,
+	// the copies are queued as a single batch, and their components
+	// are started together in the next Flush.
+	// Note: unlike Instantiate, you don't have to call Start yourself.
+	// @param const Prefab& prefab the layout to copy
+	// @param size_t count how many copies to make
+	// @param std::function<void(Entity*, size_t)> init optional per-copy setup, given the copy's index
+	// --------------------------------------------------------
+	void InstantiateBatch(const Prefab& prefab, size_t count, std::function<void(Entity*, size_t)> init = nullptr);
+
 	// --------------------------------------------------------
-	Entity* Instantiate(const std::string& name);
+	// Spawns count empty entities as a single batch, for loaders
+	// that set up each Entity themselves. Entities start out with
+	// only a Transform and no name.
+	// @param std::function<void(Entity*, size_t)> init per-Entity setup, given the Entity's index
+	// --------------------------------------------------------
+	void InstantiateBatch(size_t count, std::function<void(Entity*, size_t)> init);
+
+	// --------------------------------------------------------
+	// Like InstantiateBatch, but init can fail. If it returns false, the
+	// entities made so far are freed without ever spawning, and nothing
+	// is queued.
+	// @returns bool false if init failed
+	// --------------------------------------------------------
+	bool TryInstantiateBatch(size_t count, std::function<bool(Entity*, size_t)> init);
+
+	// --------------------------------------------------------
+	// Creates a prefab and adds it to the internal Prefab map
+	// --------------------------------------------------------
+	Prefab* CreatePrefab(const std::string& name);
+	Prefab* GetPrefab(const std::string& name);
 
 	// --------------------------------------------------------
 	// Finds an Entity with the provided name
-	// @returns Entity* the found Entity* or nullptr if not found
+	// @returns EntityHandle the found Entity, or an invalid handle if not found
 	// --------------------------------------------------------
-	Entity* Find(const std::string& name);
+	EntityHandle Find(const std::string& name);
 
 	// --------------------------------------------------------
 	// Finds the first entity containing the tag
-	// @returns Entity* the found Entity* or nullptr if not found
+	// @returns EntityHandle the found Entity, or an invalid handle if not found
 	// --------------------------------------------------------
-	Entity* FindWithTag(const std::string& tag);
+	EntityHandle FindWithTag(const std::string& tag);
+
+	// --------------------------------------------------------
+	// Returns every spawned entity containing the tag.
+	// The list belongs to the World and is only valid until the next
+	// spawn, destroy or tag change.
+	// --------------------------------------------------------
+	const std::vector<Entity*>& FindAllWithTag(const std::string& tag);
+
+	// --------------------------------------------------------
+	// Returns the Entity a handle refers to, or nullptr if it has been destroyed
+	// --------------------------------------------------------
+	Entity* Resolve(EntityHandle handle)
+	{
+		uint32_t page = handle.index / SLOT_PAGE_SIZE;
+		if (page >= MAX_SLOT_PAGES) {
+			return nullptr;
+		}
+		EntitySlot* slots = m_slotPages[page].load(std::memory_order_acquire);
+		if (!slots) {
+			return nullptr;
+		}
+		const EntitySlot& slot = slots[handle.index % SLOT_PAGE_SIZE];
+		return slot.generation == handle.generation ? slot.entity : nullptr;
+	}
+
+	// --------------------------------------------------------
+	// Returns every spawned Entity, densely packed in no particular order
+	// --------------------------------------------------------
+	const std::vector<Entity*>& GetEntities() { return m_entities; }
+
+	// --------------------------------------------------------
+	// Grows the Entity pool, or a component type's pool, ahead of 
+	// time so spawning that many doesn't have to allocate
+	// --------------------------------------------------------
+	void ReserveEntities(size_t count);
+	template <class T>
+	void ReserveComponents(size_t count) { ObjectPool<T>::GetInstance().Reserve(count); }
+
+	// --------------------------------------------------------
+	// Returns pool and small buffer counters. When entities are spawned and
+	// destroyed at a steady rate, the slab and heap spill counts stop growing.
+	// --------------------------------------------------------
+	AllocationStats GetAllocationStats();
+
+	// Worker threads 1 to MAX_WORKER_THREADS have their own command buffers
+	static const int MAX_WORKER_THREADS = 32;
+
+	// --------------------------------------------------------
+	// Gives the calling thread a fixed command buffer. Buffers are applied
+	// in index order during Flush, so worker threads that register with 
+	// a stable index get deterministic spawn and destroy order.
+	// Threads that don't register still work, borrowing a buffer until
+	// they exit. Indices out of range abort. These indices are only for
+	// game threads; the job system's workers have buffers of their own.
+	// @param int workerIndex from 1 to MAX_WORKER_THREADS
+	// --------------------------------------------------------
+	void RegisterWorkerThread(int workerIndex);
+
+	// --------------------------------------------------------
+	// Returns the World's worker threads, for splitting up work like
+	// ParallelFor. Its workers have their own command buffers, so they
+	// don't use up RegisterWorkerThread's indices. Jobs can record
+	// spawns and destroys, but mustn't change Transforms.
+	// --------------------------------------------------------
+	JobSystem* GetJobSystem() { return &m_jobSystem; }
+
+	// --------------------------------------------------------
+	// Returns the streamer that loads level cells around the main camera
+	// --------------------------------------------------------
+	LevelStreamer* GetLevelStreamer() { return &m_levelStreamer; }
+
+	// --------------------------------------------------------
+	// Starts or stops watching asset files for hot reloading. Meshes
+	// made from files, shaders and particle configs are reloaded on a
+	// background thread when their files change, and swapped in at the
+	// start of the next tick. Off by default. Particle configs are only
+	// watched for emitters made while it's on.
+	// --------------------------------------------------------
+	void SetHotReload(bool enabled);
+	FileWatcher* GetFileWatcher() { return &m_fileWatcher; }
+
+	// --------------------------------------------------------
+	// Runs a function on the main thread during the next Flush, before
+	// spawns and destroys are applied. Use this for structural changes 
+	// to live entities from worker threads, like adding a component.
+	// --------------------------------------------------------
+	void Defer(std::function<void()> command);
+
+	// --------------------------------------------------------
+	// Adds a component to an Entity during the next Flush, and starts it
+	// if the Entity has already started. Safe to call from any thread.
+	// --------------------------------------------------------
+	template <class T>
+	void DeferAddComponent(EntityHandle handle, std::function<void(T*)> init = nullptr);
 
 	// --------------------------------------------------------
 	// Destroys an Entity. It will not be rendered after this.
+	// Destroying an Entity more than once, or through a stale handle, is safe.
 	// --------------------------------------------------------
 	void Destroy(Entity* entity);
+	void Destroy(EntityHandle handle);
 
 	// --------------------------------------------------------
 	// Destroys all entities that have been instantiated
@@ -128,11 +590,96 @@ public:
 	void DestroyAllEntities();
 
 	// --------------------------------------------------------
-	// Creates a mesh and adds it to the internal Mesh map
+	// Scene queries against the bounds of every Entity with a mesh.
+	// Results are appended to the output list. Bounds are slightly 
+	// enlarged, so use these as a broad phase.
+	// --------------------------------------------------------
+	void QueryBox(const DirectX::BoundingBox& box, std::vector<Entity*>& results);
+	void QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<Entity*>& results);
+	void QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<Entity*>& results);
+
+	// --------------------------------------------------------
+	// Finds every Entity whose bounds the ray passes through, nearest first
+	// @param DirectX::XMFLOAT3 direction normalized ray direction
+	// --------------------------------------------------------
+	void QueryRay(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, std::vector<BoundsHit>& results);
+
+	// --------------------------------------------------------
+	// Physics queries against the colliders of every rigid body. 
+	// Call these from the main thread, outside of the physics step.
+	// layerMask picks the layers a query can hit, one bit per layer
+	// (see CollisionLayers::GetGroup). It ignores the layer matrix.
+	// --------------------------------------------------------
+
+	// --------------------------------------------------------
+	// Finds the closest collider a ray hits
+	// @param DirectX::XMFLOAT3 direction normalized ray direction
+	// --------------------------------------------------------
+	RaycastHit Raycast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, uint32_t layerMask = 0xFFFFFFFF);
+
+	// --------------------------------------------------------
+	// Casts many rays at once, split across the job system.
+	// results[i] is the closest hit for queries[i].
+	// --------------------------------------------------------
+	void RaycastBatch(const std::vector<RaycastQuery>& queries, std::vector<RaycastHit>& results);
+
+	// --------------------------------------------------------
+	// Moves a shape along a ray and finds the first collider it touches
+	// @param DirectX::XMFLOAT3 direction normalized direction to move in
+	// --------------------------------------------------------
+	RaycastHit SweepSphere(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, float radius, uint32_t layerMask = 0xFFFFFFFF);
+	RaycastHit SweepBox(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, 
+		DirectX::XMFLOAT3 halfExtents, DirectX::XMFLOAT4 rotation = DirectX::XMFLOAT4(0, 0, 0, 1), uint32_t layerMask = 0xFFFFFFFF);
+
+	// --------------------------------------------------------
+	// Finds every Entity whose collider overlaps a shape. 
+	// Results are appended to the output list, once per Entity.
+	// --------------------------------------------------------
+	void OverlapSphere(DirectX::XMFLOAT3 center, float radius, std::vector<EntityHandle>& results, uint32_t layerMask = 0xFFFFFFFF);
+	void OverlapBox(DirectX::XMFLOAT3 center, DirectX::XMFLOAT3 halfExtents, DirectX::XMFLOAT4 rotation, std::vector<EntityHandle>& results, uint32_t layerMask = 0xFFFFFFFF);
+
+	// --------------------------------------------------------
+	// Creates a mesh and adds it to the Mesh cache. Meshes loaded
+	// from a file can be evicted, and are loaded again when asked for.
+	// --------------------------------------------------------
+	MeshHandle CreateMesh(const std::string& name, Vertex* vertices, int numVertices, unsigned int* indices, int numIndices, ID3D11Device* device);
+	MeshHandle CreateMesh(const std::string& name, const char* file, ID3D11Device* device);
+	MeshHandle GetMesh(const std::string& name);
+
+	// --------------------------------------------------------
+	// Adds a Mesh made elsewhere, e.g. on a loading thread, to the Mesh cache.
+	// The World owns it from then on.
+	// @param const char * file the file it was loaded from, so it can be evicted and loaded again, or nullptr
+	// --------------------------------------------------------
+	MeshHandle AddMesh(const std::string& name, Mesh* mesh, const char* file = nullptr, ID3D11Device* device = nullptr);
+
+	// --------------------------------------------------------
+	// Removes a resource from its cache. It's freed once nothing
+	// holds a handle to it.
+	// --------------------------------------------------------
+	void DestroyMesh(const std::string& name);
+	void DestroyMaterial(const std::string& name);
+	void DestroyTexture(const std::string& name);
+
+	// --------------------------------------------------------
+	// Sets the estimated bytes the meshes, textures and materials may
+	// use. Past it, resources without handles are evicted at the end
+	// of each tick, least recently used first. Unlimited by default.
+	// --------------------------------------------------------
+	void SetResourceBudget(size_t bytes) { m_resourceBudget = bytes; }
+
+	// --------------------------------------------------------
+	// Frees replaced resources nothing uses any more, and evicts
+	// resources until the caches are within the budget.
+	// Called at the end of each tick.
 	// --------------------------------------------------------
-	Mesh* CreateMesh(const std::string& name, Vertex* vertices, int numVertices, unsigned int* indices, int numIndices, ID3D11Device* device);
-	Mesh* CreateMesh(const std::string& name, const char* file, ID3D11Device* device);
-	Mesh* GetMesh(const std::string& name);
+	void CollectResources();
+
+	// --------------------------------------------------------
+	// Lists every cached resource with its size and handle count
+	// @returns size_t the estimated bytes used by loaded resources
+	// --------------------------------------------------------
+	size_t GetResourceReport(std::vector<ResourceReportEntry>& report);
 
 	// --------------------------------------------------------
 	// Creates a vertex shader and adds it to the internal VS map
@@ -147,18 +694,19 @@ public:
 	SimplePixelShader* GetPixelShader(const std::string& name);
 
 	// --------------------------------------------------------
-	// Creates a Material and adds it to the internal Materials map
+	// Creates a Material and adds it to the Material cache. It holds
+	// handles to the diffuse and normal textures if they're cached.
 	// --------------------------------------------------------
-	Material* CreateMaterial(const std::string& name, SimpleVertexShader* vertexShader, SimplePixelShader* pixelShader,
+	MaterialHandle CreateMaterial(const std::string& name, SimpleVertexShader* vertexShader, SimplePixelShader* pixelShader,
 		ID3D11ShaderResourceView* diffuseSRV, ID3D11ShaderResourceView* normalSRV, ID3D11ShaderResourceView* reflectionSRV,
 		ID3D11SamplerState* samplerState, ID3D11BlendState* blendState = nullptr, ID3D11DepthStencilState* depthStencilState = nullptr);
-	Material* GetMaterial(const std::string& name);
+	MaterialHandle GetMaterial(const std::string& name);
 
 	// --------------------------------------------------------
-	// Creates a shader resource view and returns it
+	// Creates a shader resource view and adds it to the Texture cache
 	// --------------------------------------------------------
-	ID3D11ShaderResourceView* CreateTexture(const std::string& name, ID3D11Device* device, ID3D11DeviceContext* context, const wchar_t* fileName);
-	ID3D11ShaderResourceView* GetTexture(const std::string& name);
+	TextureHandle CreateTexture(const std::string& name, ID3D11Device* device, ID3D11DeviceContext* context, const wchar_t* fileName);
+	TextureHandle GetTexture(const std::string& name);
 
 	// --------------------------------------------------------
 	// Creates a cube texture shader resource view and returns it
@@ -209,6 +757,11 @@ public:
 	FMOD::Sound* CreateSound(const std::string& name, const char* path);
 	FMOD::Sound* GetSound(const std::string& name);
 
+	// --------------------------------------------------------
+	// Returns the name a sound was created with, or an empty string
+	// --------------------------------------------------------
+	std::string GetSoundName(FMOD::Sound* sound);
+
 
 	// Lifecycle methods for Entities
 	void OnMouseDown(WPARAM buttonState, int x, int y);
@@ -224,5 +777,15 @@ public:
 	// --------------------------------------------------------
 	void DrawEntities(ID3D11DeviceContext* context, DirectX::SpriteBatch* spriteBatch, int screenWidth, int screenHeight);
 
+	// --------------------------------------------------------
+	// Returns draw call and state change counters for the last drawn frame
+	// --------------------------------------------------------
+	const RenderStats& GetRenderStats() { return m_renderQueue.GetStats(); }
+
+	// --------------------------------------------------------
+	// Returns how many entities were visible and culled in the last drawn frame
+	// --------------------------------------------------------
+	const CullStats& GetCullStats() { return m_frustumCuller.GetStats(); }
+
 	~World();
-};
\ No newline at end of file
+};
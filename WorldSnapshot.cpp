@@ -0,0 +1,264 @@
+#include "WorldSnapshot.h"
+#include <utility>
+
+namespace
+{
+	// Equal runs shorter than this are folded into the surrounding
+	// literal, since starting a new run costs about as much
+	const size_t MIN_MATCH = 8;
+
+	void WriteVarint(std::vector<uint8_t>& out, size_t value)
+	{
+		while (value >= 0x80) {
+			out.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8_t)value);
+	}
+
+	bool ReadVarint(SnapshotReader& reader, size_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			uint8_t byte;
+			if (!reader.Read(byte)) {
+				return false;
+			}
+			value |= (size_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Counts matching bytes from start, comparing a word at a time where it can
+	size_t MatchLength(const uint8_t* a, const uint8_t* b, size_t start, size_t end)
+	{
+		size_t i = start;
+		while (i + sizeof(uint64_t) <= end) {
+			uint64_t wordA, wordB;
+			std::memcpy(&wordA, a + i, sizeof(uint64_t));
+			std::memcpy(&wordB, b + i, sizeof(uint64_t));
+			if (wordA != wordB) {
+				break;
+			}
+			i += sizeof(uint64_t);
+		}
+		while (i < end && a[i] == b[i]) {
+			++i;
+		}
+		return i - start;
+	}
+}
+
+void SnapshotWriter::WriteVector(const btVector3& vector)
+{
+	Write(vector.x());
+	Write(vector.y());
+	Write(vector.z());
+}
+
+void SnapshotWriter::WriteTransform(const btTransform& transform)
+{
+	const btMatrix3x3& basis = transform.getBasis();
+	WriteVector(basis[0]);
+	WriteVector(basis[1]);
+	WriteVector(basis[2]);
+	WriteVector(transform.getOrigin());
+}
+
+bool SnapshotReader::ReadVector(btVector3& vector)
+{
+	btScalar x, y, z;
+	if (!Read(x) || !Read(y) || !Read(z)) {
+		return false;
+	}
+	vector.setValue(x, y, z);
+	return true;
+}
+
+bool SnapshotReader::ReadTransform(btTransform& transform)
+{
+	btVector3 row0, row1, row2, origin;
+	if (!ReadVector(row0) || !ReadVector(row1) || !ReadVector(row2) || !ReadVector(origin)) {
+		return false;
+	}
+	transform.getBasis().setValue(
+		row0.x(), row0.y(), row0.z(),
+		row1.x(), row1.y(), row1.z(),
+		row2.x(), row2.y(), row2.z());
+	transform.setOrigin(origin);
+	return true;
+}
+
+SnapshotReader SnapshotReader::ReadBlock(size_t size)
+{
+	if (m_failed || size > m_size - m_offset) {
+		m_failed = true;
+		return SnapshotReader(nullptr, 0);
+	}
+	SnapshotReader block(m_data + m_offset, size);
+	m_offset += size;
+	return block;
+}
+
+void WorldSnapshot::Diff(const WorldSnapshot& base, std::vector<uint8_t>& delta) const
+{
+	delta.clear();
+	SnapshotWriter header(delta);
+	header.Write(m_frame);
+	header.Write((uint64_t)m_data.size());
+	header.Write((uint64_t)base.m_data.size());
+
+	// Alternating runs: bytes copied from base, then bytes stored in the delta
+	const uint8_t* target = m_data.data();
+	const uint8_t* source = base.m_data.data();
+	size_t size = m_data.size();
+	size_t shared = size < base.m_data.size() ? size : base.m_data.size();
+	size_t i = 0;
+	while (i < size) {
+		size_t copy = i < shared ? MatchLength(target, source, i, shared) : 0;
+		i += copy;
+
+		size_t literalStart = i;
+		while (i < size) {
+			if (i < shared && target[i] == source[i]) {
+				size_t match = MatchLength(target, source, i, i + MIN_MATCH < shared ? i + MIN_MATCH : shared);
+				if (match == MIN_MATCH || i + match == size) {
+					break;
+				}
+				i += match;
+			}
+			else {
+				++i;
+			}
+		}
+
+		WriteVarint(delta, copy);
+		WriteVarint(delta, i - literalStart);
+		delta.insert(delta.end(), target + literalStart, target + i);
+	}
+}
+
+bool WorldSnapshot::Patch(const WorldSnapshot& base, const std::vector<uint8_t>& delta)
+{
+	SnapshotReader reader(delta.data(), delta.size());
+	uint32_t frame;
+	uint64_t size, baseSize;
+	if (!reader.Read(frame) || !reader.Read(size) || !reader.Read(baseSize) || baseSize != base.m_data.size()) {
+		return false;
+	}
+
+	m_data.resize((size_t)size);
+	size_t position = 0;
+	while (position < size) {
+		size_t copy, literal;
+		if (!ReadVarint(reader, copy) || !ReadVarint(reader, literal)) {
+			return false;
+		}
+		if (position > baseSize || copy > baseSize - position || copy > size - position) {
+			return false;
+		}
+		std::memcpy(m_data.data() + position, base.m_data.data() + position, copy);
+		position += copy;
+
+		if (literal > size - position || !reader.ReadBytes(m_data.data() + position, literal)) {
+			return false;
+		}
+		position += literal;
+	}
+	m_frame = frame;
+	return reader.AtEnd();
+}
+
+SnapshotHistory::SnapshotHistory(size_t capacity)
+	: m_capacity(capacity > 0 ? capacity : 1)
+{
+}
+
+void SnapshotHistory::Push(const WorldSnapshot& snapshot)
+{
+	if (m_hasLatest) {
+		Entry entry;
+		entry.frame = m_latest.GetFrame();
+		if (!m_spareDeltas.empty()) {
+			entry.delta.swap(m_spareDeltas.back());
+			m_spareDeltas.pop_back();
+		}
+		m_latest.Diff(snapshot, entry.delta);
+		m_older.push_front(std::move(entry));
+	}
+	m_latest = snapshot;
+	m_hasLatest = true;
+
+	while (GetCount() > m_capacity) {
+		m_spareDeltas.push_back(std::move(m_older.back().delta));
+		m_older.pop_back();
+	}
+}
+
+bool SnapshotHistory::Get(uint32_t frame, WorldSnapshot& snapshot) const
+{
+	if (!m_hasLatest) {
+		return false;
+	}
+	snapshot = m_latest;
+	if (snapshot.GetFrame() == frame) {
+		return true;
+	}
+
+	// Step back one frame at a time from the newest
+	WorldSnapshot older;
+	for (const Entry& entry : m_older) {
+		if (!older.Patch(snapshot, entry.delta)) {
+			return false;
+		}
+		std::swap(snapshot, older);
+		if (entry.frame == frame) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SnapshotHistory::Truncate(uint32_t frame)
+{
+	if (m_hasLatest && m_latest.GetFrame() == frame) {
+		return true;
+	}
+	WorldSnapshot target;
+	if (!Get(frame, target)) {
+		return false;
+	}
+
+	// The target's own entry goes too, since it's now the newest
+	while (!m_older.empty()) {
+		m_spareDeltas.push_back(std::move(m_older.front().delta));
+		bool reached = m_older.front().frame == frame;
+		m_older.pop_front();
+		if (reached) {
+			break;
+		}
+	}
+	m_latest = std::move(target);
+	return true;
+}
+
+void SnapshotHistory::Clear()
+{
+	for (Entry& entry : m_older) {
+		m_spareDeltas.push_back(std::move(entry.delta));
+	}
+	m_older.clear();
+	m_hasLatest = false;
+}
+
+size_t SnapshotHistory::GetMemoryUsage() const
+{
+	size_t bytes = m_hasLatest ? m_latest.GetSize() : 0;
+	for (const Entry& entry : m_older) {
+		bytes += entry.delta.size();
+	}
+	return bytes;
+}
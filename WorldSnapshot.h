@@ -0,0 +1,190 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <bullet/btBulletDynamicsCommon.h>
+
+// --------------------------------------------------------
+// Appends raw values to a snapshot's byte buffer. Only write
+// values without padding, so equal states give equal bytes.
+// --------------------------------------------------------
+class SnapshotWriter
+{
+private:
+	std::vector<uint8_t>& m_data;
+public:
+	SnapshotWriter(std::vector<uint8_t>& data) : m_data(data) { }
+
+	template <class T>
+	void Write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Snapshots only hold trivially copyable values");
+		WriteBytes(&value, sizeof(T));
+	}
+
+	void WriteBytes(const void* data, size_t size)
+	{
+		size_t offset = m_data.size();
+		m_data.resize(offset + size);
+		std::memcpy(m_data.data() + offset, data, size);
+	}
+
+	// --------------------------------------------------------
+	// Bullet's vectors carry an unused fourth float, so only x, y and z are written
+	// --------------------------------------------------------
+	void WriteVector(const btVector3& vector);
+	void WriteTransform(const btTransform& transform);
+
+	size_t GetSize() const { return m_data.size(); }
+};
+
+// --------------------------------------------------------
+// Reads back values written by a SnapshotWriter. Reading
+// past the end fails, and leaves the value untouched.
+// --------------------------------------------------------
+class SnapshotReader
+{
+private:
+	const uint8_t* m_data;
+	size_t m_size;
+	size_t m_offset = 0;
+	bool m_failed = false;
+public:
+	SnapshotReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) { }
+
+	template <class T>
+	bool Read(T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Snapshots only hold trivially copyable values");
+		return ReadBytes(&value, sizeof(T));
+	}
+
+	bool ReadBytes(void* data, size_t size)
+	{
+		if (m_failed || size > m_size - m_offset) {
+			m_failed = true;
+			return false;
+		}
+		std::memcpy(data, m_data + m_offset, size);
+		m_offset += size;
+		return true;
+	}
+
+	bool ReadVector(btVector3& vector);
+	bool ReadTransform(btTransform& transform);
+
+	// --------------------------------------------------------
+	// Returns a reader over the next size bytes, and skips past them
+	// --------------------------------------------------------
+	SnapshotReader ReadBlock(size_t size);
+
+	bool Failed() const { return m_failed; }
+	bool AtEnd() const { return m_offset == m_size; }
+	size_t GetRemaining() const { return m_size - m_offset; }
+};
+
+// --------------------------------------------------------
+// Bullet's dynamics world, with access to the leftover time
+// it carries between fixed steps, which snapshots need to restore.
+// --------------------------------------------------------
+class SnapshotDynamicsWorld : public btDiscreteDynamicsWorld
+{
+public:
+	using btDiscreteDynamicsWorld::btDiscreteDynamicsWorld;
+
+	btScalar GetLocalTime() const { return m_localTime; }
+	void SetLocalTime(btScalar localTime) { m_localTime = localTime; }
+};
+
+// --------------------------------------------------------
+// The simulation state of the World at the end of a frame, made
+// by World::CaptureSnapshot. Snapshots of consecutive frames are
+// mostly the same bytes, so they can be stored as deltas.
+// --------------------------------------------------------
+class WorldSnapshot
+{
+	friend class World;
+private:
+	std::vector<uint8_t> m_data;
+	uint32_t m_frame = 0;
+public:
+	uint32_t GetFrame() const { return m_frame; }
+	const std::vector<uint8_t>& GetData() const { return m_data; }
+	size_t GetSize() const { return m_data.size(); }
+
+	// --------------------------------------------------------
+	// Byte comparison. A replay is deterministic if its
+	// snapshots equal the ones captured the first time.
+	// --------------------------------------------------------
+	bool operator==(const WorldSnapshot& other) const { return m_frame == other.m_frame && m_data == other.m_data; }
+	bool operator!=(const WorldSnapshot& other) const { return !(*this == other); }
+
+	// --------------------------------------------------------
+	// Encodes this snapshot as the bytes that differ from base.
+	// Unchanged runs cost a couple of bytes each.
+	// @param std::vector<uint8_t> & delta replaced with the encoded delta
+	// --------------------------------------------------------
+	void Diff(const WorldSnapshot& base, std::vector<uint8_t>& delta) const;
+
+	// --------------------------------------------------------
+	// Rebuilds this snapshot from base and a delta made by Diff against it
+	// @returns bool false if the delta is malformed or wasn't made from base
+	// --------------------------------------------------------
+	bool Patch(const WorldSnapshot& base, const std::vector<uint8_t>& delta);
+};
+
+// --------------------------------------------------------
+// The last few frames' snapshots, for rolling back. The newest
+// is kept whole, and each older frame as a delta from the one
+// after it, so recent frames are the cheapest to get back.
+// --------------------------------------------------------
+class SnapshotHistory
+{
+private:
+	struct Entry
+	{
+		uint32_t frame;
+		std::vector<uint8_t> delta; // Rebuilds this frame from the next newer one
+	};
+
+	size_t m_capacity;
+	WorldSnapshot m_latest;
+	bool m_hasLatest = false;
+	std::deque<Entry> m_older; // Newest first
+	std::vector<std::vector<uint8_t>> m_spareDeltas; // Buffers kept from dropped entries
+public:
+	// --------------------------------------------------------
+	// @param size_t capacity how many frames to keep
+	// --------------------------------------------------------
+	SnapshotHistory(size_t capacity = 16);
+
+	// --------------------------------------------------------
+	// Adds the newest frame. Frames must be pushed in order.
+	// The oldest frame is dropped when the history is full.
+	// --------------------------------------------------------
+	void Push(const WorldSnapshot& snapshot);
+
+	// --------------------------------------------------------
+	// Rebuilds a stored frame
+	// @returns bool false if the frame isn't in the history
+	// --------------------------------------------------------
+	bool Get(uint32_t frame, WorldSnapshot& snapshot) const;
+
+	// --------------------------------------------------------
+	// Drops every frame newer than the given one, so
+	// resimulated frames can be pushed in their place
+	// @returns bool false if the frame isn't in the history
+	// --------------------------------------------------------
+	bool Truncate(uint32_t frame);
+
+	void Clear();
+
+	size_t GetCount() const { return m_older.size() + (m_hasLatest ? 1 : 0); }
+
+	// --------------------------------------------------------
+	// Bytes used by the stored frames
+	// --------------------------------------------------------
+	size_t GetMemoryUsage() const;
+};